@@ -0,0 +1,890 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+// eventem_bench: throughput of the accumulation kernels, the decoders and the complete file to image
+// pipeline, without Python. The input is written by DataGenerator to a scratch directory, every
+// benchmark runs the detector classes directly with the same enable_* configuration the processor
+// classes use. Results are printed and written to a JSON file, so releases can be compared.
+//
+//   kernel/<kernel>:             accumulate_batch() on decoded events in memory, single thread
+//   decoder/<detector>:          file to PACBED (the cheapest kernel), per detector and format
+//   e2e/<detector>/<kernel>:     file to image for the kernel of every processor class
+//   threads/<detector>/<kernel>/<n>: CHEETAH, SIMULATED, ADVAPIX .t3p and .t3r with n decode threads
+//   verify/cheetah/<start>/<run>: COM images of CHEETAH scans starting at 0 s and right before a ToA
+//                                 and a TDC rollover, decoded serially (against the generated
+//                                 electrons), in parallel and from the index. Mismatches are
+//                                 reported and make the exit status 1.
+//
+// usage: eventem_bench [--json file] [--dir dir] [--filter text] [--runs n] [--scan n] [--dose d]
+//                      [--repetitions n] [--threads n] [--quick] [--keep] [--verbose]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <chrono>
+#include <thread>
+#include <ctime>
+
+#include "Cheetah.hpp"
+#include "Simulated.hpp"
+#include "Advapix.hpp"
+#include "Merlin.hpp"
+#include "Numpy.hpp"
+#include "DataGenerator.h"
+#include "PerfCounters.hpp"
+#include "CpuDispatch.h"
+
+struct Options
+{
+    std::string json_path = "eventem_bench.json";
+    std::string dir;
+    std::string filter;
+    int runs = 3;
+    int scan = 128;
+    double dose = 20;
+    int repetitions = 2;
+    int max_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    uint64_t kernel_events = 50000000;
+    double timeout = 120;
+    bool keep = false;
+    bool verbose = false;
+};
+
+struct Result
+{
+    std::string name;
+    std::string suite;
+    std::string detector;
+    std::string kernel;
+    int threads = 1;
+    int runs = 0;
+    double seconds = 0;     // median over the runs
+    double seconds_min = 0;
+    uint64_t events = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    bool timeout = false;
+    std::vector<std::pair<std::string, uint64_t>> counters; // of the median run
+};
+
+struct Measurement
+{
+    double seconds = 0;
+    bool timeout = false;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+};
+
+static Options options;
+static std::vector<Result> results;
+
+//--------------------------------------------------------------------------------------------------
+// images of all kernels, sized like the processor classes do
+//--------------------------------------------------------------------------------------------------
+
+struct Images
+{
+    int nx, ny, nxy, n_cam, rep;
+
+    std::vector<std::vector<size_t>> stem;
+    std::array<float, 2> radius_sqr;
+    std::array<float, 2> offset;
+    std::vector<std::array<float, 2>> radia_sqr;
+    std::vector<std::array<float, 2>> offsets;
+
+    std::vector<size_t> dose[2];
+    std::vector<size_t> sumx[2];
+    std::vector<size_t> sumy[2];
+    std::vector<size_t> var[2];
+
+    std::vector<size_t> pacbed;
+
+    int lower_left[2];
+    int upper_right[2];
+    std::vector<std::vector<uint64_t>> roi_scan_stack;
+    std::vector<std::vector<uint64_t>> roi_pattern_stack;
+    std::vector<uint64_t> roi_scan;
+    std::vector<uint64_t> roi_pattern;
+
+    size_t det_bin = 4;
+    size_t scan_bin = 1;
+    size_t chunksize = 16;
+    std::vector<uint64_t> counts;
+    std::vector<uint8_t> chunk_8[2];
+    std::vector<uint16_t> chunk_16[2];
+    std::vector<uint32_t> chunk_32[2];
+    std::mutex mtx[2];
+
+    // frame based
+    std::vector<int> detector_image;
+    std::vector<float> comx;
+    std::vector<float> comy;
+
+    Images(int _nx, int _ny, int _n_cam, int _rep, int n_stack) : nx(_nx), ny(_ny), nxy(_nx * _ny), n_cam(_n_cam), rep(_rep)
+    {
+        float c = n_cam / 2.0f;
+        float r = n_cam / 16.0f;
+        radius_sqr = {0, r * r};
+        offset = {c, c};
+        radia_sqr = {{0, r * r}, {4 * r * r, 9 * r * r}, {16 * r * r, 36 * r * r}};
+        offsets.assign(3, {c, c});
+        stem.assign(n_stack, std::vector<size_t>(nxy, 0));
+        for (int i = 0; i < 2; i++)
+        {
+            dose[i].assign(nxy, 0);
+            sumx[i].assign(nxy, 0);
+            sumy[i].assign(nxy, 0);
+            var[i].assign(nxy, 0);
+        }
+        pacbed.assign((size_t)n_cam * n_cam, 0);
+
+        lower_left[0] = nx / 4;
+        lower_left[1] = ny / 4;
+        upper_right[0] = 3 * nx / 4;
+        upper_right[1] = 3 * ny / 4;
+        size_t roi_size = (size_t)(upper_right[0] - lower_left[0]) * (upper_right[1] - lower_left[1]);
+        roi_scan_stack.assign(rep + 1, std::vector<uint64_t>(roi_size, 0));
+        roi_pattern_stack.assign(rep + 1, std::vector<uint64_t>((size_t)n_cam * n_cam, 0));
+        roi_scan.assign(roi_size, 0);
+        roi_pattern.assign((size_t)n_cam * n_cam, 0);
+
+        counts.assign(nxy / (scan_bin * scan_bin), 0);
+        size_t chunk = chunksize / scan_bin * nx / scan_bin * (n_cam / det_bin) * (n_cam / det_bin);
+        for (int i = 0; i < 2; i++)
+        {
+            chunk_8[i].assign(chunk, 0);
+            chunk_16[i].assign(chunk, 0);
+            chunk_32[i].assign(chunk, 0);
+        }
+
+        detector_image.assign((size_t)n_cam * n_cam, 0);
+        for (int y = 0; y < n_cam; y++)
+            for (int x = 0; x < n_cam; x++)
+                if ((x - c) * (x - c) + (y - c) * (y - c) <= r * r) detector_image[(size_t)y * n_cam + x] = 1;
+        comx.assign(n_stack * nxy, 0);
+        comy.assign(n_stack * nxy, 0);
+    };
+};
+
+static const std::vector<std::string> event_kernels = {"vstem", "multi_vstem", "com", "pacbed", "var", "roi", "count_chunked_8", "count_chunked_16", "count_chunked_32"};
+
+// kernel of the processor classes: vSTEM, Ricom, Pacbed, Var, Roi and FourD
+static const std::vector<std::string> processor_kernels = {"vstem", "com", "pacbed", "var", "roi", "count_chunked_8"};
+
+template <class Cam>
+bool enable_kernel(Cam &cam, const std::string &kernel, Images &img)
+{
+    if (kernel == "vstem") cam.enable_vSTEM(&img.radius_sqr, &img.offset, &img.stem);
+    else if (kernel == "multi_vstem") cam.enable_multi_vSTEM(&img.radia_sqr, &img.offsets, &img.stem);
+    else if (kernel == "com") cam.enable_Ricom(&img.dose, &img.sumx, &img.sumy);
+    else if (kernel == "pacbed") cam.enable_Pacbed(&img.pacbed);
+    else if (kernel == "var") cam.enable_var(&img.var, img.offset);
+    else if (kernel == "roi") cam.enable_roi(&img.roi_scan_stack, &img.roi_pattern_stack, &img.roi_scan, &img.roi_pattern, img.lower_left, img.upper_right);
+    else if (kernel == "count_chunked_8") cam.enable_FourD(&img.counts, &img.chunk_8, img.det_bin, img.scan_bin, img.chunksize, img.mtx);
+    else if (kernel == "count_chunked_16") cam.enable_FourD(&img.counts, &img.chunk_16, img.det_bin, img.scan_bin, img.chunksize, img.mtx);
+    else if (kernel == "count_chunked_32") cam.enable_FourD(&img.counts, &img.chunk_32, img.det_bin, img.scan_bin, img.chunksize, img.mtx);
+    else return false;
+    return true;
+}
+
+template <class Cam>
+bool enable_frame_kernel(Cam &cam, const std::string &kernel, Images &img)
+{
+    if (kernel == "vstem") cam.enable_vSTEM(&img.detector_image, &img.stem);
+    else if (kernel == "com") cam.enable_Ricom(&img.comx, &img.comy);
+    else if (kernel == "pacbed") cam.enable_Pacbed(&img.pacbed);
+    else return false;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// measurement and reporting
+//--------------------------------------------------------------------------------------------------
+
+static bool selected(const std::string &name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// var (like com) keeps two images and indexes them with the scan repetition
+static bool supported(const std::string &kernel)
+{
+    return (kernel != "var") || (options.repetitions <= 2);
+}
+
+// detector output is only shown with --verbose
+class QuietCout
+{
+private:
+    std::streambuf *buf = nullptr;
+
+public:
+    QuietCout() { if (!options.verbose) buf = std::cout.rdbuf(nullptr); };
+    ~QuietCout()
+    {
+        if (options.verbose) return;
+        std::cout.rdbuf(buf);
+        std::cout.clear();
+    };
+};
+
+static double rate(double n, double seconds)
+{
+    return (seconds > 0) ? n / seconds : 0;
+}
+
+static void print_result(const Result &r)
+{
+    std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed << std::setprecision(4)
+              << std::setw(10) << r.seconds << " s";
+    if (r.events) std::cout << std::setprecision(2) << std::setw(10) << rate(r.events, r.seconds) / 1e6 << " Mevents/s";
+    if (r.frames) std::cout << std::setprecision(0) << std::setw(10) << rate(r.frames, r.seconds) << " frames/s";
+    if (r.bytes) std::cout << std::setprecision(1) << std::setw(10) << rate(r.bytes, r.seconds) / 1e6 << " MB/s";
+    if (r.timeout) std::cout << "  TIMEOUT";
+    std::cout << std::endl;
+}
+
+// runs 'run' options.runs times and keeps the median
+static void record(Result r, const std::function<Measurement()> &run)
+{
+    std::vector<Measurement> m;
+    for (int i = 0; i < options.runs; i++)
+    {
+        m.push_back(run());
+        if (m.back().timeout) break;
+    }
+    std::sort(m.begin(), m.end(), [](const Measurement &a, const Measurement &b) { return a.seconds < b.seconds; });
+    const Measurement &median = m[m.size() / 2];
+    r.runs = (int)m.size();
+    r.seconds = median.seconds;
+    r.seconds_min = m.front().seconds;
+    r.counters = median.counters;
+    r.timeout = m.back().timeout;
+    print_result(r);
+    results.push_back(r);
+}
+
+static std::string json_escape(const std::string &s)
+{
+    std::string o;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\') o += '\\';
+        o += c;
+    }
+    return o;
+}
+
+static bool write_json(const std::string &path)
+{
+    std::ofstream f(path, std::ios::out | std::ios::trunc);
+    if (!f.is_open())
+    {
+        std::cout << "eventem_bench: Error opening " << path << std::endl;
+        return false;
+    }
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    PerfCounters perf;
+
+    f << std::setprecision(9);
+    f << "{\n";
+    f << "  \"date\": \"" << date << "\",\n";
+    f << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    f << "  \"cpu_features\": \"" << CPU::features() << "\",\n";
+    f << "  \"perf_counters\": " << (perf.available() ? "true" : "false") << ",\n";
+    f << "  \"config\": {\"scan\": " << options.scan << ", \"dose\": " << options.dose << ", \"repetitions\": " << options.repetitions
+      << ", \"runs\": " << options.runs << ", \"kernel_events\": " << options.kernel_events << "},\n";
+    f << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        f << "    {\"name\": \"" << json_escape(r.name) << "\", \"suite\": \"" << r.suite << "\", \"detector\": \"" << r.detector
+          << "\", \"kernel\": \"" << r.kernel << "\", \"threads\": " << r.threads << ", \"runs\": " << r.runs
+          << ", \"seconds\": " << r.seconds << ", \"seconds_min\": " << r.seconds_min
+          << ", \"events\": " << r.events << ", \"frames\": " << r.frames << ", \"bytes\": " << r.bytes
+          << ", \"events_per_s\": " << rate(r.events, r.seconds) << ", \"frames_per_s\": " << rate(r.frames, r.seconds)
+          << ", \"bytes_per_s\": " << rate(r.bytes, r.seconds) << ", \"timeout\": " << (r.timeout ? "true" : "false")
+          << ", \"counters\": {";
+        for (size_t j = 0; j < r.counters.size(); j++)
+        {
+            f << (j ? ", " : "") << "\"" << r.counters[j].first << "\": " << r.counters[j].second;
+        }
+        f << "}}" << ((i + 1 < results.size()) ? "," : "") << "\n";
+    }
+    f << "  ]\n}\n";
+    return f.good();
+}
+
+//--------------------------------------------------------------------------------------------------
+// detectors
+//--------------------------------------------------------------------------------------------------
+
+// runs the detector until it has published target_line, like the processors wait for it
+template <class Cam>
+Measurement drive(Cam &cam, int *p_processor_line, int target_line)
+{
+    Measurement m;
+    PerfCounters perf;
+    LineNotifier line_notifier;
+    cam.enable_line_notification(&line_notifier);
+    *p_processor_line = 0;
+    {
+        QuietCout quiet;
+        perf.start();
+        auto t0 = std::chrono::steady_clock::now();
+        cam.run();
+        while (line_notifier.wait_past(target_line - 1, std::chrono::microseconds(50)) < target_line)
+        {
+            if (std::chrono::steady_clock::now() - t0 > std::chrono::duration<double>(options.timeout))
+            {
+                m.timeout = true;
+                break;
+            }
+        }
+        m.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        *p_processor_line = -1;
+        cam.terminate();
+        m.counters = perf.stop();
+    }
+    return m;
+}
+
+struct Inputs
+{
+    DataGenerator gen;            // scene of the TIMEPIX files
+    std::string tpx3;             // 512 x 512 quad
+    std::string electron;         // 256 x 256
+    std::string advapix;          // 256 x 256, one extra scan after the last repetition
+    std::string advaraw;          // the same as .t3r packets
+    std::string merlin_u08;       // 256 x 256, two scans
+    std::string merlin_r64;
+    std::string npy;              // 64 x 64, two scans
+    uint64_t events_512 = 0;      // events in the scans
+    uint64_t events_256 = 0;
+    uint64_t tpx3_bytes = 0;      // bytes of the scans
+    uint64_t electron_bytes = 0;
+    uint64_t advapix_bytes = 0;
+    uint64_t advaraw_bytes = 0;
+};
+
+static uint64_t count_events(DataGenerator &gen, int n_cam, int repetitions)
+{
+    std::vector<DataGenerator::Hit> hits;
+    uint64_t n = 0;
+    for (int rep = 0; rep < repetitions; rep++)
+        for (int ry = 0; ry < gen.scene.ny; ry++)
+            for (int rx = 0; rx < gen.scene.nx; rx++)
+            {
+                gen.probe_hits(rx, ry, rep, hits);
+                for (auto &h : hits) n += (h.kx < n_cam && h.ky < n_cam);
+            }
+    return n;
+}
+
+static uint64_t file_size(const std::string &path)
+{
+    return (uint64_t)std::filesystem::file_size(path);
+}
+
+static void make_inputs(Inputs &in)
+{
+    std::filesystem::create_directories(options.dir);
+    std::cout << "writing input files to " << options.dir << std::endl;
+    DataGenerator &gen = in.gen;
+    gen.scene.nx = options.scan;
+    gen.scene.ny = options.scan;
+    gen.scene.dose = options.dose;
+    gen.repetitions = options.repetitions;
+
+    gen.scene.n_cam = 512;
+    gen.scene.disk_radius = 40;
+    in.tpx3 = options.dir + "/bench.tpx3";
+    gen.write_tpx3(in.tpx3);
+    in.events_512 = count_events(gen, 512, gen.repetitions);
+    in.tpx3_bytes = file_size(in.tpx3);
+
+    gen.scene.n_cam = 256;
+    gen.scene.disk_radius = 20;
+    in.electron = options.dir + "/bench.electron";
+    gen.write_electron(in.electron);
+    in.events_256 = count_events(gen, 256, gen.repetitions);
+    in.electron_bytes = in.events_256 * 10;
+
+    // the ADVAPIX file mode does not stop at the last repetition, the extra scan keeps the line
+    // counter valid until the benchmark stops it
+    int extra_lines = gen.extra_lines;
+    gen.extra_lines = gen.scene.ny;
+    in.advapix = options.dir + "/bench.t3p";
+    gen.write_advapix(in.advapix);
+    in.advapix_bytes = in.events_256 * 16;
+    in.advaraw = options.dir + "/bench.t3r";
+    gen.write_advaraw(in.advaraw);
+    in.advaraw_bytes = in.events_256 * 8;
+    gen.extra_lines = extra_lines;
+
+    // the frame based detectors run one scan, the second one is read while they are stopped
+    DataGenerator frames = gen;
+    frames.repetitions = 2;
+    frames.merlin_dtype = "U08";
+    in.merlin_u08 = options.dir + "/bench_u08.mib";
+    frames.write_merlin(in.merlin_u08);
+    frames.merlin_dtype = "R64";
+    in.merlin_r64 = options.dir + "/bench_r64.mib";
+    frames.write_merlin(in.merlin_r64);
+
+    DataGenerator small = gen;
+    small.scene.n_cam = 64;
+    small.scene.disk_radius = 6;
+    small.scene.ny = 2 * gen.scene.ny; // two scans in one array
+    in.npy = options.dir + "/bench.npy";
+    small.write_npy(in.npy);
+}
+
+static void remove_inputs(const Inputs &in)
+{
+    for (auto &p : {in.tpx3, in.electron, in.advapix, in.advaraw, in.merlin_u08, in.merlin_r64, in.npy}) std::filesystem::remove(p);
+}
+
+//--------------------------------------------------------------------------------------------------
+// suites
+//--------------------------------------------------------------------------------------------------
+
+// exposes the accumulation stage of the detectors
+using SimulatedCam = SIMULATED<SIMULATED_ADDITIONAL::EVENT, SIMULATED_ADDITIONAL::BUFFER_SIZE, SIMULATED_ADDITIONAL::N_BUFFER>;
+class KernelCam : public SimulatedCam
+{
+public:
+    using SimulatedCam::SimulatedCam;
+    inline void accumulate(const EventBatch &events) { this->accumulate_batch(events); };
+};
+
+static void kernel_suite(Inputs &in)
+{
+    int nx = options.scan, ny = options.scan, rep = options.repetitions, mode = 0;
+    int n_cam = 256;
+    bool b_cumulative = false;
+    int processor_line = 0, preprocessor_line = 0;
+    std::string path;
+    SocketConnector socket;
+
+    // the decoded events of all scans, in batches of the size the decoders use
+    std::vector<EventBatch> batches;
+    std::vector<DataGenerator::Hit> hits;
+    uint64_t n_events = 0;
+    batches.emplace_back(SIMULATED_ADDITIONAL::BUFFER_SIZE);
+    for (int r = 0; r < rep; r++)
+        for (int ry = 0; ry < ny; ry++)
+            for (int rx = 0; rx < nx; rx++)
+            {
+                in.gen.probe_hits(rx, ry, r, hits);
+                for (auto &h : hits)
+                {
+                    if (batches.back().n == batches.back().capacity()) batches.emplace_back(SIMULATED_ADDITIONAL::BUFFER_SIZE);
+                    batches.back().push_back((uint64_t)ry * nx + rx, h.kx, h.ky, (uint16_t)r, 0, h.tot);
+                    ++n_events;
+                }
+            }
+    if (n_events == 0) return;
+    uint64_t passes = std::max<uint64_t>(1, options.kernel_events / n_events);
+
+    for (auto &kernel : event_kernels)
+    {
+        Result r;
+        r.name = "kernel/" + kernel;
+        if (!selected(r.name) || !supported(kernel)) continue;
+        r.suite = "kernel";
+        r.detector = "none";
+        r.kernel = kernel;
+        r.events = passes * n_events;
+        record(r, [&]
+        {
+            Images img(nx, ny, n_cam, rep, rep + 1);
+            KernelCam cam(nx, ny, n_cam, &b_cumulative, rep, &processor_line, &preprocessor_line, mode, path, socket);
+            enable_kernel(cam, kernel, img);
+            Measurement m;
+            PerfCounters perf;
+            perf.start();
+            auto t0 = std::chrono::steady_clock::now();
+            for (uint64_t p = 0; p < passes; p++)
+                for (auto &b : batches) cam.accumulate(b);
+            m.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            m.counters = perf.stop();
+            return m;
+        });
+    }
+}
+
+// runs a TIMEPIX detector on a file with one kernel
+template <class Make>
+void timepix_run(const std::string &name, const std::string &suite, const std::string &detector, const std::string &kernel,
+                 int threads, uint64_t events, uint64_t bytes, Make &&make)
+{
+    if (!selected(name) || !supported(kernel)) return;
+    Result r;
+    r.name = name;
+    r.suite = suite;
+    r.detector = detector;
+    r.kernel = kernel;
+    r.threads = threads;
+    r.events = events;
+    r.bytes = bytes;
+    record(r, [&]
+    {
+        int processor_line = 0, preprocessor_line = 0;
+        decltype(make(nullptr, nullptr)) cam;
+        {
+            QuietCout quiet;
+            cam = make(&processor_line, &preprocessor_line);
+        }
+        Images img(options.scan, options.scan, cam->n_cam, options.repetitions, options.repetitions + 1);
+        enable_kernel(*cam, kernel, img);
+        return drive(*cam, &processor_line, options.scan * options.repetitions);
+    });
+}
+
+// runs a frame based detector on a file with one kernel, frames/s of one scan
+template <class Make>
+void frame_run(const std::string &name, const std::string &suite, const std::string &detector, const std::string &kernel,
+               int n_cam, uint64_t frame_bytes, Make &&make)
+{
+    if (!selected(name)) return;
+    Result r;
+    r.name = name;
+    r.suite = suite;
+    r.detector = detector;
+    r.kernel = kernel;
+    r.frames = (uint64_t)options.scan * options.scan;
+    r.bytes = r.frames * frame_bytes;
+    record(r, [&]
+    {
+        int processor_line = 0, preprocessor_line = 0;
+        decltype(make(nullptr, nullptr)) cam;
+        {
+            QuietCout quiet;
+            cam = make(&processor_line, &preprocessor_line);
+        }
+        // FRAMEBASED does not wrap the probe position, the images have room for the frames read
+        // after the scan until the detector is stopped
+        Images img(options.scan, options.scan, n_cam, 1, 3);
+        for (auto &s : img.stem) s.resize(3 * img.nxy, 0);
+        enable_frame_kernel(*cam, kernel, img);
+        return drive(*cam, &processor_line, options.scan);
+    });
+}
+
+struct CheetahFactory
+{
+    std::string path;
+    int threads;
+    int repetitions = options.repetitions;
+    bool index = false; // sidecar index, decoding from first_line
+    int first_line = 0;
+    auto operator()(int *p_processor_line, int *p_preprocessor_line)
+    {
+        using namespace CHEETAH_ADDITIONAL;
+        bool b_cumulative = false;
+        int nx = options.scan, ny = options.scan, dt = 1000, mode = 0;
+        SocketConnector socket;
+        auto cam = std::make_unique<CHEETAH<EVENT, BUFFER_SIZE, N_BUFFER>>(nx, ny, dt, &b_cumulative, repetitions, p_processor_line, p_preprocessor_line, mode, path, socket);
+        cam->enable_parallel_decoding(threads);
+        cam->enable_index(index, first_line);
+        return cam;
+    };
+};
+
+template <class Cam>
+struct TimepixFactory
+{
+    std::string path;
+    int n_cam;
+    int threads = 1; // decode threads
+    auto operator()(int *p_processor_line, int *p_preprocessor_line)
+    {
+        bool b_cumulative = false;
+        int nx = options.scan, ny = options.scan, dt = 1000, mode = 0;
+        SocketConnector socket;
+        std::unique_ptr<Cam> cam;
+        if constexpr (std::is_same_v<Cam, SimulatedCam>)
+            cam = std::make_unique<Cam>(nx, ny, n_cam, &b_cumulative, options.repetitions, p_processor_line, p_preprocessor_line, mode, path, socket);
+        else
+            cam = std::make_unique<Cam>(nx, ny, dt, &b_cumulative, options.repetitions, p_processor_line, p_preprocessor_line, mode, path, socket);
+        cam->enable_parallel_decoding(threads);
+        return cam;
+    };
+};
+
+template <class Cam>
+struct FrameFactory
+{
+    std::string path;
+    int data_depth;
+    auto operator()(int *p_processor_line, int *p_preprocessor_line)
+    {
+        bool b_cumulative = false;
+        int nx = options.scan, ny = options.scan, mode = 0;
+        SocketConnector socket;
+        auto cam = std::make_unique<Cam>(nx, ny, &b_cumulative, 1, p_processor_line, p_preprocessor_line, mode, path, socket);
+        cam->data_depth = data_depth; // the counter depth of R64 is not in the frame header
+        return cam;
+    };
+};
+
+using AdvapixCam = ADVAPIX<ADVAPIX_ADDITIONAL::EVENT, ADVAPIX_ADDITIONAL::BUFFER_SIZE, ADVAPIX_ADDITIONAL::N_BUFFER>;
+using AdvarawCam = ADVAPIX<ADVAPIX_ADDITIONAL::RAW_EVENT, ADVAPIX_ADDITIONAL::RAW_BUFFER_SIZE, ADVAPIX_ADDITIONAL::N_BUFFER>;
+using Merlin256Cam = MERLIN<MERLIN_256::N_CAM, MERLIN_256::BUFFER_SIZE, MERLIN_256::HEAD_SIZE, MERLIN_256::N_BUFFER, MERLIN_256::PIXEL>;
+using NumpyCam = NUMPY<FRAME_64_ADDITIONAL::N_CAM, FRAME_64_ADDITIONAL::BUFFER_SIZE, FRAME_64_ADDITIONAL::HEAD_SIZE, FRAME_64_ADDITIONAL::N_BUFFER, FRAME_64_ADDITIONAL::PIXEL>;
+
+static uint64_t mib_frame_bytes(int n_cam, int bits)
+{
+    return MERLIN_256::HEAD_SIZE + (uint64_t)n_cam * n_cam * bits / 8;
+}
+
+static void decoder_suite(Inputs &in)
+{
+    timepix_run("decoder/cheetah", "decoder", "cheetah", "pacbed", 1, in.events_512, in.tpx3_bytes, CheetahFactory{in.tpx3, 1});
+    timepix_run("decoder/simulated", "decoder", "simulated", "pacbed", 1, in.events_256, in.electron_bytes, TimepixFactory<SimulatedCam>{in.electron, 256});
+    timepix_run("decoder/advapix", "decoder", "advapix", "pacbed", 1, in.events_256, in.advapix_bytes, TimepixFactory<AdvapixCam>{in.advapix, 256});
+    timepix_run("decoder/advaraw", "decoder", "advaraw", "pacbed", 1, in.events_256, in.advaraw_bytes, TimepixFactory<AdvarawCam>{in.advaraw, 256});
+    frame_run("decoder/merlin_u08", "decoder", "merlin", "pacbed", 256, mib_frame_bytes(256, 8), FrameFactory<Merlin256Cam>{in.merlin_u08, 8});
+    frame_run("decoder/merlin_raw_binary", "decoder", "merlin", "pacbed", 256, mib_frame_bytes(256, 1), FrameFactory<Merlin256Cam>{in.merlin_r64, 1});
+    frame_run("decoder/numpy", "decoder", "numpy", "pacbed", 64, 64 * 64, FrameFactory<NumpyCam>{in.npy, 8});
+}
+
+static void e2e_suite(Inputs &in)
+{
+    for (auto &kernel : processor_kernels)
+    {
+        timepix_run("e2e/cheetah/" + kernel, "e2e", "cheetah", kernel, 1, in.events_512, in.tpx3_bytes, CheetahFactory{in.tpx3, 1});
+        timepix_run("e2e/simulated/" + kernel, "e2e", "simulated", kernel, 1, in.events_256, in.electron_bytes, TimepixFactory<SimulatedCam>{in.electron, 256});
+    }
+    for (auto kernel : {"vstem", "com", "pacbed"})
+    {
+        frame_run(std::string("e2e/merlin/") + kernel, "e2e", "merlin", kernel, 256, mib_frame_bytes(256, 8), FrameFactory<Merlin256Cam>{in.merlin_u08, 8});
+        frame_run(std::string("e2e/numpy/") + kernel, "e2e", "numpy", kernel, 64, 64 * 64, FrameFactory<NumpyCam>{in.npy, 8});
+    }
+}
+
+// CHEETAH, SIMULATED and ADVAPIX (.t3p, .t3r) with parallel decoding on 1, 2, 4, ... and max_threads decode threads
+static void thread_suite(Inputs &in)
+{
+    std::vector<int> n_threads;
+    for (int n = 1; n < options.max_threads; n *= 2) n_threads.push_back(n);
+    n_threads.push_back(options.max_threads);
+    for (auto kernel : {"vstem", "pacbed"})
+    {
+        for (int n : n_threads)
+        {
+            timepix_run("threads/cheetah/" + std::string(kernel) + "/" + std::to_string(n), "threads", "cheetah", kernel, n,
+                        in.events_512, in.tpx3_bytes, CheetahFactory{in.tpx3, n});
+            timepix_run("threads/simulated/" + std::string(kernel) + "/" + std::to_string(n), "threads", "simulated", kernel, n,
+                        in.events_256, in.electron_bytes, TimepixFactory<SimulatedCam>{in.electron, 256, n});
+            timepix_run("threads/advapix/" + std::string(kernel) + "/" + std::to_string(n), "threads", "advapix", kernel, n,
+                        in.events_256, in.advapix_bytes, TimepixFactory<AdvapixCam>{in.advapix, 256, n});
+            timepix_run("threads/advaraw/" + std::string(kernel) + "/" + std::to_string(n), "threads", "advaraw", kernel, n,
+                        in.events_256, in.advaraw_bytes, TimepixFactory<AdvarawCam>{in.advaraw, 256, n});
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// verification
+//--------------------------------------------------------------------------------------------------
+
+static int n_mismatches = 0;
+
+// Probe positions of the lines from first_line on (line = scan * ny + ry) where the COM images
+// (dose, sum of kx and ky per scan, indexed by scan % 2) of a and b differ.
+static size_t com_mismatches(const Images &a, const Images &b, int first_line)
+{
+    size_t n = 0;
+    for (int r = 0; r < std::min(a.rep, 2); r++)
+        for (int ry = 0; ry < a.ny; ry++)
+        {
+            if (r * a.ny + ry < first_line) continue;
+            for (int rx = 0; rx < a.nx; rx++)
+            {
+                size_t p = (size_t)ry * a.nx + rx;
+                n += (a.dose[r][p] != b.dose[r][p]) || (a.sumx[r][p] != b.sumx[r][p]) || (a.sumy[r][p] != b.sumy[r][p]);
+            }
+        }
+    return n;
+}
+
+// COM images of the electrons the generator put into the scans
+static void generated_com(DataGenerator &gen, Images &img)
+{
+    std::vector<DataGenerator::Hit> hits;
+    for (int r = 0; r < std::min(img.rep, 2); r++)
+        for (int ry = 0; ry < img.ny; ry++)
+            for (int rx = 0; rx < img.nx; rx++)
+            {
+                size_t p = (size_t)ry * img.nx + rx;
+                gen.probe_hits(rx, ry, r, hits);
+                for (auto &h : hits)
+                {
+                    img.dose[r][p]++;
+                    img.sumx[r][p] += h.kx;
+                    img.sumy[r][p] += h.ky;
+                }
+            }
+}
+
+// decodes the file with the COM kernel into img
+template <class Make>
+bool verify_decode(Make &&make, Images &img)
+{
+    int processor_line = 0, preprocessor_line = 0;
+    decltype(make(nullptr, nullptr)) cam;
+    {
+        QuietCout quiet;
+        cam = make(&processor_line, &preprocessor_line);
+    }
+    enable_kernel(*cam, "com", img);
+    return !drive(*cam, &processor_line, img.ny * img.rep).timeout;
+}
+
+static void verify_result(const std::string &name, bool b_done, size_t n_diff)
+{
+    std::cout << std::left << std::setw(44) << name << std::right;
+    if (!b_done) std::cout << "  TIMEOUT" << std::endl;
+    else if (n_diff > 0) std::cout << "  MISMATCH in " << n_diff << " probe positions" << std::endl;
+    else std::cout << "  ok" << std::endl;
+    if (!b_done || n_diff > 0) ++n_mismatches;
+}
+
+// The CHEETAH decoder serially, with parallel decoding and seeded from the sidecar index halfway
+// through the scans, on scans that start at 0 s and right before the ToA (26.8 s) and the TDC
+// (107.4 s) rollover. The serial decode is checked against the electrons of the generator, the
+// others against the serial one.
+static void verify_suite(Inputs &in)
+{
+    const double toa_period = (double)(1ULL << 34) * 1.5625e-9;
+    const std::vector<std::pair<std::string, double>> starts = {{"0", 0}, {"toa", toa_period - 0.01}, {"tdc", 4 * toa_period - 0.01}};
+    const int rep = 2;
+    const int threads = std::max(2, options.max_threads);
+    const int first_line = options.scan * rep / 2 + 1;
+
+    DataGenerator gen = in.gen;
+    gen.scene.n_cam = 512;
+    gen.scene.disk_radius = 40;
+    gen.repetitions = rep;
+    for (auto &start : starts)
+    {
+        std::string name = "verify/cheetah/" + start.first;
+        if (!selected(name)) continue;
+        std::string path = options.dir + "/verify_" + start.first + ".tpx3";
+        gen.start_time = start.second;
+        gen.write_tpx3(path);
+        Images expected(options.scan, options.scan, 512, rep, rep + 1);
+        generated_com(gen, expected);
+
+        Images serial(options.scan, options.scan, 512, rep, rep + 1);
+        bool b_serial = verify_decode(CheetahFactory{path, 1, rep}, serial);
+        verify_result(name + "/serial", b_serial, com_mismatches(expected, serial, 0));
+        if (b_serial)
+        {
+            Images parallel(options.scan, options.scan, 512, rep, rep + 1);
+            bool b_done = verify_decode(CheetahFactory{path, threads, rep}, parallel);
+            verify_result(name + "/parallel", b_done, com_mismatches(serial, parallel, 0));
+
+            // the first run builds the index, the second one starts from it
+            Images build(options.scan, options.scan, 512, rep, rep + 1);
+            Images seeded(options.scan, options.scan, 512, rep, rep + 1);
+            b_done = verify_decode(CheetahFactory{path, 1, rep, true, 0}, build) && verify_decode(CheetahFactory{path, 1, rep, true, first_line}, seeded);
+            verify_result(name + "/index", b_done, com_mismatches(serial, build, 0) + com_mismatches(serial, seeded, first_line));
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(Tpx3Index::path_for(path));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+
+static void usage()
+{
+    std::cout << "usage: eventem_bench [--json file] [--dir dir] [--filter text] [--runs n] [--scan n] [--dose d]\n"
+                 "                     [--repetitions n] [--threads n] [--kernel-events n] [--quick] [--keep] [--verbose]\n";
+}
+
+int main(int argc, char **argv)
+{
+    options.dir = (std::filesystem::temp_directory_path() / "eventem_bench").string();
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                usage();
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--json") options.json_path = value();
+        else if (a == "--dir") options.dir = value();
+        else if (a == "--filter") options.filter = value();
+        else if (a == "--runs") options.runs = std::max(1, std::stoi(value()));
+        else if (a == "--scan") options.scan = std::max(8, std::stoi(value()));
+        else if (a == "--dose") options.dose = std::stod(value());
+        else if (a == "--repetitions") options.repetitions = std::max(1, std::stoi(value()));
+        else if (a == "--threads") options.max_threads = std::max(1, std::stoi(value()));
+        else if (a == "--kernel-events") options.kernel_events = std::stoull(value());
+        else if (a == "--quick")
+        {
+            options.scan = 64;
+            options.runs = 1;
+            options.kernel_events = 5000000;
+        }
+        else if (a == "--keep") options.keep = true;
+        else if (a == "--verbose") options.verbose = true;
+        else
+        {
+            usage();
+            return (a == "--help" || a == "-h") ? 0 : 1;
+        }
+    }
+    // the frame based detectors process whole buffers of 128 frames, so nx * ny is a multiple of it
+    options.scan = std::max(16, options.scan / 16 * 16);
+
+    Inputs in;
+    make_inputs(in);
+    if (!PerfCounters().available()) std::cout << "hardware counters not available (perf_event_paranoid?)" << std::endl;
+
+    verify_suite(in);
+    kernel_suite(in);
+    decoder_suite(in);
+    e2e_suite(in);
+    thread_suite(in);
+
+    if (!options.keep) remove_inputs(in);
+    if (!write_json(options.json_path)) return 1;
+    std::cout << "results written to " << options.json_path << std::endl;
+    if (n_mismatches > 0)
+    {
+        std::cout << "eventem_bench: " << n_mismatches << " verification runs failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
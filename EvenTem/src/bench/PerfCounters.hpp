@@ -0,0 +1,120 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware counters of this process via perf_event_open. The counters are inherited by the threads
+// started after start(), their counts are added once those threads are joined, so read stop() after
+// the detector's terminate(). Without perf support (other platforms, perf_event_paranoid, containers)
+// available() is false and stop() returns nothing.
+class PerfCounters
+{
+private:
+    struct Counter
+    {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+        int fd;
+    };
+    std::vector<Counter> counters;
+
+public:
+    PerfCounters()
+    {
+        #ifdef __linux__
+        counters = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+            {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+            {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+            {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1},
+            {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1},
+        };
+        for (auto &c : counters)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = c.type;
+            attr.config = c.config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            c.fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        #endif
+    };
+
+    ~PerfCounters()
+    {
+        #ifdef __linux__
+        for (auto &c : counters) if (c.fd != -1) close(c.fd);
+        #endif
+    };
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const
+    {
+        for (auto &c : counters) if (c.fd != -1) return true;
+        return false;
+    };
+
+    void start()
+    {
+        #ifdef __linux__
+        for (auto &c : counters)
+        {
+            if (c.fd == -1) continue;
+            ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        #endif
+    };
+
+    // (name, count) of every counter that could be opened
+    std::vector<std::pair<std::string, uint64_t>> stop()
+    {
+        std::vector<std::pair<std::string, uint64_t>> result;
+        #ifdef __linux__
+        for (auto &c : counters)
+        {
+            if (c.fd == -1) continue;
+            ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count = 0;
+            if (read(c.fd, &count, sizeof(count)) == sizeof(count)) result.push_back({c.name, count});
+        }
+        #endif
+        return result;
+    };
+};
+
+#endif // PERF_COUNTERS_HPP
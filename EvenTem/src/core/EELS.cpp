@@ -37,6 +37,7 @@ void EELS::run(){
                     socket
                 );
                 cam.enable_EELS(&EELS_data_stack, &EELS_image_stack);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -56,6 +57,7 @@ void EELS::run(){
                     socket
                 );
                 cam.enable_EELS(&EELS_data_stack, &EELS_image_stack);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -88,6 +90,7 @@ void EELS::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 }
 
 
@@ -102,7 +105,7 @@ void EELS::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line) 
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line()) 
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0) id_image = *processor_line / ny;
@@ -67,6 +67,29 @@ void Electron::run(){
                 socket
             );
             cam.enable_electron(file_electron,decluster,dtime,dspace,cluster_range, x_crop, y_crop, scan_bin, detector_bin, n_threads, &clustersize_histogram);
+            configure_camera(cam);
+            cam.run();
+            process_data();
+            cam.terminate();
+            break;
+        }
+        case CAMERA::ADVARAW:
+        {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,  
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+            cam.enable_electron(file_electron,decluster,dtime,dspace,cluster_range, x_crop, y_crop, scan_bin, detector_bin, n_threads, &clustersize_histogram);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -89,6 +112,7 @@ void Electron::run(){
                 socket
             );
             cam.enable_electron(file_electron,decluster,dtime,dspace,cluster_range, x_crop, y_crop, scan_bin, detector_bin, n_threads, &clustersize_histogram);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -113,6 +137,7 @@ void Electron::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
@@ -127,7 +152,7 @@ void Electron::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
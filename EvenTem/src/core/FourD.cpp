@@ -39,6 +39,30 @@ void FourD<BitDepth>::run(){
             );
            
             cam.enable_FourD(&Dose_image, &chunk_data, det_bin,scan_bin, chunksize,mtx);
+            configure_camera(cam);
+            cam.run();
+            process_data();
+            cam.terminate();
+            break;
+        }
+         case CAMERA::ADVARAW:
+         {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,  
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+           
+            cam.enable_FourD(&Dose_image, &chunk_data, det_bin,scan_bin, chunksize,mtx);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -62,6 +86,7 @@ void FourD<BitDepth>::run(){
 
                
             cam.enable_FourD(&Dose_image, &chunk_data, det_bin,scan_bin, chunksize,mtx); 
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -83,6 +108,7 @@ void FourD<BitDepth>::run(){
                 socket
             ); 
             cam.enable_FourD(&Dose_image, &chunk_data, det_bin,scan_bin, chunksize,mtx); 
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -104,6 +130,7 @@ void FourD<BitDepth>::run(){
                     socket
                 );
                 cam.enable_compress(&Dose_image,&chunk_data, chunksize,det_bin,mtx);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -123,6 +150,7 @@ void FourD<BitDepth>::run(){
                     socket
                 );
                 cam.enable_compress(&Dose_image,&chunk_data,chunksize,det_bin,mtx);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -142,6 +170,7 @@ void FourD<BitDepth>::allocate_chunk()
     switch (camera)
      {
         case CAMERA::ADVAPIX:
+        case CAMERA::ADVARAW:
         {   
             diff_pattern_size = 256/det_bin*256/det_bin;
             diff_pattern_length = 256/det_bin;
@@ -190,6 +219,7 @@ void FourD<BitDepth>::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
@@ -206,7 +236,7 @@ void FourD<BitDepth>::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
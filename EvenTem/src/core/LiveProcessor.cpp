@@ -32,17 +32,27 @@ void LiveProcessor::process_data()
 
     int last_processor_line = 0;
     int stall_count = 0;
+    if (tracer.running()) tracer.name_thread("process_data");
 
     while (*processor_line != -1)
     {
-        line_processor(
-            img_num, 
-            first_frame, 
-            end_frame, 
-            p_prog_mon, 
-            fr_total_u, 
-            &pool
-        );
+        {
+            PipelineMetrics::StageTimer timer(&metrics, PipelineMetrics::PROCESS);
+            line_processor(
+                img_num, 
+                first_frame, 
+                end_frame, 
+                p_prog_mon, 
+                fr_total_u, 
+                &pool
+            );
+        }
+        metrics.positions_processed.store((uint64_t)p_prog_mon->fr_count, std::memory_order_relaxed);
+        if (tracer.running()) tracer.line_processed((int)(p_prog_mon->fr_count / nx));
+
+        // sleep until the detector has completed a line that has not been processed yet
+        if (*processor_line != -1)
+            line_notifier.wait_past((int)(p_prog_mon->fr_count / nx), std::chrono::milliseconds(10));
 
         //check for stalling
         // if (last_processor_line == *processor_line)
@@ -62,6 +72,23 @@ void LiveProcessor::process_data()
         // }
     }
     p_prog_mon = nullptr;
+
+    // events/s for every event based detector, the detectors that measure it themselves overwrite it
+    PipelineMetrics::Snapshot s = sample_metrics();
+    if ((s.time > 0) && (s.events_accepted > 0)) processing_rate = (float)(s.events_accepted / s.time);
+}
+
+
+PipelineMetrics::Snapshot LiveProcessor::sample_metrics()
+{
+    PipelineMetrics::Snapshot s;
+    s.line_decoded = line_notifier.line();
+    s.line_processed = (nx > 0) ? (int)(metrics.positions_processed.load(std::memory_order_relaxed) / nx) : 0;
+    // the receiver is created with the socket and lives as long as this processor
+    s.socket_bytes_received = socket.receiver->bytes_received.load(std::memory_order_relaxed);
+    uint64_t n_read = socket.receiver->bytes_read.load(std::memory_order_relaxed);
+    s.socket_bytes_buffered = (s.socket_bytes_received > n_read) ? s.socket_bytes_received - n_read : 0;
+    return metrics.sample(s);
 }
 
 
@@ -115,6 +142,19 @@ void LiveProcessor::set_dwell_time(int dwell_time)
 }
 
 
+void LiveProcessor::set_line_range(int first, int end)
+{
+    first_line = first;
+    end_line = end;
+}
+
+
+void LiveProcessor::set_repetition(int repetition)
+{
+    set_line_range(repetition * ny, (repetition + 1) * ny);
+}
+
+
 void LiveProcessor::set_file(std::string filename)
 {
 
@@ -125,8 +165,17 @@ void LiveProcessor::set_file(std::string filename)
     }
     else if (std::filesystem::path(filename).extension() == ".t3r")
     {
-        camera = CAMERA::ADVARAW;
-        n_cam = 256;
+        if (b_experimental_t3r)
+        {
+            camera = CAMERA::ADVARAW;
+            n_cam = 256;
+        }
+        else
+        {
+            std::cout << "Reading .t3r files is experimental, the packet layout is not verified against Pixet recordings. "
+                      << "Set experimental_t3r = True before set_file() to use it." << std::endl;
+            camera = CAMERA::DUMMY;
+        }
     }
     else if (std::filesystem::path(filename).extension() == ".tpx3")
     {
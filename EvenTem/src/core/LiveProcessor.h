@@ -35,10 +35,16 @@
 #include <chrono>
 #include <algorithm>
 #include <ctime>
+#include <type_traits>
+#include <utility>
 
 #include "BoundedThreadPool.hpp"
 #include "SocketConnector.h"
 #include "ProgressMonitor.h"
+#include "LineNotifier.hpp"
+#include "PipelineMetrics.hpp"
+#include "Tracer.h"
+#include "ScanPattern.h"
 #include "Cheetah.hpp"
 #include "Timepix.hpp"
 #include "Advapix.hpp"
@@ -59,6 +65,17 @@ namespace CAMERA
         HDF5,
         DUMMY
     };
+
+    // optional settings, only some detectors decode in parallel (TIMEPIX files) or keep an index (CHEETAH)
+    template <class Cam, class = void>
+    struct has_parallel_decoding : std::false_type {};
+    template <class Cam>
+    struct has_parallel_decoding<Cam, std::void_t<decltype(std::declval<Cam &>().enable_parallel_decoding(1))>> : std::true_type {};
+
+    template <class Cam, class = void>
+    struct has_index : std::false_type {};
+    template <class Cam>
+    struct has_index<Cam, std::void_t<decltype(std::declval<Cam &>().enable_index(true, 0, -1))>> : std::true_type {};
 }
 
 
@@ -77,6 +94,7 @@ public:
     SocketConnector socket;
     std::string file_path;
     std::string pattern_file;
+    ScanPattern scan_pattern; // probe order, raster when empty; takes the place of pattern_file
 
     ProgressMonitor *p_prog_mon;
     void set_file(std::string filename);
@@ -111,17 +129,53 @@ public:
     int fr_total;
     int *processor_line = new int;
     int *preprocessor_line  = new int;
+    LineNotifier line_notifier; // wakes process_data() when the detector completed new lines
+    PipelineMetrics metrics;    // filled by the detector and process_data(), see sample_metrics()
+    Tracer tracer;              // buffer and line timeline, recorded while tracer.path is set
     int id_image;
 
     // Variables for progress and performance
     int n_threads;
     int n_threads_max;
+    int n_decode_threads;
+    bool b_busy_poll;
+    bool b_read_ahead;
+    bool b_direct_io;
     int queue_size;
+
+    // .tpx3 sidecar index, off by default: writes <file>.idx (and <file>.idx.tmp while saving)
+    // next to the data. Built on the first run over a file (or while recording), then used to
+    // start decoding right before first_line; lines from end_line on (-1: none) are not decoded
+    bool b_index;
+    int first_line;
+    int end_line;
+
+    // .t3r files are only read with this set (before set_file): the packet layout is assumed to be
+    // the one of the .tpx3 stream and has not been checked against .t3r files recorded by Pixet
+    bool b_experimental_t3r;
+    void set_line_range(int first, int end);
+    void set_repetition(int repetition); // only the lines of one repetition
     float fr_freq;        // Frequncy per frame
     float fr_count;       // Count all Frames processed in an image
     float fr_count_total; // Count all Frames in a scanning session
 
     float processing_rate = 0;
+    PipelineMetrics::Snapshot sample_metrics(); // safe to call from any thread during run()
+
+    // Passes the settings above to a detector, after its kernel is enabled and before cam.run().
+    // A processor that decodes a different line range calls cam.enable_index() again afterwards.
+    template <class Cam>
+    void configure_camera(Cam &cam)
+    {
+        if constexpr (CAMERA::has_parallel_decoding<Cam>::value) cam.enable_parallel_decoding(n_decode_threads);
+        if constexpr (CAMERA::has_index<Cam>::value) cam.enable_index(b_index, first_line, end_line);
+        cam.enable_line_notification(&line_notifier);
+        cam.enable_scan_pattern(&scan_pattern);
+        cam.enable_metrics(&metrics);
+        cam.enable_tracing(&tracer);
+        cam.enable_read_ahead(b_read_ahead, b_direct_io);
+        cam.enable_busy_poll(b_busy_poll);
+    };
 
     bool rc_quit = false;
     // int max_stall_count = 2147483647; 
@@ -144,7 +198,8 @@ public:
         mode(0),
         nx(1024), ny(1024), nxy(0), n_cam(512), dt(0),
         rep(repetitions), fr_total(0),
-        n_threads(1), queue_size(64),
+        n_threads(1), n_decode_threads(1), b_busy_poll(false), b_read_ahead(false), b_direct_io(false), queue_size(64),
+        b_index(false), first_line(0), end_line(-1), b_experimental_t3r(false),
         fr_freq(0.0), fr_count(0.0), fr_count_total(0.0)
     {
     };
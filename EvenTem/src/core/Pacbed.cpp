@@ -36,6 +36,29 @@ void Pacbed::run(){
             socket
         );
         cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
+        cam.run();
+        process_data();
+        cam.terminate();
+        break;
+        }
+        case CAMERA::ADVARAW:
+        {   
+        using namespace ADVAPIX_ADDITIONAL;
+        ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+            nx, 
+            ny,  
+            dt,
+            &b_cumulative,
+            rep,
+            processor_line,
+            preprocessor_line,
+            mode,
+            file_path,
+            socket
+        );
+        cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
         cam.run();
         process_data();
         cam.terminate();
@@ -57,6 +80,7 @@ void Pacbed::run(){
             socket
         );
         cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
         cam.run();
         process_data();
         cam.terminate();
@@ -78,6 +102,7 @@ void Pacbed::run(){
             socket
         );
         cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
         cam.run();
         process_data();
         cam.terminate();
@@ -99,6 +124,7 @@ void Pacbed::run(){
             pattern_file
         );
         cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
         cam.run();
         process_data();
         cam.terminate();
@@ -120,6 +146,7 @@ void Pacbed::run(){
                 socket
             );
             cam.enable_Pacbed(&Pacbed_image);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -138,6 +165,7 @@ void Pacbed::run(){
                 socket
             );
             cam.enable_Pacbed(&Pacbed_image);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -160,6 +188,7 @@ void Pacbed::run(){
             socket
         );
         cam.enable_Pacbed(&Pacbed_image);
+        configure_camera(cam);
         cam.run();
         process_data();
         cam.terminate();
@@ -187,6 +216,7 @@ void Pacbed::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
@@ -203,7 +233,7 @@ void Pacbed::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
@@ -13,6 +13,48 @@
  */
 
 #include "Ricom.h"
+#include "CpuDispatch.h"
+
+namespace
+{
+    // out[i] += (cx[i] - ox) * wx + (cy[i] - oy) * wy for both the image and its stack entry:
+    // one kernel tap applied to a line of CoM values
+    EVENTEM_ALWAYS_INLINE void icom_tap_body(float *out, float *out_stack, const float *cx, const float *cy, int n, float wx, float wy, float ox, float oy)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            float v = (cx[i] - ox) * wx + (cy[i] - oy) * wy;
+            out[i] += v;
+            out_stack[i] += v;
+        }
+    }
+
+    void icom_tap_scalar(float *out, float *out_stack, const float *cx, const float *cy, int n, float wx, float wy, float ox, float oy)
+    {
+        icom_tap_body(out, out_stack, cx, cy, n, wx, wy, ox, oy);
+    }
+#if defined(EVENTEM_X86)
+    EVENTEM_TARGET_SSE4 void icom_tap_sse4(float *out, float *out_stack, const float *cx, const float *cy, int n, float wx, float wy, float ox, float oy)
+    {
+        icom_tap_body(out, out_stack, cx, cy, n, wx, wy, ox, oy);
+    }
+    EVENTEM_TARGET_AVX2 void icom_tap_avx2(float *out, float *out_stack, const float *cx, const float *cy, int n, float wx, float wy, float ox, float oy)
+    {
+        icom_tap_body(out, out_stack, cx, cy, n, wx, wy, ox, oy);
+    }
+    EVENTEM_TARGET_AVX512 void icom_tap_avx512(float *out, float *out_stack, const float *cx, const float *cy, int n, float wx, float wy, float ox, float oy)
+    {
+        icom_tap_body(out, out_stack, cx, cy, n, wx, wy, ox, oy);
+    }
+#endif
+
+    typedef void (*icom_tap_fn)(float *, float *, const float *, const float *, int, float, float, float, float);
+#if defined(EVENTEM_X86)
+    const icom_tap_fn icom_tap = CPU::select<icom_tap_fn>({icom_tap_scalar, icom_tap_sse4, icom_tap_avx2, icom_tap_avx512, nullptr});
+#else
+    const icom_tap_fn icom_tap = icom_tap_scalar;
+#endif
+}
 
 // Compute the kernel
 void Ricom_kernel::compute_kernel()
@@ -150,6 +192,31 @@ void Ricom::run()
                 socket
             );
             cam.enable_Ricom(&dose_data,&sumx_data,&sumy_data);
+            configure_camera(cam);
+            cam.run();
+            startime = std::chrono::high_resolution_clock::now();
+            process_data();
+            cam.terminate();
+            processing_rate = cam.get_processing_rate();
+            break;
+        }
+        case CAMERA::ADVARAW:
+        {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,  
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+            cam.enable_Ricom(&dose_data,&sumx_data,&sumy_data);
+            configure_camera(cam);
             cam.run();
             startime = std::chrono::high_resolution_clock::now();
             process_data();
@@ -173,6 +240,7 @@ void Ricom::run()
             socket
             );
             cam.enable_Ricom(&dose_data,&sumx_data,&sumy_data);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -194,6 +262,7 @@ void Ricom::run()
             socket
             );
             cam.enable_Ricom(&dose_data,&sumx_data,&sumy_data);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -221,6 +290,7 @@ void Ricom::run()
                 //     cam.enable_vSTEM(&(child->get_detector()),&child->vSTEM_data,false,false);
                 // }
 
+                configure_camera(cam);
                 cam.run();
                 std::thread t_self = std::thread(&Ricom::process_data, this);
 
@@ -251,6 +321,7 @@ void Ricom::run()
                 //     cam.enable_vSTEM(&(child->get_detector()),&child->vSTEM_data,false,false);
                 // }
 
+                configure_camera(cam);
                 cam.run();
                 std::thread t_self = std::thread(&Ricom::process_data, this);
 
@@ -279,6 +350,7 @@ void Ricom::run()
             socket
             );
             cam.enable_Ricom(&comx_image,&comy_image);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -327,7 +399,7 @@ void Ricom::line_processor(
 )
 {
     int pp_id = 0;
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
@@ -432,33 +504,25 @@ void Ricom::line_processor(
 
 void Ricom::icom_group_classical(int pp_id, int id_image)
 {
-    int idk;
-    int idc;
-    int id;
-    int idr_x;
-    int idr_delay;
-    int k_bias = kernel.k_width_sym * (kernel.kernel_size + 1);
-
+    // pp_id is the first probe position of a line; the line kernel_size lines back is complete
+    // now. Every kernel tap is applied to the whole line at once (same summation order per pixel
+    // as tap by tap), clipped where the tap reaches past the left or right edge of the scan.
     if (((pp_id / nx - 2*kernel.kernel_size) >= 0))
     {
+        int idr_line = pp_id - kernel.kernel_size * nx;
+        float *out = &ricom_image[idr_line];
+        float *out_stack = &ricom_image_stack[id_image][idr_line];
         for (int iy = -kernel.kernel_size; iy <= kernel.kernel_size; iy++)
         {
-            for (int i_line = 0, idr_delay = pp_id - kernel.kernel_size * nx;
-                i_line < nx;
-                i_line++, idr_delay++)
+            int idc = idr_line + iy * nx;
+            int idk = (kernel.kernel_size + iy) * kernel.k_width_sym;
+            for (int ix = -kernel.kernel_size; ix <= kernel.kernel_size; ix++, idk++)
             {
-                idc = idr_delay + iy * nx;
-                idr_x = idr_delay % nx;
-                idk = (kernel.kernel_size + iy) * kernel.k_width_sym;
-                for (int ix = -kernel.kernel_size; ix <= kernel.kernel_size; ix++)
-                {
-                    if (((idr_x + ix) >= 0) & ((idr_x + ix) < nx))
-                    {
-                        ricom_image[idr_delay] += ((comx_image[idc + ix] - offset[0]) * -kernel.kernel_x[idk] + (comy_image[idc + ix] - offset[1]) * -kernel.kernel_y[idk]);
-                        ricom_image_stack[id_image][idr_delay] += ((comx_image[idc + ix] - offset[0]) * -kernel.kernel_x[idk] + (comy_image[idc + ix] - offset[1]) * -kernel.kernel_y[idk]);
-                    }
-                    ++idk;
-                }
+                int i_first = std::max(0, -ix);
+                int i_last = std::min(nx, nx - ix);
+                if (i_last <= i_first) continue;
+                icom_tap(out + i_first, out_stack + i_first, &comx_image[idc + ix + i_first], &comy_image[idc + ix + i_first],
+                    i_last - i_first, -kernel.kernel_x[idk], -kernel.kernel_y[idk], offset[0], offset[1]);
             }
         }
         fr_count = pp_id;
@@ -500,6 +564,7 @@ void Ricom::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
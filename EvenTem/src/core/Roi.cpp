@@ -49,6 +49,42 @@ void Roi::run(){
             {
                 cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
             }
+            configure_camera(cam);
+            cam.run();
+            process_data();
+            cam.terminate();
+            break;
+         }
+         case CAMERA::ADVARAW:
+         {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,  
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+            if (b_ROI_4D)
+            {
+                if (bitdepth == 8) cam.enable_roi_4D(Roi_4D_8,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right,det_bin);
+                else if (bitdepth == 16) cam.enable_roi_4D(Roi_4D_16,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right,det_bin);
+                else if (bitdepth == 32) cam.enable_roi_4D(Roi_4D_32,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right,det_bin);
+            }
+            else if (use_mask)
+            {
+                cam.enable_roi_mask(&roi_mask,&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern);
+            }
+            else
+            {
+                cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
+            }
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -83,6 +119,16 @@ void Roi::run(){
             {
                 cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
             }
+            configure_camera(cam);
+            if (!use_mask)
+            {
+                // only the lines of the rectangle are decoded, from its first line in the first
+                // repetition to its last line in the last one
+                int roi_end = (rep - 1) * ny + nx - lower_left[1];
+                if ((end_line > 0) && ((end_line < roi_end) || b_continuous)) roi_end = end_line;
+                else if (b_continuous) roi_end = -1;
+                cam.enable_index(b_index, std::max(first_line, nx - upper_right[1]), roi_end);
+            }
             cam.run();
             process_data();
             cam.terminate();
@@ -117,6 +163,7 @@ void Roi::run(){
             {
                 cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
             }
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -151,6 +198,7 @@ void Roi::run(){
             {
                 cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
             }
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -179,6 +227,7 @@ void Roi::run(){
                 {
                     cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
                 }
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -204,6 +253,7 @@ void Roi::run(){
                 {
                     cam.enable_roi(&Roi_scan_image_stack,&Roi_diffraction_pattern_stack,&Roi_scan_image,&Roi_diffraction_pattern, lower_left, upper_right);
                 }
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -335,6 +385,7 @@ void Roi::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
@@ -350,7 +401,7 @@ void Roi::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
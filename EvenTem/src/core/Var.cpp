@@ -36,6 +36,29 @@ void Var::run(){
                 socket
             );
             cam.enable_var(&Var_data, offset);
+            configure_camera(cam);
+            cam.run();
+            process_data();
+            cam.terminate();
+            break;
+         }
+         case CAMERA::ADVARAW:
+         {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,  
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+            cam.enable_var(&Var_data, offset);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -57,6 +80,7 @@ void Var::run(){
                 socket
             );
             cam.enable_var(&Var_data, offset);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -78,6 +102,7 @@ void Var::run(){
                 socket
             );
             cam.enable_var(&Var_data, offset);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -121,6 +146,7 @@ void Var::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 
 }
 
@@ -136,7 +162,7 @@ void Var::line_processor(
 {
     int idxx = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line)
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line())
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0)
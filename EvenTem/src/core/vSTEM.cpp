@@ -42,6 +42,38 @@ void vSTEM::run(){
             }
             else  cam.enable_vSTEM(&detector.radia_sqr[0],&offsets[0],&vSTEM_stack);
             // else  cam.enable_atomic_vSTEM(&detector.radia_sqr[0],&offsets[0],&atomic_vSTEM_image);
+            configure_camera(cam);
+            cam.run();
+            startime = std::chrono::high_resolution_clock::now();
+            process_data();
+            cam.terminate();
+            processing_rate = cam.get_processing_rate();
+            // from_atomic();
+            break;
+         }
+         case CAMERA::ADVARAW:
+         {   
+            using namespace ADVAPIX_ADDITIONAL;
+            ADVAPIX<RAW_EVENT, RAW_BUFFER_SIZE, N_BUFFER> cam(
+                nx, 
+                ny,
+                dt,
+                &b_cumulative,
+                rep,
+                processor_line,
+                preprocessor_line,
+                mode,
+                file_path,
+                socket
+            );
+            if (use_mask) cam.enable_mask_vSTEM(&detector_mask,&vSTEM_stack);
+            else if (detector.n_detectors > 1)
+            {
+                cam.enable_multi_vSTEM(&detector.radia_sqr,&offsets,&vSTEM_stack);
+            }
+            else  cam.enable_vSTEM(&detector.radia_sqr[0],&offsets[0],&vSTEM_stack);
+            // else  cam.enable_atomic_vSTEM(&detector.radia_sqr[0],&offsets[0],&atomic_vSTEM_image);
+            configure_camera(cam);
             cam.run();
             startime = std::chrono::high_resolution_clock::now();
             process_data();
@@ -71,6 +103,7 @@ void vSTEM::run(){
                 cam.enable_multi_vSTEM(&detector.radia_sqr,&offsets,&vSTEM_stack);
             }
             else  cam.enable_vSTEM(&detector.radia_sqr[0],&offsets[0],&vSTEM_stack);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -97,6 +130,7 @@ void vSTEM::run(){
             }
             else  cam.enable_vSTEM(&detector.radia_sqr[0],&offsets[0],&vSTEM_stack);
             // else  cam.enable_atomic_vSTEM(&detector.radia_sqr[0],&offsets[0],&atomic_vSTEM_image);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -123,6 +157,7 @@ void vSTEM::run(){
                 cam.enable_multi_vSTEM(&detector.radia_sqr,&offsets,&vSTEM_stack);
             }
             else  cam.enable_vSTEM(&detector.radia_sqr[0],&offsets[0],&vSTEM_stack);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -145,6 +180,7 @@ void vSTEM::run(){
                 );
                 compute_detector();
                 cam.enable_vSTEM(&detector.detector_image,&vSTEM_stack, allow_torch);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -165,6 +201,7 @@ void vSTEM::run(){
                 );
                 compute_detector();
                 cam.enable_vSTEM(&detector.detector_image,&vSTEM_stack, allow_torch);
+                configure_camera(cam);
                 cam.run();
                 process_data();
                 cam.terminate();
@@ -189,6 +226,7 @@ void vSTEM::run(){
             );
             compute_detector();
             cam.enable_vSTEM(&detector.detector_image,&vSTEM_stack, allow_torch);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -210,6 +248,7 @@ void vSTEM::run(){
             );
             compute_detector();
             cam.enable_vSTEM(&detector.detector_image,&vSTEM_stack, allow_torch);
+            configure_camera(cam);
             cam.run();
             process_data();
             cam.terminate();
@@ -246,6 +285,7 @@ void vSTEM::reset()
     // Data Processing Progress
     *processor_line = 0;
     *preprocessor_line = 0;
+    line_notifier.reset();
 }
 
 
@@ -260,7 +300,7 @@ void vSTEM::line_processor(
 {
     int pp_id = 0;
     // process newly finished lines, if there are any
-    if ((int)(prog_mon->fr_count / nx) < *preprocessor_line) 
+    if ((int)(prog_mon->fr_count / nx) < line_notifier.line()) 
     {
         *processor_line = (int)(prog_mon->fr_count) / nx;
         if (*processor_line%ny==0) id_image = *processor_line / ny;
@@ -21,7 +21,9 @@ inline void OnTpx3Data(intptr_t eventData, intptr_t userData)
     int deviceIndex = cbData->deviceIndex;
     int n_buffer = ADVAPIX_ADDITIONAL::N_BUFFER;
 
-    if (!(*cbData->p_n_buffer_filled < (n_buffer + *cbData->p_n_buffer_processed)))
+    SpscRing *ring = cbData->p_ring;
+
+    if (!(ring->filled() - ring->processed() < (uint64_t)n_buffer))
     {
         std::cout << "Error: Buffer is full" << std::endl;
         return;
@@ -38,9 +40,9 @@ inline void OnTpx3Data(intptr_t eventData, intptr_t userData)
 
     if (rc) return;
 
-    (*cbData->p_ragged_buffer)[*cbData->p_n_buffer_filled % n_buffer] = Tpx3Pixels;
-    (*cbData->p_ragged_buffer_sizes)[*cbData->p_n_buffer_filled % n_buffer] = pixelCount;
-    (*cbData->p_n_buffer_filled)++;
+    (*cbData->p_ragged_buffer)[ring->filled() % n_buffer] = Tpx3Pixels;
+    (*cbData->p_ragged_buffer_sizes)[ring->filled() % n_buffer] = pixelCount;
+    ring->push();
     return;
 };
 #endif
@@ -30,9 +30,12 @@
 #include <array>
 #include <thread>
 #include <chrono>
+#include <type_traits>
 
 #include "FileConnector.h"
 #include "Timepix.hpp"
+#include "Tpx3Decoder.hpp"
+#include "BoundedThreadPool.hpp"
 
 
 namespace ADVAPIX_ADDITIONAL
@@ -40,6 +43,7 @@ namespace ADVAPIX_ADDITIONAL
     const size_t BUFFER_SIZE = 14400;
     const size_t N_BUFFER = 1024;
 
+    // .t3p record, ToA in 25 ns
     PACK(struct EVENT
     {
         uint32_t index;
@@ -48,6 +52,14 @@ namespace ADVAPIX_ADDITIONAL
         uint8_t ftoa;
         uint16_t tot;
     });
+
+    // .t3r: the 64 bit packets of the readout, hits in the layout of the .tpx3 stream (chip packet
+    // in the upper 48 bits, ToA extended by 16 bits in the lower ones). The layout is taken from the
+    // Timepix3 manual (pixel packet, 0xb header) and the spidr .tpx3 format; it has not been
+    // checked against .t3r files written by Pixet, only against DataGenerator::advaraw(), which
+    // makes the same assumption. LiveProcessor reads .t3r only with b_experimental_t3r set.
+    typedef uint64_t RAW_EVENT;
+    const size_t RAW_BUFFER_SIZE = 28800; // the bytes of a .t3p buffer
 };
 
 #ifdef PIXET_ENABLED
@@ -65,8 +77,7 @@ namespace ADVAPIX_ADDITIONAL
 struct CallbackData_t
 {
     int deviceIndex;
-    int *p_n_buffer_filled;
-    int *p_n_buffer_processed;
+    SpscRing *p_ring;
     std::shared_ptr<Tpx3Pixel[]> (*p_ragged_buffer)[ADVAPIX_ADDITIONAL::N_BUFFER];
     int (*p_ragged_buffer_sizes)[ADVAPIX_ADDITIONAL::N_BUFFER];
 };
@@ -88,8 +99,19 @@ class ADVAPIX : public TIMEPIX<event, buffer_size, n_buffer>
 { 
 private:
     int dt;
+    EventBatch batch = EventBatch(buffer_size);
+
+    // .t3r files hold the packets of the chip (RAW_EVENT) instead of the .t3p pixel records
+    static constexpr bool raw = std::is_same<event, uint64_t>::value;
+    uint64_t time_ref = 0; // .t3r: ToA of the last hit, unwrapped (ToA units, 1.5625 ns)
 
-    BoundedThreadPool *event_parsing_pool = new BoundedThreadPool;
+    // parallel decoding
+    int n_decode_threads = 1;
+    int decode_batch = 1;
+    BoundedThreadPool decode_pool;
+    std::vector<uint64_t> checkpoints; // time_ref before each buffer of the batch
+    std::vector<EventBatch> decoded;
+    TaskGroup decode_group;
 
     #ifdef PIXET_ENABLED
     unsigned deviceIndex = 0 ;
@@ -132,7 +154,7 @@ private:
         pxcSetDeviceParameter(deviceIndex, PAR_DDBLOCKSIZE, BLOCKSIZE); //in MegaBytes unlike what docs say
         pxcSetDeviceParameter(deviceIndex, PAR_DDBUFFSIZE, BUFFSIZE); // in MegaBytes 1000
 
-        CallbackData = new CallbackData_t{(int)deviceIndex, &this->n_buffer_filled, &this->n_buffer_processed};
+        CallbackData = new CallbackData_t{(int)deviceIndex, &this->ring};
         p_ragged_buffer = new std::shared_ptr<Tpx3Pixel[]>[1][n_buffer];
         for (int i = 0; i < n_buffer; ++i){
             (*p_ragged_buffer)[i] = std::shared_ptr<Tpx3Pixel[]>(new Tpx3Pixel[1], std::default_delete<Tpx3Pixel[]>());
@@ -150,49 +172,117 @@ private:
     inline void schedule_buffer()
     {
         int buffer_id;
+        this->trace_thread("proc_thread");
+
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
+        {
+            buffer_id = this->ring.processed() % this->n_buf;
+
+            if (!this->repetitions_reached)
+            { 
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+                switch (this->mode)
+                {
+                    case 0:
+                        process_buffer(this->slot(buffer_id));
+                        break;
+                    case 1:
+                        ELOG_DEBUG("ragged buffer of %d events", (int)(*p_ragged_buffer_sizes)[buffer_id]);
+                        process_ragged_buffer((*p_ragged_buffer)[buffer_id],  (*p_ragged_buffer_sizes)[buffer_id]);
+                        break;
+                }
+                if (this->decluster) {
+                    this->declusterer.set_buffer_read();
+                    ELOG_DEBUG("filled buffer %llu", (unsigned long long)this->ring.filled());
+                }
+                this->publish_line((int)this->current_line);
+            }
+            this->ring.pop();
+        }
+    };
+
+    // Parallel decoding (files): the records of a .t3p buffer are independent, a .t3r buffer only
+    // depends on time_ref, which a pre-pass takes from its last hit. A batch of buffers is decoded
+    // concurrently by the decode_pool; process methods with a sharded form are accumulated by the
+    // decode tasks into their own shard and reduced here after the batch, the others are
+    // accumulated in buffer order on this thread.
+    inline void schedule_buffer_parallel()
+    {
+        int buffer_id;
+        int n_batch;
+        this->trace_thread("proc_thread");
 
-        while ((*this->p_processor_line)!=-1)
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            if (this->n_buffer_processed < this->n_buffer_filled)
+            n_batch = std::min((int)this->ring.available(), decode_batch);
+            if (!this->repetitions_reached)
             {
-                buffer_id = this->n_buffer_processed % this->n_buf;
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+
+                for (int k = 0; k < n_batch; k++)
+                {
+                    buffer_id = (this->ring.processed() + k) % this->n_buf;
+                    checkpoints[k] = time_ref;
+                    if constexpr (raw) time_ref = advance_time(time_ref, this->slot(buffer_id));
+                }
 
-                if (!this->repetitions_reached)
-                { 
-                    switch (this->mode)
+                for (int k = 0; k < n_batch; k++)
+                {
+                    buffer_id = (this->ring.processed() + k) % this->n_buf;
+                    int64_t seq = this->ring.processed() + k;
+                    decode_pool.push_task(decode_group, [this, k, buffer_id, seq]
                     {
-                        case 0:
-                            process_buffer(&(this->buffer[buffer_id]));
-                            // event_parsing_pool->push_task([=]{process_buffer(&(this->buffer[buffer_id]));});
-                            break;
-                        case 1:
-                            std::cout << (*p_ragged_buffer_sizes)[buffer_id] << std::endl;
-                            process_ragged_buffer((*p_ragged_buffer)[buffer_id],  (*p_ragged_buffer_sizes)[buffer_id]);
-                            break;
-                    }
-                    if (this->decluster) {
-                        this->declusterer.set_buffer_read();
-                        #ifdef DBG_LOG 
-                            Logger::getInstance().log("filled buffer " + std::to_string(n_buffer_filled));
-                        #endif
+                        this->trace_thread("decode_pool");
+                        uint64_t ref = checkpoints[k];
+                        int64_t t0 = this->trace_time();
+                        decode_buffer(ref, this->slot(buffer_id), decoded[k]);
+                        this->remap_batch(decoded[k]);
+                        t0 = this->trace_span("decode", seq, t0);
+                        if (this->b_sharded)
+                        {
+                            int shard_id = this->acquire_shard();
+                            this->accumulate_shard(this->shards[shard_id], decoded[k]);
+                            this->release_shard(shard_id);
+                            this->trace_span("accumulate", seq, t0);
+                        }
+                    });
+                }
+                decode_group.wait();
+                if constexpr (raw) this->repetitions_reached = scan_complete(time_ref);
+
+                if (this->b_sharded)
+                {
+                    int64_t t0 = this->trace_time();
+                    for (auto &shard : this->shards) this->reduce_shard(shard);
+                    this->trace_span("reduce", this->ring.processed(), t0);
+                }
+                for (int k = 0; k < n_batch; k++)
+                {
+                    if (!this->b_sharded)
+                    {
+                        int64_t t0 = this->trace_time();
+                        this->accumulate_batch(decoded[k]);
+                        this->trace_span("accumulate", this->ring.processed() + k, t0);
                     }
-                    ++this->n_buffer_processed;
-                    *this->p_preprocessor_line = (int)this->current_line;
+                    if (this->decluster) this->declusterer.set_buffer_read();
+                    update_position(this->slot((this->ring.processed() + k) % this->n_buf));
                 }
             }
-            else
-            {
-                this->process_wait++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            }
+            this->ring.pop(n_batch);
+            this->publish_line((int)this->current_line);
         }
     };
 
     inline void process_ragged_buffer(std::shared_ptr<Tpx3Pixel[]> p_buffer, size_t size)
     {
-        for (int j = 0; j < size; j++)
+        // the callback buffers have no fixed size, so they are decoded in batch-sized chunks
+        for (size_t j = 0; (j < size) && (!this->repetitions_reached); )
         {
-            if (!this->repetitions_reached) process_event(&p_buffer[j]);
+            batch.clear();
+            for (; (j < size) && (batch.n < batch.capacity()) && (!this->repetitions_reached); j++) decode_event(&p_buffer[j], batch);
+            if (this->p_metrics) this->p_metrics->count_decoded(batch.n, batch.n);
+            this->remap_batch(batch);
+            this->accumulate_batch(batch);
         }
 
         if (!this->repetitions_reached) {
@@ -208,22 +298,58 @@ private:
         }
     };
 
-
-
-    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    // ref: time_ref before the buffer (.t3r), advanced over it
+    inline void decode_buffer(uint64_t &ref, std::array<event, buffer_size> *p_buffer, EventBatch &events)
     {
+        size_t n_hits = 0;
+        events.clear();
         for (int j = 0; j < buffer_size; j++)
         {
-            if (!this->repetitions_reached) 
+            if (this->repetitions_reached) break;
+            if constexpr (raw)
             {
-                process_event(&(*p_buffer)[j]);
-                // for (int i_proc=0; i_proc<this->n_proc; i_proc++) { this->process[i_proc](); }
+                if (!TPX3_DECODER::is_event((*p_buffer)[j])) continue; // time and control packets
+                ++n_hits;
+                decode_packet(ref, (*p_buffer)[j], events);
             }
+            else if (!is_padding((*p_buffer)[j])) decode_event(&(*p_buffer)[j], events);
         }
+        if constexpr (!raw) n_hits = events.n;
+        if (this->p_metrics) this->p_metrics->count_decoded(n_hits, events.n);
+    };
 
+    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    {
+        int64_t t0 = this->trace_time();
+        decode_buffer(time_ref, p_buffer, batch);
+        if constexpr (raw) this->repetitions_reached = scan_complete(time_ref);
+        this->remap_batch(batch);
+        t0 = this->trace_span("decode", this->ring.processed(), t0);
+        this->accumulate_batch(batch);
+        this->trace_span("accumulate", this->ring.processed(), t0);
+        update_position(p_buffer);
+    };
+
+    // the last buffer of a file is padded with zeros (empty packets in a .t3r)
+    static inline bool is_padding(const event &e)
+    {
+        if constexpr (raw) return e == 0;
+        else return (e.toa == 0) && (e.index == 0) && (e.tot == 0);
+    };
+
+    // scan position after the buffer, from the time of its last hit
+    inline void update_position(std::array<event, buffer_size> *p_buffer)
+    {
         if (!this->repetitions_reached) 
         {
-            this->probe_position_total = (*p_buffer).back().toa * 25 / this->dt;
+            if constexpr (raw) this->probe_position_total = time_ref * 25 / 16 / this->dt;
+            else
+            {
+                int j = buffer_size;
+                while ((j > 0) && is_padding((*p_buffer)[j - 1])) j--;
+                if (j == 0) return; // past the end of the file
+                this->probe_position_total = (*p_buffer)[j - 1].toa * 25 / this->dt;
+            }
             this->current_line = floor(this->probe_position_total / this->nx);
             this->id_image = this->probe_position_total / this->nxy;
         }
@@ -237,7 +363,7 @@ private:
 
     uint64_t latest_pp = 0;
     
-    inline void process_event(event *packet)
+    inline void decode_event(event *packet, EventBatch &events)
     {
         uint64_t _probe_position_total = packet->toa * 25 / this->dt;
         uint16_t _kx = packet->index % this->n_cam;
@@ -250,66 +376,10 @@ private:
         //     return;
         // }
 
-        switch(this->functionType)
-        {
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                this->vstem(_probe_position_total%this->nxy,_kx,_ky, _id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                this->multi_vstem(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::mask_vstem:
-                this->mask_vstem(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::atomic_vstem:
-                this->atomic_vstem(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                this->com(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                this->count_chunked_8(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                this->count_chunked_16(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                this->count_chunked_32(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                this->pacbed(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                this->var(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                this->roi(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_mask:
-                this->roi_mask(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                this->roi_4D(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                this->write_electron(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_declusterer_buffer:
-                this->write_declusterer_buffer(_probe_position_total%this->nxy,_kx,_ky,_id_image,packet->toa*25,packet->tot);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                this->information(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            #ifdef GPRI_OPTION_ENABLED
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                this->GPRI(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            #endif
-        }
-        ++this->n_events_processed;
+        events.push_back(_probe_position_total%this->nxy,_kx,_ky,_id_image,packet->toa*25,packet->tot);
     };
 
-    inline void process_event(Tpx3Pixel *packet)
+    inline void decode_event(Tpx3Pixel *packet, EventBatch &events)
     {
         uint64_t _probe_position_total = packet->toa * 25 / this->dt;
         uint16_t _kx = packet->index % this->n_cam;
@@ -322,66 +392,67 @@ private:
             return;
         }
 
-        switch(this->functionType)
+        events.push_back(_probe_position_total%this->nxy,_kx,_ky,_id_image,packet->toa*25,packet->tot);
+    };
+
+    // .t3r hit packet of the single chip. The ToA is unwrapped against the hit before it (ref),
+    // so hits up to half the ToA range (13.4 s) out of order still land at the right time.
+    inline void decode_packet(uint64_t &ref, uint64_t packet, EventBatch &events)
+    {
+        ref = TPX3_DECODER::unwrap(TPX3_DECODER::toa<true>(packet), ref, TPX3_DECODER::toa_bits);
+        uint64_t _toa = ref * 25 / 16; // ns
+        uint64_t _probe_position_total = _toa / this->dt;
+        uint64_t pack_44 = packet >> 44;
+        uint16_t _kx = ((pack_44 & 0x0FE00) >> 8) + ((pack_44 & 0x00007) >> 2);
+        uint16_t _ky = ((pack_44 & 0x001F8) >> 1) + (pack_44 & 0x00003);
+        uint16_t _id_image = _probe_position_total / this->nxy;
+
+        // past the last repetition, the buffer ends the scan (scan_complete)
+        if (_probe_position_total >= (uint64_t)this->nxy*this->repetitions) return;
+
+        events.push_back(_probe_position_total%this->nxy,_kx,_ky,_id_image,_toa,(packet >> 20) & 0x3ff);
+    };
+
+    // .t3r: the repetitions are reached once the time passes the last probe position, as with the
+    // hits of the live .t3p path. Set on the processing thread after a buffer or a parallel batch,
+    // the decode tasks only drop the hits after it.
+    inline bool scan_complete(uint64_t ref)
+    {
+        return ref * 25 / 16 / this->dt >= (uint64_t)this->nxy * this->repetitions;
+    };
+
+    // pre-pass: time_ref after a .t3r buffer; a buffer spans far less than half the ToA range,
+    // so this is the time of its last hit
+    inline uint64_t advance_time(uint64_t ref, std::array<event, buffer_size> *p_buffer)
+    {
+        for (int j = buffer_size; j-- > 0;)
         {
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                this->vstem(_probe_position_total%this->nxy,_kx,_ky, _id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                this->multi_vstem(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::mask_vstem:
-                this->mask_vstem(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                this->com(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                this->count_chunked_8(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                this->count_chunked_16(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                this->count_chunked_32(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                this->pacbed(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                this->var(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                this->roi(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_mask:
-                this->roi_mask(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                this->roi_4D(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                this->write_electron(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_declusterer_buffer:
-                this->write_declusterer_buffer(_probe_position_total%this->nxy,_kx,_ky,_id_image,packet->toa*25,packet->tot);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                this->information(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            #ifdef GPRI_OPTION_ENABLED
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                this->GPRI(_probe_position_total%this->nxy,_kx,_ky,_id_image);
-                break;
-            #endif
+            if (TPX3_DECODER::is_event((*p_buffer)[j])) return TPX3_DECODER::unwrap(TPX3_DECODER::toa<true>((*p_buffer)[j]), ref, TPX3_DECODER::toa_bits);
         }
-        ++this->n_events_processed;
+        return ref;
+    };
+
+    void reset()
+    {
+        TIMEPIX<event, buffer_size, n_buffer>::reset();
+        time_ref = 0;
     };
 
 public:
+    // decodes file buffers on n_threads threads
+    void enable_parallel_decoding(int n_threads)
+    {
+        if (n_threads <= 1) return;
+        n_decode_threads = n_threads;
+        decode_batch = std::min(8 * n_decode_threads, n_buffer / 4);
+        checkpoints.resize(decode_batch);
+        decoded.assign(decode_batch, EventBatch(buffer_size));
+        decode_pool.init(n_decode_threads, decode_batch);
+    }
+
     void run()
     {
-        this->reset();
+        reset();
         switch (this->mode)
         {
             case 0:
@@ -399,7 +470,15 @@ public:
                 break;
             }
         }
-        this->proc_thread = std::thread(&ADVAPIX<event, buffer_size, n_buffer>::schedule_buffer, this);
+        if ((n_decode_threads > 1) && (this->mode == 0))
+        {
+            this->init_shards(n_decode_threads);
+            this->proc_thread = std::thread(&ADVAPIX<event, buffer_size, n_buffer>::schedule_buffer_parallel, this);
+        }
+        else
+        {
+            this->proc_thread = std::thread(&ADVAPIX<event, buffer_size, n_buffer>::schedule_buffer, this);
+        }
         this->starttime  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
     };
 
@@ -432,7 +511,6 @@ public:
         dt(dt)
         {this->n_cam = 256;
         if (dt == 0) std::cout << "Dwell time not provided!" << std::endl;
-        // event_parsing_pool->init(1, 16);
         }
 
     #ifdef PIXET_ENABLED
@@ -31,9 +31,15 @@
 #include <thread>
 #include <chrono>
 #include <set>
+#include <mutex>
+#include <condition_variable>
 
 #include "FileConnector.h"
 #include "Timepix.hpp"
+#include "Tpx3Decoder.hpp"
+#include "Tpx3Index.hpp"
+#include "EventBatch.hpp"
+#include "BoundedThreadPool.hpp"
 
 namespace CHEETAH_ADDITIONAL
 {
@@ -44,284 +50,304 @@ namespace CHEETAH_ADDITIONAL
     using EVENT = uint64_t;
 }; 
 
-#pragma pack(push, 1)
-struct state_after_buffer
-{
-    uint64_t tdc_offset;
-    uint64_t toa_offset;
-    int line_count[4];
-};
-#pragma pack(pop)
-
 template <typename event, int buffer_size, int n_buffer>
 class CHEETAH : public TIMEPIX<event, buffer_size, n_buffer>
 {
 private:
+    using Shard = typename TIMEPIX<event, buffer_size, n_buffer>::Shard;
 
-    std::vector<state_after_buffer> state_after_buffer_list;
+    state_after_buffer state;
+    EventBatch batch = EventBatch(buffer_size);
 
     // header
-    int chip_id;
     uint64_t tpx_header = 861425748; //(b'TPX3', 'little')
 
+    // packets that are not used, counted instead of reported one by one
+    uint64_t n_global_time_packets = 0;
+    uint64_t n_unknown_packets = 0;
+    uint64_t n_toa_rollovers = 0; // including the ones that are also TDC rollovers
+    uint64_t n_tdc_rollovers = 0;
+
     // TDC
-    uint64_t rise_t[4];
-    uint64_t fall_t[4];
-    bool rise_fall[4] = {false, false, false, false};
-    int line_count[4] = {0, 0, 0, 0};
-    int most_advanced_line = 0;
-    uint64_t line_interval;
     uint64_t dt;
+    uint64_t stop_line = 0; // the scan is complete once every chip reached this line
 
-    int type;
+    // sidecar index (Tpx3Index.hpp), only decoding from first_line to end_line (-1: to the end)
+    bool b_index = false;
+    int first_line = 0;
+    int end_line = -1;
+    Tpx3Index index;
+    std::string index_path;     // empty when not indexing this run
+    uint64_t start_offset = 0;  // of ring buffer 0 in the stream
 
     // event
-    uint64_t toa = 0;
-    uint64_t pack_44;
     int address_multiplier[4] = {1,-1,-1,1};
     int address_bias_x[4] = {256, 511, 255, 0};
     int address_bias_y[4] = {0, 511, 511, 0};
 
-    // overflow correction
-    uint64_t prev_toa;
-    std::atomic<uint64_t> toa_offset = 0;
-    uint64_t toa_overflow_drop = 4294967296;
-    int last_offset_line = 0;
+    // parallel decoding
+    int n_decode_threads = 1;
+    int decode_batch = 1;
+    BoundedThreadPool decode_pool;
+    std::vector<state_after_buffer> checkpoints;
+    std::vector<EventBatch> decoded;
+    TaskGroup decode_group;
 
-    uint64_t prev_tdc = 0;
-    uint64_t tdc_offset = 0;
-    uint64_t tdc_overflow_drop = 17179869184; //half of 34359738368 = tdc range
-    int last_offset_line_tdc = 0;
-    std::thread check_overflow_thread;
 
+    // The line and the scan of the hits come from the line count of their own chip: the chips
+    // finish a line at slightly different points of the stream, s.id_image already moves on when
+    // the first chip starts the next scan.
+    inline TPX3_DECODER::run_parameters run_parameters(const state_after_buffer &s)
+    {
+        return {
+            s.rise_t[s.chip_id] * 2,
+            s.dt,
+            (uint64_t)this->nx,
+            (uint64_t)((s.line_count[s.chip_id] % this->ny) * this->nx),
+            address_multiplier[s.chip_id],
+            address_bias_x[s.chip_id],
+            address_bias_y[s.chip_id],
+            (uint16_t)(s.line_count[s.chip_id] / this->ny)
+        };
+    };
 
-    void parse_event(event *packet)
+    // Unwraps a 35 bit TDC / global time against the last one of the stream. The ToA and TDC
+    // ranges are 26.8 s and 107.4 s, the time packets of a scan are much closer than half of that.
+    // One reference for all chips is enough: the chips run on the same clock and their chunks
+    // interleave in the stream within far less than half a period, so the last time of any chip
+    // is as good as the chip's own. A per chip reference would go stale on a chip that sends no
+    // time packets for half a period. The hits are then taken relative to the TDC rise of their
+    // own chip (run_parameters).
+    template <bool primary>
+    inline uint64_t advance_time(state_after_buffer &s, uint64_t raw)
     {
-        toa = ((((*packet & 0xFFFF) << 14) + ((*packet >> 30) & 0x3FFF)) << 4) + toa_offset;
-        uint64_t _probe_position = ( toa - (rise_t[chip_id] * 2)) / dt;
-        if (_probe_position < this->nx)
+        uint64_t t = TPX3_DECODER::unwrap(raw, s.time_ref, TPX3_DECODER::tdc_bits);
+        uint64_t period = (2 * t) >> 34;
+        if (s.time_ref == 0) s.toa_period = period; // first time packet of the stream
+        else if (period > s.toa_period)
         {
-            pack_44 = (*packet >> 44);
-            _probe_position += (line_count[chip_id] % this->ny) * this->nx;
-            uint16_t _kx = (address_multiplier[chip_id] * (((pack_44 & 0x0FE00) >> 8) + ((pack_44 & 0x00007) >> 2)) + address_bias_x[chip_id]);
-            uint16_t _ky = (address_multiplier[chip_id] * (((pack_44 & 0x001F8) >> 1) + (pack_44 & 0x00003)) + address_bias_y[chip_id]);
-
-            switch(this->functionType)
+            bool tdc = TPX3_DECODER::is_tdc_rollover(s.toa_period, period);
+            s.toa_period = period;
+            if constexpr (primary)
             {
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                    this->vstem(_probe_position,_kx,_ky, this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                    this->multi_vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::mask_vstem:
-                    this->mask_vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                    this->com(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                    this->count_chunked_8(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                    this->count_chunked_16(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                    this->count_chunked_32(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                    this->pacbed(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                    this->var(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                    this->roi(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_mask:
-                    this->roi_mask(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                    this->roi_4D(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                    this->write_electron(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_declusterer_buffer:
-                    this->write_declusterer_buffer(_probe_position,_kx,_ky,this->id_image,toa,0);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                    this->information(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #ifdef GPRI_OPTION_ENABLED
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                    this->GPRI(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #endif
+                // reported after the run (terminate), the decode thread does not print
+                ++n_toa_rollovers;
+                if (tdc) ++n_tdc_rollovers;
+                if (this->p_tracer) this->p_tracer->instant(tdc ? "tdc_rollover" : "toa_rollover", s.current_line);
+                ELOG_DEBUG("%s rollover at line %llu", tdc ? "tdc" : "toa", (unsigned long long)s.current_line);
             }
-            ++this->n_events_processed;
         }
+        s.time_ref = t;
+        return t;
     };
 
-    void parse_event_w_tot(event *packet)
+    // makes the scan position of the decoder state visible to the rest of TIMEPIX
+    inline void publish_state(state_after_buffer &s)
     {
-        toa = ((((*packet & 0xFFFF) << 14) + ((*packet >> 30) & 0x3FFF)) << 4) - ((*packet >> 16) & 0xF) + toa_offset;
-        this->tot = ((*packet) >> (16 + 4)) & 0x3ff;
-        uint64_t _probe_position = ( toa - (rise_t[chip_id] * 2)) / dt;
-        if (_probe_position < this->nx)
+        this->current_line = s.current_line;
+        this->id_image = s.id_image;
+        this->repetitions_reached = s.repetitions_reached;
+        if (this->repetitions_reached)  
         {
-            pack_44 = (*packet >> 44);
-            _probe_position += (line_count[chip_id] % this->ny) * this->nx;
-            uint16_t _kx = (address_multiplier[chip_id] * (((pack_44 & 0x0FE00) >> 8) + ((pack_44 & 0x00007) >> 2)) + address_bias_x[chip_id]);
-            uint16_t _ky = (address_multiplier[chip_id] * (((pack_44 & 0x001F8) >> 1) + (pack_44 & 0x00003)) + address_bias_y[chip_id]);
-
-            switch(this->functionType)
-            {
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                    this->vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                    this->multi_vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::mask_vstem:
-                    this->mask_vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                    this->com(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                    this->count_chunked_8(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                    this->count_chunked_16(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                    this->count_chunked_32(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                    this->pacbed(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                    this->var(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                    this->roi_ToT(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_mask:
-                    this->roi_mask(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                    this->roi_4D(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                    this->write_electron(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_declusterer_buffer:
-                    this->write_declusterer_buffer(_probe_position,_kx,_ky,this->id_image,toa*25./16.,this->tot);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                    this->information(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #ifdef GPRI_OPTION_ENABLED
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                    this->GPRI(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #endif
-            }
-            ++this->n_events_processed;
+            this->probe_position_total = this->nxy*this->repetitions+1;
+            this->id_image = this->repetitions;
+            this->current_line = this->ny*this->repetitions; // also when stopped at end_line
         }
     };
 
-    void check_toa_overflow()
+    inline uint64_t stream_offset(int64_t seq)
     {
-        if ((prev_toa > toa + toa_overflow_drop) && (this->current_line > 1) && (last_offset_line != this->current_line)) // toa drop bigger than half of toa range --> toa must have overflowed
-        {
-            toa_offset += 17179869184; 
-            last_offset_line = this->current_line;
-            std::cout << "toa overflow at line " << this->current_line << std::endl;
-        }
-        prev_toa = toa;
+        return start_offset + (uint64_t)seq * sizeof(std::array<event, buffer_size>);
+    };
+
+    inline Tpx3Index::layout index_layout()
+    {
+        return {sizeof(std::array<event, buffer_size>), (uint64_t)this->nx, (uint64_t)this->ny};
+    };
+
+    // Loads the index of the file and starts reading at the last entry before first_line. The
+    // processors then see the lines before as complete and empty.
+    void open_index()
+    {
+        index_path = Tpx3Index::path_for(this->file_path);
+        index.load(index_path, index_layout(), this->file_path, this->file.file_size);
+        const Tpx3Index::entry *e = (first_line > 0) ? index.find(first_line) : nullptr;
+        if (e == nullptr) return;
+        state = e->state;
+        state.repetitions_reached = (state.current_line >= stop_line);
+        start_offset = e->offset;
+        this->file.seek_to(start_offset);
+        publish_state(state);
+        this->publish_line((int)this->current_line);
+        std::cout << "Starting at line " << state.current_line << " (byte " << start_offset << " of " << this->file_path << ")" << std::endl;
     };
 
-    void continous_check_toa_overflow(){
-        while ((*this->p_processor_line)!=-1)
+    inline void schedule_buffer()
+    {
+        int buffer_id;
+        this->trace_thread("proc_thread");
+
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            check_toa_overflow();
-            std::this_thread::sleep_for(std::chrono::microseconds(1));
+            buffer_id = this->ring.processed() % this->n_buf;
+
+            if (!this->repetitions_reached)
+            { 
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+                if (!index_path.empty()) index.visit(stream_offset(this->ring.processed()), state, (const char *)this->slot(buffer_id));
+                process_buffer(this->slot(buffer_id));
+
+                if (this->decluster) this->declusterer.set_buffer_read();
+            }
+            this->ring.pop();
+            this->publish_line((int)this->current_line);
         }
-    }
+    };
 
-    inline void schedule_buffer()
+    // Parallel decoding: the only serial dependency between buffers is the decoder state, so a
+    // pre-pass over the header and TDC packets of a batch of buffers records a checkpoint before
+    // each buffer. The buffers are then decoded concurrently from their checkpoints by the
+    // decode_pool. Process methods with a sharded form are accumulated by the decode tasks into
+    // their own shard and reduced here after the batch; the others are accumulated in buffer order
+    // on this thread. Either way only this thread writes the images.
+    inline void schedule_buffer_parallel()
     {
         int buffer_id;
+        int n_batch;
+        this->trace_thread("proc_thread");
 
-        while ((*this->p_processor_line)!=-1)
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            if (this->n_buffer_processed < this->n_buffer_filled)
+            n_batch = std::min((int)this->ring.available(), decode_batch);
+            if (!this->repetitions_reached)
             {
-                buffer_id = this->n_buffer_processed % this->n_buf;
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
 
-                if (!this->repetitions_reached)
-                { 
-                    process_buffer(&(this->buffer[buffer_id]));
-                    state_after_buffer_list.push_back({tdc_offset, toa_offset, line_count[0], line_count[1], line_count[2], line_count[3]});
+                for (int k = 0; k < n_batch; k++)
+                {
+                    buffer_id = (this->ring.processed() + k) % this->n_buf;
+                    checkpoints[k] = state;
+                    if (state.repetitions_reached) continue; // as schedule_buffer: the rest of the batch is not read
+                    if (!index_path.empty()) index.visit(stream_offset(this->ring.processed() + k), state, (const char *)this->slot(buffer_id));
+                    checkpoint_buffer(state, this->slot(buffer_id));
+                }
 
-                    if (this->decluster) this->declusterer.set_buffer_read();
+                for (int k = 0; k < n_batch; k++)
+                {
+                    buffer_id = (this->ring.processed() + k) % this->n_buf;
+                    int64_t seq = this->ring.processed() + k;
+                    decode_pool.push_task(decode_group, [this, k, buffer_id, seq]
+                    {
+                        this->trace_thread("decode_pool");
+                        state_after_buffer s = checkpoints[k];
+                        int64_t t0 = this->trace_time();
+                        if (this->b_tot) decode_buffer<true, false>(s, this->slot(buffer_id), decoded[k]);
+                        else decode_buffer<false, false>(s, this->slot(buffer_id), decoded[k]);
+                        this->remap_batch(decoded[k]);
+                        t0 = this->trace_span("decode", seq, t0);
+                        if (this->b_sharded)
+                        {
+                            int shard_id = this->acquire_shard();
+                            this->accumulate_shard(this->shards[shard_id], decoded[k]);
+                            this->release_shard(shard_id);
+                            this->trace_span("accumulate", seq, t0);
+                        }
+                    });
+                }
+                decode_group.wait();
 
-                    ++this->n_buffer_processed;
+                if (this->b_sharded)
+                {
+                    int64_t t0 = this->trace_time();
+                    for (auto &shard : this->shards) this->reduce_shard(shard);
+                    this->trace_span("reduce", this->ring.processed(), t0);
                 }
-                *this->p_preprocessor_line = (int)this->current_line;
-                check_toa_overflow();
-            }
-            else
-            {
-                this->process_wait++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                for (int k = 0; k < n_batch; k++)
+                {
+                    if (!this->b_sharded)
+                    {
+                        int64_t t0 = this->trace_time();
+                        this->accumulate_batch(decoded[k]);
+                        this->trace_span("accumulate", this->ring.processed() + k, t0);
+                    }
+                    if (this->decluster) this->declusterer.set_buffer_read();
+                }
+                publish_state(state);
             }
+            this->ring.pop(n_batch);
+            this->publish_line((int)this->current_line);
         }
     };
 
-    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    // pre-pass: advances the decoder state over a buffer without decoding the pixel hits
+    inline void checkpoint_buffer(state_after_buffer &s, std::array<event, buffer_size> *p_buffer)
     {
-        switch (this->b_tot)
+        const event *p = p_buffer->data();
+        size_t j = 0;
+        while (j < buffer_size)
         {
-           case true:
-           for (int j = 0; j < buffer_size; j++)
+            if (TPX3_DECODER::is_event(p[j]))
             {
-                type = which_type(&(*p_buffer)[j]);
-                if ((type == 2) && rise_fall[chip_id] && (!this->repetitions_reached)) 
-                {
-                    parse_event_w_tot(&(*p_buffer)[j]);
-                }
+                j += TPX3_DECODER::event_run_length(p + j, buffer_size - j);
             }
-            break;
-            case false:
-            for (int j = 0; j < buffer_size; j++)
+            else which_type<true>(s, &p[j++]);
+        }
+    };
+
+    // Decodes the hits of a buffer into a batch. Header and TDC packets update the state in
+    // between; the runs of hits in between are decoded by the vectorised TPX3_DECODER kernels.
+    template <bool w_tot, bool primary>
+    inline void decode_buffer(state_after_buffer &s, std::array<event, buffer_size> *p_buffer, EventBatch &events)
+    {
+        const event *p = p_buffer->data();
+        size_t j = 0;
+        size_t n_hits = 0;
+        events.clear();
+        while (j < buffer_size)
+        {
+            if (TPX3_DECODER::is_event(p[j]))
             {
-                type = which_type(&(*p_buffer)[j]);
-                if ((type == 2) && rise_fall[chip_id] && (!this->repetitions_reached)) 
+                size_t n = TPX3_DECODER::event_run_length(p + j, buffer_size - j);
+                if (!s.repetitions_reached) n_hits += n;
+                if (s.rise_fall[s.chip_id] && (!s.repetitions_reached))
                 {
-                    parse_event(&(*p_buffer)[j]);
+                    TPX3_DECODER::decode_events<w_tot>(p + j, n, run_parameters(s), events);
                 }
+                j += n;
             }
+            else which_type<primary>(s, &p[j++]);
         }
-        if (this->repetitions_reached)  
+        if (this->p_metrics) this->p_metrics->count_decoded(n_hits, events.n);
+        if constexpr (w_tot)
         {
-            this->probe_position_total = this->nxy*this->repetitions+1;
-            this->id_image = this->repetitions;
+            for (size_t i = 0; i < events.n; i++) events.toa[i] = events.toa[i]*25./16.; // ns
         }
     };
 
-    inline int which_type(event *packet)
+    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    {
+        int64_t t0 = this->trace_time();
+        if (this->b_tot) decode_buffer<true, true>(state, p_buffer, batch);
+        else decode_buffer<false, true>(state, p_buffer, batch);
+        this->remap_batch(batch);
+        t0 = this->trace_span("decode", this->ring.processed(), t0);
+        this->accumulate_batch(batch);
+        this->trace_span("accumulate", this->ring.processed(), t0);
+        publish_state(state);
+    };
+
+    // primary: the decoder that owns the state (reports packets and rollovers, flushes images)
+    template <bool primary>
+    inline int which_type(state_after_buffer &s, const event *packet)
     {
         if ((*packet & 0xFFFFFFFF) == tpx_header) // header
         {
-            chip_id = (*packet >> 32) & 0xff;
+            s.chip_id = (*packet >> 32) & 0xff;
             return 0;
         } 
         else if (*packet >> 60 == 0x6) // TDC
         {
-            process_tdc(packet);
+            process_tdc<primary>(s, packet);
             return 1;
         } 
         else if (*packet >> 60 == 0xb) // event
@@ -330,95 +356,90 @@ private:
         }
         else if (*packet >> 60 == 0x4)
         {
-            std::cout << "global time" << std::endl;
+            if ((*packet >> 56) == 0x44) advance_time<primary>(s, ((*packet >> 16) & 0xFFFFFFFF) * 8); // global time, 25 ns
+            if constexpr (primary) ++n_global_time_packets;
             return 3;
         }
         else // unknown
         {
-            std::cout << "unknown packet type" << std::endl;
+            if constexpr (primary) ++n_unknown_packets;
             return 3;
         }
     };
 
-    inline void process_tdc(event *packet)
+    template <bool primary>
+    inline void process_tdc(state_after_buffer &s, const event *packet)
     {
         if (((*packet >> 56) & 0x0F) == 15) // TDC1 rise
         {
-            rise_fall[chip_id] = true;
-            rise_t[chip_id] = ((*packet >> 9) & 0x7FFFFFFFF) + tdc_offset;
-
-            if ((prev_tdc > rise_t[chip_id] + tdc_overflow_drop) && (this->current_line > 1) && (last_offset_line_tdc != this->current_line)) // tdc drop bigger than half of tdc range --> tdc must have overflowed
-            {
-            tdc_offset += 34359738368; 
-            last_offset_line_tdc = this->current_line;
-            std::cout << "tdc overflow at line " << this->current_line << std::endl;
-            }
-
-            prev_tdc = rise_t[chip_id];
+            s.rise_fall[s.chip_id] = true;
+            s.rise_t[s.chip_id] = advance_time<primary>(s, (*packet >> 9) & 0x7FFFFFFFF);
         }
         else if (((*packet >> 56) & 0x0F) == 10) // TDC1 fall
         {
-            rise_fall[chip_id] = false;
-            fall_t[chip_id] = ((*packet >> 9) & 0x7FFFFFFFF) + tdc_offset;
-
-            if ((prev_tdc > fall_t[chip_id] + tdc_overflow_drop) && (this->current_line > 1) && (last_offset_line_tdc != this->current_line)) // tdc drop bigger than half of tdc range --> tdc must have overflowed
-            {
-            tdc_offset += 34359738368; 
-            last_offset_line_tdc = this->current_line;
-            }
+            s.rise_fall[s.chip_id] = false;
+            s.fall_t[s.chip_id] = advance_time<primary>(s, (*packet >> 9) & 0x7FFFFFFFF);
 
-            prev_tdc = fall_t[chip_id];
+            ++s.line_count[s.chip_id];
 
-            ++line_count[chip_id];
-
-            if ((line_count[chip_id] <= line_count[0]) & (line_count[chip_id] <= line_count[1]) & (line_count[chip_id] <= line_count[2]) & (line_count[chip_id] <= line_count[3]))
+            if ((s.line_count[s.chip_id] <= s.line_count[0]) & (s.line_count[s.chip_id] <= s.line_count[1]) & (s.line_count[s.chip_id] <= s.line_count[2]) & (s.line_count[s.chip_id] <= s.line_count[3]))
             { 
-                this->current_line = line_count[chip_id];
+                s.current_line = s.line_count[s.chip_id];
             }
-            else if (line_count[chip_id] >= most_advanced_line)
+            else if (s.line_count[s.chip_id] >= s.most_advanced_line)
             {
-                most_advanced_line = line_count[chip_id];
-                if (most_advanced_line%this->ny == 0)
+                s.most_advanced_line = s.line_count[s.chip_id];
+                if (s.most_advanced_line%this->ny == 0)
                 {
-                    this->id_image = most_advanced_line / this->ny ;
-                    this->flush_image(this->id_image);
+                    s.id_image = s.most_advanced_line / this->ny ;
+                    if constexpr (primary) this->flush_image(s.id_image);
                 }
             }
 
-            line_interval = (fall_t[chip_id] - rise_t[chip_id]) * 2; //factor 2 for difference in time unit of tdc and toa
-            // std::cout << "line interval: " << line_interval << std::endl;
-            dt = line_interval / this->nx; //unit 1.5625 ns
-            // std::cout << dt << std::endl;
+            s.dt = ((s.fall_t[s.chip_id] - s.rise_t[s.chip_id]) * 2) / this->nx; //factor 2 for difference in time unit of tdc and toa, unit 1.5625 ns
         }
-        if (this->current_line == this->ny * this->repetitions) this->repetitions_reached = true;
+        if (s.current_line >= stop_line) s.repetitions_reached = true;
     };
 
-    void skip_to_buffer(int buffer_id)
-    {
-        this->n_buffer_processed = buffer_id;
-        int min_line = std::min({state_after_buffer_list[buffer_id].line_count[0], state_after_buffer_list[buffer_id].line_count[1], state_after_buffer_list[buffer_id].line_count[2], state_after_buffer_list[buffer_id].line_count[3]});
-        this->current_line = min_line;
-        toa_offset = state_after_buffer_list[buffer_id].toa_offset;
-        tdc_offset = state_after_buffer_list[buffer_id].tdc_offset;
-        line_count[0] = state_after_buffer_list[buffer_id].line_count[0];
-        line_count[1] = state_after_buffer_list[buffer_id].line_count[1];
-        line_count[2] = state_after_buffer_list[buffer_id].line_count[2];
-        line_count[3] = state_after_buffer_list[buffer_id].line_count[3];
-    }
-    
     void reset()
     {
         TIMEPIX<event, buffer_size, n_buffer>::reset();
-        for (int i = 0; i < 4; i++)
-        {
-            rise_fall[i] = false;
-            line_count[i] = 0;
-        }
-        most_advanced_line = 0;
+        state = state_after_buffer();
+        state.dt = dt;
+        n_global_time_packets = 0;
+        n_unknown_packets = 0;
+        n_toa_rollovers = 0;
+        n_tdc_rollovers = 0;
         this->id_image = 0;
+        stop_line = (uint64_t)(this->ny * this->repetitions);
+        if (end_line > 0) stop_line = std::min(stop_line, (uint64_t)end_line);
+        index_path.clear();
+        start_offset = 0;
     };
 
 public:
+    // decodes buffers on n_threads threads from per-buffer checkpoints of the decoder state
+    void enable_parallel_decoding(int n_threads)
+    {
+        if (n_threads <= 1) return;
+        n_decode_threads = n_threads;
+        decode_batch = std::min(8 * n_decode_threads, n_buffer / 4);
+        checkpoints.resize(decode_batch);
+        decoded.assign(decode_batch, EventBatch(buffer_size));
+        decode_pool.init(n_decode_threads, decode_batch);
+    }
+
+    // Keeps a sidecar index of the file (<file>.idx, see Tpx3Index.hpp), or of the recording in
+    // socket mode, and only decodes the lines [_first_line, _end_line) (-1: to the end of the scan).
+    // Without an index yet the run starts at the beginning of the file and builds it. The line or
+    // two decoded before _first_line (from the index entry on) can be incomplete.
+    void enable_index(bool _index, int _first_line = 0, int _end_line = -1)
+    {
+        b_index = _index;
+        first_line = std::max(_first_line, 0);
+        end_line = _end_line;
+    }
+
     void run()
     {
         reset();
@@ -428,26 +449,46 @@ public:
             {
                 this->file.path = this->file_path;
                 this->file.open_file();
+                if (b_index) open_index();
                 this->read_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::read_file, this);
                 break;
             }
             case 1:
             {
                 //socket connection handled through seperate funtions in python binding
+                if (b_index && (!this->socket.record_path.empty()) && (this->socket.record_compression == 0))
+                {
+                    index_path = Tpx3Index::path_for(this->socket.record_path);
+                    index.clear(index_layout());
+                }
                 this->read_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::read_socket, this);
                 break;
             }
         }
-        this->proc_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::schedule_buffer, this);
-        this->check_overflow_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::continous_check_toa_overflow, this);
+        if (n_decode_threads > 1)
+        {
+            this->init_shards(n_decode_threads);
+            this->proc_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::schedule_buffer_parallel, this);
+        }
+        else
+        {
+            this->proc_thread = std::thread(&CHEETAH<event, buffer_size, n_buffer>::schedule_buffer, this);
+        }
         this->starttime  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
     };
 
     void terminate()
     {
         TIMEPIX<event, buffer_size, n_buffer>::terminate();
-        while ((!check_overflow_thread.joinable()) ) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
-        check_overflow_thread.join();
+        if ((!index_path.empty()) && index.b_changed) index.save(index_path);
+        if (n_global_time_packets + n_unknown_packets > 0)
+        {
+            std::cout << n_global_time_packets << " global time packets, " << n_unknown_packets << " unknown packets skipped" << std::endl;
+        }
+        if (n_toa_rollovers > 0)
+        {
+            std::cout << n_toa_rollovers << " ToA rollovers (" << n_tdc_rollovers << " of them TDC rollovers) in the scan" << std::endl;
+        }
     };
 
     CHEETAH(
@@ -33,17 +33,22 @@
 
 #include "FileConnector.h"
 #include "Timepix.hpp"
+#include "ScanPattern.h"
 
 template <typename event, int buffer_size, int n_buffer>
 class CHEETAH_pixeltrig : public TIMEPIX<event, buffer_size, n_buffer>
 {
 private:
+    using FunctionType = typename TIMEPIX<event, buffer_size, n_buffer>::FunctionType;
+
     // header
     int chip_id;
     uint64_t tpx_header = 861425748; //(b'TPX3', 'little')
 
+    // one trigger per probe position, in the order of the scan pattern
     std::string &pattern_file;
-    std::vector<uint64_t> pattern;
+    ScanPattern own_pattern;  // read from pattern_file
+    const ScanPattern *p_pattern = nullptr;
     uint64_t probe_count;
 
     // TDC
@@ -77,63 +82,17 @@ private:
     uint64_t tdc_overflow_drop = 17179869184; //half of 34359738368 = tdc range
     int last_offset_line_tdc = 0;
 
-    void parse_event(event *packet)
+    template <FunctionType F>
+    inline void parse_event(event *packet)
     {
         toa = ((((*packet & 0xFFFF) << 14) + ((*packet >> 30) & 0x3FFF)) << 4) + toa_offset;
-        if (this->probe_count_chip[chip_id]%this->nxy < pattern.size()-1)
+        uint32_t _probe_position = p_pattern->position(this->probe_count_chip[chip_id]);
+        if (_probe_position != ScanPattern::skip)
         {
             pack_44 = (*packet >> 44);
-            uint64_t _probe_position = pattern[this->probe_count_chip[chip_id]%this->nxy];
             uint16_t _kx = (address_multiplier[chip_id] * (((pack_44 & 0x0FE00) >> 8) + ((pack_44 & 0x00007) >> 2)) + address_bias_x[chip_id]);
             uint16_t _ky = (address_multiplier[chip_id] * (((pack_44 & 0x001F8) >> 1) + (pack_44 & 0x00003)) + address_bias_y[chip_id]);
-            ++this->n_events_processed;
-
-            switch(this->functionType){
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                    this->vstem(_probe_position,_kx,_ky, this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                    this->multi_vstem(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                    this->com(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                    this->count_chunked_8(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                    this->count_chunked_16(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                    this->count_chunked_32(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                    this->pacbed(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                    this->var(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                    this->roi(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                    this->roi_4D(_probe_position,_kx,_ky,this->id_image);
-                    break;  
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                    this->write_electron(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_declusterer_buffer:
-                    this->write_declusterer_buffer(_probe_position,_kx,_ky,this->id_image,toa,0);
-                    break;
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                    this->information(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #ifdef GPRI_OPTION_ENABLED
-                case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                    this->GPRI(_probe_position,_kx,_ky,this->id_image);
-                    break;
-                #endif
-            }
+            this->template accumulate<F>(_probe_position,_kx,_ky,this->id_image,toa,0);
             ++this->n_events_processed;
         }
     };
@@ -152,42 +111,46 @@ private:
     inline void schedule_buffer()
     {
         int buffer_id;
+        this->trace_thread("proc_thread");
 
-        while ((*this->p_processor_line)!=-1)
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            if (this->n_buffer_processed < this->n_buffer_filled)
+            buffer_id = this->ring.processed() % this->n_buf;
+
             {
-                buffer_id = this->n_buffer_processed % this->n_buf;
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+                int64_t t0 = this->trace_time();
+                process_buffer(this->slot(buffer_id)); // decodes and accumulates in one pass
+                this->trace_span("accumulate", this->ring.processed(), t0);
+            }
 
-                process_buffer(&(this->buffer[buffer_id]));
+            if (this->decluster) this->declusterer.set_buffer_read();
 
-                if (this->decluster) this->declusterer.set_buffer_read();
- 
-                ++this->n_buffer_processed;
-                *this->p_preprocessor_line = (int)this->current_line;
+            this->ring.pop();
+            this->publish_line((int)this->current_line);
 
-                check_toa_overflow();
-            }
-            else
-            {
-                this->process_wait++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            }
+            check_toa_overflow();
         }
     };
 
-    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    template <FunctionType F>
+    inline void process_buffer_as(std::array<event, buffer_size> *p_buffer)
     {
         for (int j = 0; j < buffer_size; j++)
         {
             type = which_type(&(*p_buffer)[j]);
             if ((type == 2) & rise_fall[chip_id]) //currently always lose first line because no dwelltime known yet
             {
-                parse_event(&(*p_buffer)[j]);
+                parse_event<F>(&(*p_buffer)[j]);
             }
         }
     };
 
+    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    {
+        this->with_policy([&](auto policy){ process_buffer_as<decltype(policy)::value>(p_buffer); });
+    };
+
     inline int which_type(event *packet)
     {
         if ((*packet & 0xFFFFFFFF) == tpx_header)
@@ -245,16 +208,16 @@ private:
             if ((probe_count_chip[chip_id] <= probe_count_chip[0]) & (probe_count_chip[chip_id] <= probe_count_chip[1]) & (probe_count_chip[chip_id] <= probe_count_chip[2]) & (probe_count_chip[chip_id] <= probe_count_chip[3]))
             { 
                 this->probe_count = probe_count_chip[chip_id];
-                this->current_line = this->probe_count/this->nx;
+                this->current_line = p_pattern->lines_complete(this->probe_count);
             }
             else if (probe_count_chip[chip_id] >= most_advanced_probe_count)
             {
                 most_advanced_probe_count = probe_count_chip[chip_id];
                 most_advanced_line = most_advanced_probe_count/this->nx;
                 
-                if (most_advanced_probe_count%this->nxy == 0)
+                if (most_advanced_probe_count%p_pattern->size() == 0)
                 {
-                    this->id_image = most_advanced_line / this->ny;
+                    this->id_image = most_advanced_probe_count / p_pattern->size();
                     this->flush_image(this->id_image);
                 }
             }
@@ -277,21 +240,27 @@ private:
 
     void read_patten_file()
     {
-        std::ifstream file(pattern_file);
-        if (file.is_open())
+        if (pattern_file.empty() || !own_pattern.load(pattern_file, this->nx, this->ny))
         {
-            double element;
-            while (file >> element)
-            {
-                pattern.push_back(element);
-            }
-            file.close();
-            std::cout << "Pattern file read: " << pattern.size() << " positions" << std::endl;
+            std::cout << "No scan pattern, assuming a raster scan" << std::endl;
+            own_pattern = ScanPattern::raster(this->nx, this->ny);
         }
-        else std::cout << "Unable to open pattern file" << std::endl;   
+        p_pattern = &own_pattern;
     };
 
 public:
+    // takes the place of the pattern file, any pattern of the nx * ny scan
+    void enable_scan_pattern(const ScanPattern *_p_scan_pattern)
+    {
+        if ((!_p_scan_pattern) || _p_scan_pattern->empty()) return;
+        if ((_p_scan_pattern->nx != this->nx) || (_p_scan_pattern->ny != this->ny))
+        {
+            std::cout << "The scan pattern is not a " << this->nx << "x" << this->ny << " scan, ignored" << std::endl;
+            return;
+        }
+        p_pattern = _p_scan_pattern;
+    }
+
     void run()
     {
         reset();
@@ -37,6 +37,13 @@
 #include "SocketConnector.h"
 #include "FileConnector.h"
 #include "BoundedThreadPool.hpp"
+#include "SpscRing.hpp"
+#include "LineNotifier.hpp"
+#include "PipelineMetrics.hpp"
+#include "Tracer.h"
+#include "BufferArena.h"
+#include "FrameKernels.hpp"
+#include "ScanPattern.h"
 
 #if defined(GPRI_OPTION_ENABLED) || defined(FRAMEBASED_TORCH_ENABLED)
     #include <torch/torch.h>
@@ -100,10 +107,7 @@ protected:
 
     void pacbed()
     {
-        for (int k = 0; k < n_cam*n_cam; k++)
-        {
-            (*p_pacbed_data)[k] += (size_t)frame_buffer[buffer_id][frame_id][k];
-        };
+        FRAME_KERNELS::accumulate<pixel>(frame_buffer[buffer_id][frame_id].data(), n_cam*n_cam, p_pacbed_data->data());
     };
 
     void com()
@@ -114,19 +118,12 @@ protected:
         COM[0] = 0;
         COM[1] = 0;
 
+        FRAME_KERNELS::row_col_sums<pixel>(frame_buffer[buffer_id][frame_id].data(), n_cam, sum_x.data(), sum_y.data());
         for (int idy = 0; idy < n_cam; idy++)
         {
-            sum_x_temp = 0;
-            for (int idx = 0; idx < n_cam; idx++)
-            {
-                current_px = (size_t)frame_buffer[buffer_id][frame_id][idy * n_cam + idx];
-                sum_x_temp += current_px;
-                sum_y[idx] += current_px;
-            }
-            sum_x[idy] = sum_x_temp;
-            dose += sum_x_temp;
+            dose += sum_x[idy];
         }
-    
+
 
         if (dose > 0)
         {
@@ -221,8 +218,7 @@ protected:
     int buffer_id;
     int n_frame_filled=0;
     int n_frame_processed=0;
-    int n_buffer_filled=0;
-    int n_buffer_processed=0;
+    SpscRing ring = SpscRing(n_buffer); // reader -> processor hand-over of complete buffers
     uint8_t id_image = 0 ;
     uint64_t current_line = 0;
     uint64_t probe_position = 0;
@@ -231,39 +227,86 @@ protected:
     bool first_frame = true;
     int frame_id;
 
+    inline bool stopped()
+    {
+        return (*this->p_processor_line) == -1;
+    };
+
+    inline void publish_line(int line)
+    {
+        if (p_line_notifier) p_line_notifier->publish(line);
+        if (p_tracer) p_tracer->line_published(line);
+    };
+
+    // reader side: a new buffer may only be started once the processor has handed it back
+    inline bool wait_for_frame_slot()
+    {
+        if (stopped()) return false;
+        return (this->n_frame_filled % buffer_size != 0) || ring.wait_for_space([this]{ return stopped(); });
+    };
+
     inline void schedule_buffer()
     {
-        while ((*this->p_processor_line)!=-1)
+        if (p_tracer) p_tracer->name_thread("proc_thread");
+        while (ring.wait_for_data([this]{ return stopped(); }))
         {
-            if (this->n_buffer_processed < this->n_buffer_filled)
+            PipelineMetrics::StageTimer timer(p_metrics, PipelineMetrics::DECODE);
+            int64_t t_process = (p_tracer) ? p_tracer->now() : 0;
+            this->buffer_id = ring.processed() % n_buffer;
+            for (int frm = 0; frm < buffer_size; frm++)
             {
-                this->buffer_id = this->n_buffer_processed % n_buffer;
-                for (int frm = 0; frm < buffer_size; frm++)
+                this->frame_id = this->n_frame_processed % buffer_size;
+                if (p_scan_pattern)
                 {
-                    this->frame_id = this->n_frame_processed % buffer_size;
-                    if ((this->n_frame_processed%nx) != (nx-1)){this->process[0]();}
-                    // if ((this->n_frame_processed%nx) != (nx-1)){
-                    //     for (int i = 0; i < n_proc; i++) {this->process[i]();}
-                    // }
-
+                    // one frame per trigger of the pattern
+                    this->probe_position = p_scan_pattern->position(this->n_frame_processed);
+                    if (this->probe_position != ScanPattern::skip) {this->process[0]();}
                     ++this->n_frame_processed;
-                    this->probe_position = this->n_frame_processed;
-                    this->current_line = this->n_frame_processed / ny ;
-                    *this->p_preprocessor_line = (int)this->current_line-1;
-                    if ((int)this->current_line == ny){*this->p_preprocessor_line = ny;}
-
+                    publish_line((int)std::min<uint64_t>(p_scan_pattern->lines_complete(this->n_frame_processed), (uint64_t)ny));
+                    continue;
                 }
+                if ((this->n_frame_processed%nx) != (nx-1)){this->process[0]();}
+                // if ((this->n_frame_processed%nx) != (nx-1)){
+                //     for (int i = 0; i < n_proc; i++) {this->process[i]();}
+                // }
+
+                ++this->n_frame_processed;
+                this->probe_position = this->n_frame_processed;
+                this->current_line = this->n_frame_processed / ny ;
+                if ((int)this->current_line == ny){publish_line(ny);}
+                else {publish_line((int)this->current_line-1);}
 
-                ++this->n_buffer_processed;
-            }
-            else
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                this->process_wait++;
             }
+
+            if (p_metrics) p_metrics->add(p_metrics->frames_processed, buffer_size);
+            if (p_tracer) p_tracer->complete("accumulate", ring.processed(), t_process);
+            ring.pop();
         }
     };
 
+    // reader side: bytes of a frame or a mapped buffer taken from the file or socket
+    inline void count_read(uint64_t n_bytes)
+    {
+        if (p_metrics) p_metrics->add(p_metrics->bytes_read, n_bytes);
+    };
+
+    // reader side: the first frame of a buffer is read next
+    inline void start_buffer()
+    {
+        if (p_tracer)
+        {
+            if (n_frame_filled == 0) p_tracer->name_thread("read_thread");
+            t_buffer_start = p_tracer->now();
+        }
+    };
+
+    // reader side: hands the filled buffer to the processor
+    inline void push_buffer()
+    {
+        if (p_tracer) p_tracer->complete("read", ring.filled(), t_buffer_start);
+        ring.push();
+    };
+
     
     inline void init_uv()
     {
@@ -281,6 +324,7 @@ protected:
     {
         n_frame_filled = 0;
         n_frame_processed = 0;
+        ring.reset();
         current_line = 0;
     };
 
@@ -450,6 +494,50 @@ public:
     {
     }
 
+    void enable_busy_poll(bool _busy_poll)
+    {
+        ring.set_busy_poll(_busy_poll);
+    }
+
+    void enable_line_notification(LineNotifier *_p_line_notifier)
+    {
+        p_line_notifier = _p_line_notifier;
+    }
+
+    // frames in the order of the pattern instead of raster order, any pattern of the nx * ny scan
+    void enable_scan_pattern(const ScanPattern *_p_scan_pattern)
+    {
+        if ((!_p_scan_pattern) || _p_scan_pattern->empty()) return;
+        if ((_p_scan_pattern->nx != nx) || (_p_scan_pattern->ny != ny))
+        {
+            std::cout << "The scan pattern is not a " << nx << "x" << ny << " scan, ignored" << std::endl;
+            return;
+        }
+        p_scan_pattern = _p_scan_pattern;
+    }
+
+    // count bytes, frames and busy time of the stages into metrics (restarted here)
+    void enable_metrics(PipelineMetrics *_p_metrics)
+    {
+        p_metrics = _p_metrics;
+        if (p_metrics) p_metrics->reset();
+        ring.set_counters(p_metrics ? &p_metrics->ring : nullptr);
+    }
+
+    // record a timeline of the buffers and lines, written when the detector terminates
+    void enable_tracing(Tracer *_p_tracer)
+    {
+        p_tracer = (_p_tracer && _p_tracer->enabled()) ? _p_tracer : nullptr;
+        if (p_tracer) p_tracer->start();
+    }
+
+    // stream the file through the asynchronous read-ahead instead of mapping it
+    void enable_read_ahead(bool _read_ahead, bool _direct_io = false)
+    {
+        file.read_ahead = _read_ahead;
+        file.direct_io = _direct_io;
+    }
+
 //-------------------------------------------------------------------------------------------------
 
     void terminate()
@@ -457,11 +545,16 @@ public:
         while ((!read_thread.joinable()) || (!proc_thread.joinable())) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
         read_thread.join();
         proc_thread.join();
+        file.close_file();
+        if (p_tracer) p_tracer->finish();
+        read_wait = ring.producer_waits;
+        process_wait = ring.consumer_waits;
         this->endtime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
         uint64_t rate = nxy / ((endtime - starttime) / 1e9);
         uint64_t frametime = ((endtime - starttime) / 1e3) / nxy;
         std::cout << "Processed at " << rate << " fps (" << frametime << " microsec per frame)" << std::endl; 
         std::cout << "read waits: " << read_wait << " process waits: " << process_wait << std::endl;
+        frames.release(); // back to the arena for the next run
     };
 
 //-------------------------------------------------------------------------------------------------
@@ -497,8 +590,6 @@ public:
     std::vector<size_t> sum_y;
     float dose;
     float COM[2];
-    size_t sum_x_temp = 0;
-    size_t current_px;
 
     // ROI
     std::vector<std::vector<std::vector<std::vector<uint8_t>>>> *p_roi_4D;
@@ -571,7 +662,12 @@ public:
     //-----------------------------------------------------------------------------------------------------------------------
 
     int *p_processor_line;
-    int *p_preprocessor_line;
+    int *p_preprocessor_line; // not written, the decoded line is published through p_line_notifier
+    LineNotifier *p_line_notifier = nullptr;
+    const ScanPattern *p_scan_pattern = nullptr;
+    PipelineMetrics *p_metrics = nullptr;
+    Tracer *p_tracer = nullptr;
+    int64_t t_buffer_start = 0;
     int mode;
     std::string file_path;
     SocketConnector socket;
@@ -590,7 +686,9 @@ public:
 
     typedef std::array<pixel,n_cam*n_cam> frame;
 
-    std::array<frame*, n_buffer> frame_buffer;
+    std::array<frame*, n_buffer> frame_buffer;  // frames of each ring slot, may point into a mapped file
+    std::array<frame*, n_buffer> frame_storage; // own frames of each ring slot
+    ArenaBuffer<frame> frames = ArenaBuffer<frame>(n_buffer * buffer_size); // backs frame_storage, reused across runs
 
     uint64_t starttime;
     uint64_t endtime;
@@ -622,7 +720,7 @@ public:
         nxy = nx*ny;
         n_proc = 0;
         n_images = 0;
-        for (size_t i = 0; i < n_buffer; ++i) {frame_buffer[i] = new frame[buffer_size];}
+        for (size_t i = 0; i < n_buffer; ++i) {frame_storage[i] = frames.data() + i * buffer_size; frame_buffer[i] = frame_storage[i];}
     }
 
 };
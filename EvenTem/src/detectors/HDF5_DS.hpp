@@ -61,26 +61,19 @@ protected:
     {
         int _buffer_id;
         int _frame_id;
-        while (*this->p_processor_line!=-1)
+        while (this->wait_for_frame_slot())
         {
-            if ((this->n_frame_filled < (buffer_size*n_buffer + this->n_frame_processed))) 
+            _frame_id = this->n_frame_filled % buffer_size; 
+            _buffer_id = this->ring.filled() % n_buffer;
+            if (_frame_id == 0) this->start_buffer();
             {
-                _frame_id = this->n_frame_filled % buffer_size; 
-                _buffer_id = (this->n_frame_filled/buffer_size)%n_buffer;
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::READ);
                 read_frame(this->frame_buffer[_buffer_id][_frame_id]);
+            }
 
-                ++this->n_frame_filled;
+            ++this->n_frame_filled;
 
-                if ((this->n_frame_filled%buffer_size == 0) && (this->n_buffer_filled < (n_buffer + this->n_buffer_processed))) 
-                {
-                    ++this->n_buffer_filled;
-                }
-            }
-            else
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                this->read_wait++;
-            }
+            if (this->n_frame_filled%buffer_size == 0) this->push_buffer();
         }
         // this->file.close_file();
     };
@@ -98,6 +91,7 @@ protected:
             dataspace.selectHyperslab(H5S_SELECT_SET, count, offset);
             H5::DataSpace memspace(4, count);
             dataset.read(data.data(), H5::PredType::NATIVE_UINT8, memspace, dataspace);
+            this->count_read(data_size);
             frame_index++;
         }
     };
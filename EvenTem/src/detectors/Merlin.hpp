@@ -64,38 +64,30 @@ protected:
     {
         int _buffer_id;
         int _frame_id;
-        while (*this->p_processor_line!=-1)
+        while (this->wait_for_frame_slot())
         {
-            if ((this->n_frame_filled < (buffer_size*n_buffer + this->n_frame_processed))) 
+            _frame_id = this->n_frame_filled % buffer_size; 
+            _buffer_id = this->ring.filled() % n_buffer;
+            if (_frame_id == 0) this->start_buffer();
             {
-                _frame_id = this->n_frame_filled % buffer_size; 
-                _buffer_id = (this->n_frame_filled/buffer_size)%n_buffer;
+                // socket reads wait for the network, only the file reads are busy time
+                PipelineMetrics::StageTimer timer((this->mode == 0) ? this->p_metrics : nullptr, PipelineMetrics::READ);
                 read_frame(this->frame_buffer[_buffer_id][_frame_id], !this->first_frame);
+            }
 
-                this->first_frame = false;
-                ++this->n_frame_filled;
+            this->first_frame = false;
+            ++this->n_frame_filled;
 
+            if (this->n_frame_filled%buffer_size == 0)
+            {
                 #ifdef GPRI_OPTION_ENABLED
-                if ((this->n_frame_filled%buffer_size == 0) && (this->n_buffer_filled < (n_buffer + this->n_buffer_processed))) 
-                {
-                    if (this->GPRI_enabled) this->Binned_Tensor_buffer[_buffer_id] = ((torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device)).view({buffer_size,n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin, n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin}).sum({2, 4}, /*keepdim=*/false)).to(this->Tensortype);
-                }
+                if (this->GPRI_enabled) this->Binned_Tensor_buffer[_buffer_id] = ((torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device)).view({buffer_size,n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin, n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin}).sum({2, 4}, /*keepdim=*/false)).to(this->Tensortype);
                 #endif
                 #ifdef FRAMEBASED_TORCH_ENABLED
-                if ((this->n_frame_filled%buffer_size == 0) && (this->n_buffer_filled < (n_buffer + this->n_buffer_processed))) 
-                {
-                    if (this->frame_torch_enabled) this->Tensor_buffer[_buffer_id] = torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device);
-                }
+                if (this->frame_torch_enabled) this->Tensor_buffer[_buffer_id] = torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device);
                 #endif
-                if ((this->n_frame_filled%buffer_size == 0) && (this->n_buffer_filled < (n_buffer + this->n_buffer_processed))) ++this->n_buffer_filled;
-
+                this->push_buffer();
             }
-            else
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                this->read_wait++;
-            }
-
         }
         this->file.close_file();
     };
@@ -120,7 +112,7 @@ protected:
             return -1;
         }
         int l = decode_tcp_head();
-        acq_header.resize(l);
+        acq_header.assign(l + 1, 0); // null terminated for strtok
         char *buffer = reinterpret_cast<char *>(&acq_header[0]);
         this->socket.read_data(buffer, l);
         char *p = strtok(buffer, " ");
@@ -170,16 +162,7 @@ protected:
     template <typename T>
     inline void convert_binary_to_chars(std::array<T,n_cam*n_cam> &data)
     {
-        size_t T_size = static_cast<size_t>(sizeof(T) * 8);
-        size_t i_dat = static_cast<size_t>(data.size() / T_size);
-        for (size_t i = i_dat - 1; i > 0; i--)
-        {
-            size_t idx = i * T_size;
-            for (size_t j = 0; j < T_size; j++)
-            {
-                data[idx + j] = static_cast<T>((data[i] >> j) & 1);
-            }
-        }
+        FRAME_KERNELS::unpack_bits<T>(data.data(), data.size());
     }
 
     inline bool read_head(bool decode)
@@ -282,6 +265,7 @@ protected:
                 break;
             }
         }
+        this->count_read(data_size);
 
         if (b_binary)
         {
@@ -337,6 +321,7 @@ protected:
     {
         if (this->mode == 1)
         {
+            this->socket.record_format = RECORD_MIB; // a recording is a .mib file, not the TCP stream
             if (read_aquisition_header() == -1)
             {
                 perror("MerlinInterface::pre_run() could not obtain aquisition_header");
@@ -107,30 +107,39 @@ protected:
     {
         int _buffer_id;
         int _frame_id;
-        while (*this->p_processor_line!=-1)
+        while (this->wait_for_frame_slot())
         {
-            if ((this->n_frame_filled < (buffer_size*n_buffer + this->n_frame_processed))) 
+            _frame_id = this->n_frame_filled % buffer_size; 
+            _buffer_id = this->ring.filled() % n_buffer;
+            PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::READ);
+            if (_frame_id == 0)
             {
-                _frame_id = this->n_frame_filled % buffer_size; 
-                _buffer_id = (this->n_frame_filled/buffer_size)%n_buffer;
-                read_frame(this->frame_buffer[_buffer_id][_frame_id]);
+                this->start_buffer();
+                this->frame_buffer[_buffer_id] = this->frame_storage[_buffer_id];
+                if (b_zero_copy && map_buffer(_buffer_id)) continue;
+            }
+            read_frame(this->frame_buffer[_buffer_id][_frame_id]);
 
-                ++this->n_frame_filled;
+            ++this->n_frame_filled;
 
-                if ((this->n_frame_filled%buffer_size == 0) && (this->n_buffer_filled < (n_buffer + this->n_buffer_processed))) 
-                {
-                    // if (this->GPRI_enabled || this->frame_torch_enabled) this->Binned_Tensor_buffer[_buffer_id] = ((torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device)).view({buffer_size,n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin, n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin}).sum({2, 4}, /*keepdim=*/false)).to(this->Tensortype);
-                    ++this->n_buffer_filled;
-                }
-            }
-            else
+            if (this->n_frame_filled%buffer_size == 0)
             {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                this->read_wait++;
+                // if (this->GPRI_enabled || this->frame_torch_enabled) this->Binned_Tensor_buffer[_buffer_id] = ((torch::from_blob(this->frame_buffer[_buffer_id], {buffer_size,n_cam, n_cam}, torch::TensorOptions().dtype(torch::kUInt8)).to(this->device)).view({buffer_size,n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin, n_cam/this->GPRI_detector_bin, this->GPRI_detector_bin}).sum({2, 4}, /*keepdim=*/false)).to(this->Tensortype);
+                this->push_buffer();
             }
-
         }
-        this->file.close_file();
+    };
+
+    // points the slot at buffer_size frames of the mapped file, the frames are stored back to back
+    inline bool map_buffer(int _buffer_id)
+    {
+        const char *p = this->file.map_data(buffer_size * sizeof(typename FRAMEBASED<n_cam,buffer_size,HEAD_SIZE,n_buffer,pixel>::frame));
+        if (!p) return false;
+        this->frame_buffer[_buffer_id] = (typename FRAMEBASED<n_cam,buffer_size,HEAD_SIZE,n_buffer,pixel>::frame *)p;
+        this->n_frame_filled += buffer_size;
+        this->count_read(buffer_size * sizeof(typename FRAMEBASED<n_cam,buffer_size,HEAD_SIZE,n_buffer,pixel>::frame));
+        this->push_buffer();
+        return true;
     };
 
     
@@ -144,6 +153,7 @@ protected:
         int data_size = static_cast<int>(this->framesize * sizeof(pixel));
         char *buffer = reinterpret_cast<char *>(&data[0]);
         read_data_file(buffer, data_size);
+        this->count_read(data_size);
     };
 
     int pre_run()
@@ -155,6 +165,8 @@ protected:
         std::cout << "shape: scan: " << this->shape[0] << "x" << this->shape[1] << ", detector: " << this->shape[2] << "x" << this->shape[3] << std::endl;
 
         this->framesize = this->shape[2] * this->shape[3];
+        b_zero_copy = this->file.is_mapped() && (this->framesize == n_cam*n_cam) && (this->data_offset % alignof(pixel) == 0)
+                      && (((this->dtype == "|u1") ? 1 : 2) == sizeof(pixel));
 
         if (this->dtype == "|u1") {
             std::cout << "dtype: uint8" << std::endl;
@@ -199,6 +211,7 @@ public:
     std::vector<int> shape;
     size_t data_offset;
     uint64_t framesize;
+    bool b_zero_copy = false; // frames are used straight from the mapped file
 
     NUMPY(
         int &nx,
@@ -30,10 +30,13 @@
 #include <array>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <filesystem>
 
 #include "FileConnector.h"
 #include "Timepix.hpp"
 #include "BoundedThreadPool.hpp"
+#include "BufferArena.h"
 
 namespace SIMULATED_ADDITIONAL
 {
@@ -41,8 +44,10 @@ namespace SIMULATED_ADDITIONAL
     // const size_t N_BUFFER = 512;
     // const size_t BUFFER_SIZE = 204800; //match L3 ans L2 cache
     // const size_t N_BUFFER = 64;
-    const size_t BUFFER_SIZE = 115200;
-    const size_t N_BUFFER = 8;
+    // const size_t BUFFER_SIZE = 115200;
+    // const size_t N_BUFFER = 8;
+    const size_t BUFFER_SIZE = 28800; // the parallel decoding has up to N_BUFFER ranges in flight
+    const size_t N_BUFFER = 32;
     PACK(struct EVENT
     {
         uint16_t kx;
@@ -58,118 +63,203 @@ template <typename event, int buffer_size, int n_buffer>
 class SIMULATED : public TIMEPIX<event, buffer_size, n_buffer>
 { 
 private:
-    BoundedThreadPool *event_parsing_pool = new BoundedThreadPool;
+    EventBatch batch = EventBatch(buffer_size);
+
+    // Parallel decoding: the records have no state between them, so the file is cut into ranges
+    // of buffer_size records. The reader only hands out the ranges through the ring, the decode
+    // tasks read their range themselves, each through the file of its worker, and accumulate it
+    // into the shard of the worker. Runs with a process method without a sharded form are decoded
+    // on one thread.
+    int n_decode_threads = 1;
+    bool b_ranges = false;
+    BoundedThreadPool decode_pool;
+    TaskGroup decode_group;
+
+    struct Worker
+    {
+        FileConnector file;
+        ArenaBuffer<event> copy; // the records when the file is not mapped
+        EventBatch events = EventBatch(buffer_size);
+    };
+    std::vector<std::unique_ptr<Worker>> workers; // one per shard
+    uint64_t n_records = 0;
+    uint64_t next_record = 0;                     // first record of the next range
+    std::array<uint64_t, n_buffer> range_start;   // first record of the range of each ring slot
+    std::array<event, n_buffer> range_last;       // last record decoded
+    std::array<bool, n_buffer> range_reached;     // the range got past the last repetition
 
     inline void schedule_buffer()
     {
         int buffer_id;
+        this->trace_thread("proc_thread");
 
-        while ((*this->p_processor_line)!=-1)
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            if (this->n_buffer_processed < this->n_buffer_filled)
-            {
-                buffer_id = this->n_buffer_processed % this->n_buf;
+            buffer_id = this->ring.processed() % this->n_buf;
 
-                if (!this->repetitions_reached){ 
-                    process_buffer(&(this->buffer[buffer_id]));
-                    // event_parsing_pool->push_task([=]{process_buffer(&(this->buffer[buffer_id]));});
-                    // if (this->decluster) this->declusterer.set_buffer_read();
-                    ++this->n_buffer_processed;
-                }
-                *this->p_preprocessor_line = (int)this->current_line;
-            }
-            else
-            {
-                this->process_wait++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (!this->repetitions_reached){ 
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+                process_buffer(this->slot(buffer_id));
+                // if (this->decluster) this->declusterer.set_buffer_read();
             }
+            this->ring.pop();
+            this->publish_line((int)this->current_line);
         }
     };
 
-    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    inline void schedule_ranges()
     {
-        for (int j = 0; j < buffer_size; j++)
+        int n_batch;
+        this->trace_thread("proc_thread");
+
+        while (this->ring.wait_for_data([this]{ return this->stopped(); }))
         {
-            if (!this->repetitions_reached) 
+            n_batch = (int)this->ring.available();
+            if (!this->repetitions_reached)
             {
-                process_event(&(*p_buffer)[j]);
+                PipelineMetrics::StageTimer timer(this->p_metrics, PipelineMetrics::DECODE);
+                bool reached = false;
+                for (int k = 0; k < n_batch; k++)
+                {
+                    int buffer_id = (this->ring.processed() + k) % this->n_buf;
+                    int64_t seq = this->ring.processed() + k;
+                    decode_pool.push_task(decode_group, [this, buffer_id, seq]{ decode_range(buffer_id, seq); });
+                }
+                decode_group.wait();
+
+                int64_t t0 = this->trace_time();
+                for (auto &shard : this->shards) this->reduce_shard(shard);
+                this->trace_span("reduce", this->ring.processed(), t0);
+
+                for (int k = 0; k < n_batch; k++) reached |= range_reached[(this->ring.processed() + k) % this->n_buf];
+                if (reached) this->repetitions_reached = true;
+                update_position(range_last[(this->ring.processed() + n_batch - 1) % this->n_buf]);
             }
+            this->ring.pop(n_batch);
+            this->publish_line((int)this->current_line);
+        }
+    };
+
+    // reader side of the parallel decoding: the ring slots stand for ranges of the file
+    inline void read_ranges()
+    {
+        this->trace_thread("read_thread");
+        while ((!this->repetitions_reached) && (next_record < n_records) &&
+               this->ring.wait_for_space([this]{ return this->stopped() || this->repetitions_reached; }))
+        {
+            range_start[this->ring.filled() % n_buffer] = next_record;
+            next_record += buffer_size;
+            this->ring.push();
+        }
+    };
+
+    // decode task: reads, decodes and accumulates the range of ring slot buffer_id
+    inline void decode_range(int buffer_id, int64_t seq)
+    {
+        this->trace_thread("decode_pool");
+        int worker_id = this->acquire_shard();
+        Worker &w = *workers[worker_id];
+        size_t n = (size_t)std::min<uint64_t>(buffer_size, n_records - range_start[buffer_id]);
+
+        int64_t t0 = this->trace_time();
+        w.file.seek_to(range_start[buffer_id] * sizeof(event));
+        const event *p = (const event *)w.file.map_data(n * sizeof(event));
+        if (!p)
+        {
+            w.file.read_data((char *)w.copy.data(), n * sizeof(event));
+            p = w.copy.data();
+        }
+        if (this->p_metrics) this->p_metrics->add(this->p_metrics->bytes_read, n * sizeof(event));
+        t0 = this->trace_span("read", seq, t0);
+
+        bool reached = false;
+        decode_records(p, n, w.events, reached);
+        range_last[buffer_id] = p[n - 1];
+        range_reached[buffer_id] = reached;
+        this->remap_batch(w.events);
+        t0 = this->trace_span("decode", seq, t0);
+
+        this->accumulate_shard(this->shards[worker_id], w.events);
+        this->release_shard(worker_id);
+        this->trace_span("accumulate", seq, t0);
+    };
+
+    inline void open_workers()
+    {
+        n_records = std::filesystem::file_size(this->file_path) / sizeof(event);
+        next_record = 0;
+        workers.clear();
+        for (int i = 0; i < n_decode_threads; i++)
+        {
+            workers.push_back(std::make_unique<Worker>());
+            Worker &w = *workers.back();
+            w.file.path = this->file_path;
+            w.file.memory_mapped = this->file.memory_mapped;
+            w.file.read_ahead = false; // read_ahead streams a file from the start
+            w.file.open_file();
+            w.copy = ArenaBuffer<event>(buffer_size);
+        }
+    };
+
+    inline void decode_records(const event *p, size_t n, EventBatch &events, bool &reached)
+    {
+        events.clear();
+        for (size_t j = 0; j < n; j++)
+        {
+            if (reached) break;
+            decode_event(&p[j], events, reached);
         }
+        if (this->p_metrics) this->p_metrics->count_decoded(events.n, events.n);
+    };
 
+    inline void decode_buffer(std::array<event, buffer_size> *p_buffer, EventBatch &events)
+    {
+        decode_records(p_buffer->data(), buffer_size, events, this->repetitions_reached);
+    };
+
+    inline void process_buffer(std::array<event, buffer_size> *p_buffer)
+    {
+        int64_t t0 = this->trace_time();
+        decode_buffer(p_buffer, batch);
+        this->remap_batch(batch);
+        t0 = this->trace_span("decode", this->ring.processed(), t0);
+        this->accumulate_batch(batch);
+        this->trace_span("accumulate", this->ring.processed(), t0);
+        update_position((*p_buffer).back());
+    }
+
+    // scan position after the last record decoded
+    inline void update_position(const event &last)
+    {
         if (!this->repetitions_reached) { 
-            this->current_line = (*p_buffer).back().ry + this->ny * (*p_buffer).back().id_image;
-            this->probe_position_total = (*p_buffer).back().ry * this->nx + (*p_buffer).back().rx;
-            this->id_image = (*p_buffer).back().id_image;
+            this->current_line = last.ry + this->ny * last.id_image;
+            this->probe_position_total = last.ry * this->nx + last.rx;
+            this->id_image = last.id_image;
         }
         else {
             this->current_line =  this->ny * this->repetitions;
             this->probe_position_total = this->nxy*this->repetitions+1;
             this->id_image = this->repetitions;
         }
-
-    }
+    };
     
-    inline void process_event(event *packet)
+    inline void decode_event(const event *packet, EventBatch &events, bool &reached)
     {
         if (packet->id_image >= this->repetitions) {
-            this->repetitions_reached = true; 
+            reached = true; 
             return;
         }
-        // this->process[0]((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image); //way slower
-        // (this->*this->ProcessFun)((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image); //quite slower
-        switch(this->functionType){
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::vstem:
-                this->vstem((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::atomic_vstem:
-                this->atomic_vstem((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::multi_vstem:
-                this->multi_vstem((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::mask_vstem:
-                this->mask_vstem((uint64_t)(packet->ry * this->ny + packet->rx),packet->kx,packet->ky,this->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::com:
-                this->com((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_8: 
-                this->count_chunked_8((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_16:
-                this->count_chunked_16((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::count_chunked_32:
-                this->count_chunked_32((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::pacbed:
-                this->pacbed((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::var:
-                this->var((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi:
-                this->roi((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::roi_4D:
-                this->roi_4D((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;  
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::write_electron:
-                this->write_electron((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::information:
-                this->information((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            #ifdef GPRI_OPTION_ENABLED
-            case TIMEPIX<event, buffer_size, n_buffer>::FunctionType::GPRI:
-                this->GPRI((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image);
-                break;
-            #endif
-        }
-        ++this->n_events_processed;
+        events.push_back((uint64_t)(packet->ry * this->ny + packet->rx), packet->kx, packet->ky, packet->id_image, 0, 0);
     };
     
 public:
+    // decodes ranges of the file on n_threads threads (file mode, sharded process methods)
+    void enable_parallel_decoding(int n_threads)
+    {
+        if (n_threads <= 1) return;
+        n_decode_threads = n_threads;
+        decode_pool.init(n_decode_threads, n_buffer);
+    }
 
     void run()
     {
@@ -178,6 +268,18 @@ public:
         {
             case 0:
             {
+                b_ranges = false;
+                if (n_decode_threads > 1)
+                {
+                    this->init_shards(n_decode_threads);
+                    b_ranges = this->b_sharded;
+                }
+                if (b_ranges)
+                {
+                    open_workers();
+                    this->read_thread = std::thread(&SIMULATED<event, buffer_size, n_buffer>::read_ranges, this);
+                    break;
+                }
                 this->file.path = this->file_path;
                 this->file.open_file();
                 this->read_thread = std::thread(&SIMULATED<event, buffer_size, n_buffer>::read_file, this);
@@ -188,10 +290,17 @@ public:
                 throw std::invalid_argument("simulated must be file mode");
             }
         }
-        this->proc_thread = std::thread(&SIMULATED<event, buffer_size, n_buffer>::schedule_buffer, this);
+        if (b_ranges) this->proc_thread = std::thread(&SIMULATED<event, buffer_size, n_buffer>::schedule_ranges, this);
+        else this->proc_thread = std::thread(&SIMULATED<event, buffer_size, n_buffer>::schedule_buffer, this);
         this->starttime  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
     };
 
+    void terminate()
+    {
+        TIMEPIX<event, buffer_size, n_buffer>::terminate();
+        workers.clear(); // closes the files, the copies go back to the arena
+    };
+
     SIMULATED(
         int &nx,
         int &ny,
@@ -216,7 +325,6 @@ public:
     ) 
     {
         this->n_cam = _n_cam;
-        // event_parsing_pool->init(4, 16);
     }
 };
 
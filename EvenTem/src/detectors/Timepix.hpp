@@ -33,6 +33,8 @@
 #include <functional>
 #include <algorithm>
 #include <cstdlib>
+#include <mutex>
+#include <type_traits>
 
 #include "SocketConnector.h"
 #include "FileConnector.h"
@@ -41,6 +43,14 @@
 #include "Logger.hpp"
 #include "Roi4D.hpp"
 #include "AtomicWrapper.hpp"
+#include "EventBatch.hpp"
+#include "AccumulatorShard.hpp"
+#include "SpscRing.hpp"
+#include "LineNotifier.hpp"
+#include "PipelineMetrics.hpp"
+#include "Tracer.h"
+#include "BufferArena.h"
+#include "ScanPattern.h"
 
 template <typename event, int buffer_size, int n_buffer>
 class TIMEPIX
@@ -54,6 +64,7 @@ protected:
             multi_vstem,
             mask_vstem,
             com,
+            com_masked,
             GPRI,
             count_chunked_8,
             count_chunked_16,
@@ -76,6 +87,7 @@ protected:
             multi_vstem,
             mask_vstem,
             com,
+            com_masked,
             count_chunked_8,
             count_chunked_16,
             count_chunked_32,
@@ -108,8 +120,11 @@ protected:
 
     inline void atomic_vstem(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image)
     {
-        // (*p_atomic_stem_data)[_probe_position]++;
-        // atomic_counter++;
+        int _d2 = (_kx - x_offset)*(_kx - x_offset) + (_ky - y_offset)*(_ky - y_offset);
+        if (_d2 > in_radius_sqr && _d2 <= out_radius_sqr)
+        {   
+            ++(*p_atomic_stem_data)[_probe_position];
+        }
     };
 
     inline void multi_vstem(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image)
@@ -199,9 +214,15 @@ protected:
         (*p_pacbed_data)[_kx*n_cam+_ky]++;
     };
 
+    // squared distance to the offset, truncated per event so the serial and the sharded sums agree
+    inline size_t var_value(uint16_t _kx, uint16_t _ky)
+    {
+        return (size_t)((_kx-offset[0])*(_kx-offset[0])+(_ky-offset[0])*(_ky-offset[0]));
+    };
+
     inline void var(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image)
     {
-        (*p_var_data)[_id_image][_probe_position] += (_kx-offset[0])*(_kx-offset[0])+(_ky-offset[0])*(_ky-offset[0]);
+        (*p_var_data)[_id_image][_probe_position] += var_value(_kx, _ky);
     };
 
     inline void roi(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image)
@@ -285,14 +306,337 @@ protected:
         (*p_count_image)[_probe_position]++;
     };
 
+    // -----------------------------------------------------------------------------------------------
+    // compile-time dispatch
+    // -----------------------------------------------------------------------------------------------
+    // The detectors template their buffer loops on the FunctionType, so the choice of process method
+    // is made once per buffer in with_policy() instead of once per event.
+
+    template <FunctionType F>
+    using Policy = std::integral_constant<FunctionType, F>;
+
+    template <FunctionType F>
+    inline void accumulate(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image, uint64_t _toa = 0, uint16_t _tot = 0)
+    {
+        if constexpr (F == FunctionType::vstem) vstem(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::multi_vstem) multi_vstem(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::mask_vstem) mask_vstem(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::atomic_vstem) atomic_vstem(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::com) com(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::com_masked) com_masked(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::count_chunked_8) count_chunked_8(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::count_chunked_16) count_chunked_16(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::count_chunked_32) count_chunked_32(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::pacbed) pacbed(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::var) var(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::roi) roi(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::roi_ToT) { tot = _tot; roi_ToT(_probe_position, _kx, _ky, _id_image); }
+        else if constexpr (F == FunctionType::roi_mask) roi_mask(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::roi_4D) roi_4D(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::write_electron) write_electron(_probe_position, _kx, _ky, _id_image);
+        else if constexpr (F == FunctionType::write_declusterer_buffer) write_declusterer_buffer(_probe_position, _kx, _ky, _id_image, _toa, _tot);
+        else if constexpr (F == FunctionType::information) information(_probe_position, _kx, _ky, _id_image);
+        #ifdef GPRI_OPTION_ENABLED
+        else if constexpr (F == FunctionType::GPRI) GPRI(_probe_position, _kx, _ky, _id_image);
+        #endif
+    };
+
+    // Accumulation stage: the detectors decode their buffers into EventBatches and hand those
+    // over here, so decoding and the process methods only meet at the batch boundary.
+    template <FunctionType F>
+    inline void accumulate_batch(const EventBatch &events)
+    {
+        for (size_t i = 0; i < events.n; i++)
+        {
+            accumulate<F>(events.probe_position[i], events.kx[i], events.ky[i], events.id_image[i], events.toa[i], events.tot[i]);
+        }
+        n_events_processed += events.n;
+    };
+
+    inline void accumulate_batch(const EventBatch &events)
+    {
+        with_policy([&](auto policy){ accumulate_batch<decltype(policy)::value>(events); });
+        if (p_metrics) p_metrics->add(p_metrics->events_accepted, events.n);
+    };
+
+    // decoded positions are the raster order of the triggers, moves them to the scanned positions
+    inline void remap_batch(EventBatch &events)
+    {
+        if (!p_scan_pattern) return;
+        const uint32_t *lut = p_scan_pattern->positions().data();
+        for (size_t i = 0; i < events.n; i++) events.probe_position[i] = lut[events.probe_position[i] % nxy];
+    };
+
+    // -----------------------------------------------------------------------------------------------
+    // sharded accumulation
+    // -----------------------------------------------------------------------------------------------
+    // Worker threads accumulate batches into a Shard they own, without atomics or locks. The owner
+    // of the images folds the shards in with reduce_shard() at buffer boundaries. Process methods
+    // without a sharded form (4D, electron output, ...) stay on accumulate_batch().
+
+    struct Shard
+    {
+        AccumulatorShard<size_t> stem;    // key: id_image*ny + line
+        AccumulatorShard<size_t> dose;    // key: (id_image%2)*ny + line
+        AccumulatorShard<size_t> sumx;
+        AccumulatorShard<size_t> sumy;
+        AccumulatorShard<size_t> var;     // key: id_image*ny + line
+        AccumulatorShard<size_t> pattern; // whole n_cam*n_cam patterns, key: 0 (pacbed), id_image (roi)
+        AccumulatorShard<size_t> scan;    // key: id_image*L_1 + roi row (roi), id_image*ny + line (roi_mask)
+        uint64_t n_events = 0;
+    };
+
+    template <FunctionType F>
+    static constexpr bool is_shardable()
+    {
+        return F == FunctionType::vstem || F == FunctionType::multi_vstem || F == FunctionType::mask_vstem ||
+               F == FunctionType::com || F == FunctionType::com_masked || F == FunctionType::pacbed ||
+               F == FunctionType::var || F == FunctionType::roi || F == FunctionType::roi_ToT || F == FunctionType::roi_mask;
+    };
+
+    bool shardable()
+    {
+        bool _shardable = false;
+        with_policy([&](auto policy){ _shardable = is_shardable<decltype(policy)::value>(); });
+        return _shardable;
+    };
+
+    void init_shard(Shard &shard)
+    {
+        shard.stem.init(nx);
+        shard.dose.init(nx);
+        shard.sumx.init(nx);
+        shard.sumy.init(nx);
+        shard.var.init(nx);
+        shard.pattern.init((size_t)n_cam*n_cam);
+        shard.scan.init((functionType == FunctionType::roi_mask) ? nx : L_0);
+        shard.n_events = 0;
+    };
+
+    // one shard per decode thread, handed out to the running decode tasks
+    bool b_sharded = false;
+    std::vector<Shard> shards;
+    std::vector<int> free_shards;
+    std::mutex mtx_shards;
+
+    void init_shards(int n)
+    {
+        b_sharded = shardable();
+        if (!b_sharded) return;
+        shards.resize(n);
+        free_shards.clear();
+        for (int i = 0; i < n; i++)
+        {
+            init_shard(shards[i]);
+            free_shards.push_back(i);
+        }
+    };
+
+    inline int acquire_shard()
+    {
+        std::lock_guard<std::mutex> lock(mtx_shards);
+        int id = free_shards.back();
+        free_shards.pop_back();
+        return id;
+    };
+
+    inline void release_shard(int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx_shards);
+        free_shards.push_back(id);
+    };
+
+    template <FunctionType F>
+    inline void accumulate_shard(Shard &shard, const EventBatch &events)
+    {
+        for (size_t i = 0; i < events.n; i++)
+        {
+            uint64_t _probe_position = events.probe_position[i];
+            uint16_t _kx = events.kx[i];
+            uint16_t _ky = events.ky[i];
+            uint16_t _id_image = events.id_image[i];
+            uint64_t _line = _probe_position / nx;
+            uint64_t _col = _probe_position % nx;
+
+            if constexpr (F == FunctionType::vstem)
+            {
+                int _d2 = (_kx - x_offset)*(_kx - x_offset) + (_ky - y_offset)*(_ky - y_offset);
+                if (_d2 > in_radius_sqr && _d2 <= out_radius_sqr) shard.stem.add(_id_image*ny + _line, _col, 1);
+            }
+            else if constexpr (F == FunctionType::multi_vstem)
+            {
+                size_t _hits = 0;
+                for (int j = 0; j < n_detectors; j++)
+                {
+                    int _d2 = (_kx - offsets[j][0])*(_kx - offsets[j][0]) + (_ky - offsets[j][1])*(_ky - offsets[j][1]);
+                    if (_d2 >= radia_sqr[j][0] && _d2 <= radia_sqr[j][1]) ++_hits;
+                }
+                if (_hits) shard.stem.add(_id_image*ny + _line, _col, _hits);
+            }
+            else if constexpr (F == FunctionType::mask_vstem)
+            {
+                shard.stem.add(_id_image*ny + _line, _col, detector_mask[_kx*n_cam+_ky]);
+            }
+            else if constexpr (F == FunctionType::com)
+            {
+                uint64_t _key = (_id_image%2)*ny + _line;
+                shard.dose.add(_key, _col, 1);
+                shard.sumx.add(_key, _col, _kx);
+                shard.sumy.add(_key, _col, _ky);
+            }
+            else if constexpr (F == FunctionType::com_masked)
+            {
+                uint64_t _key = (_id_image%2)*ny + _line;
+                int _w = com_mask[_kx*n_cam+_ky];
+                shard.dose.add(_key, _col, _w);
+                shard.sumx.add(_key, _col, _kx*_w);
+                shard.sumy.add(_key, _col, _ky*_w);
+            }
+            else if constexpr (F == FunctionType::pacbed)
+            {
+                shard.pattern.add(0, _kx*n_cam + _ky, 1);
+            }
+            else if constexpr (F == FunctionType::var)
+            {
+                shard.var.add(_id_image*ny + _line, _col, var_value(_kx, _ky));
+            }
+            else if constexpr (F == FunctionType::roi || F == FunctionType::roi_ToT)
+            {
+                int _x = _col;
+                int _y = nx - _line;
+                if (_x >= lower_left[0] && _x < upper_right[0] && _y > lower_left[1] && _y <= upper_right[1])
+                {
+                    shard.pattern.add(_id_image, _kx*n_cam + _ky, (F == FunctionType::roi_ToT) ? events.tot[i] : 1);
+                    shard.scan.add((uint64_t)_id_image*L_1 + (L_1 - (_y-lower_left[1])), _x-lower_left[0], 1);
+                }
+            }
+            else if constexpr (F == FunctionType::roi_mask)
+            {
+                if (mask_roi[_id_image][_probe_position] == 1)
+                {
+                    shard.pattern.add(_id_image, _kx*n_cam + _ky, 1);
+                    shard.scan.add(_id_image*ny + _line, _col, 1);
+                }
+            }
+        }
+        shard.n_events += events.n;
+    };
+
+    inline void accumulate_shard(Shard &shard, const EventBatch &events)
+    {
+        with_policy([&](auto policy)
+        {
+            if constexpr (is_shardable<decltype(policy)::value>()) accumulate_shard<decltype(policy)::value>(shard, events);
+        });
+    };
+
+    // folds a shard into the shared images, must only be called by the thread that owns them
+    void reduce_shard(Shard &shard)
+    {
+        auto reduce_lines = [&](auto &shard_image, auto &&image_of)
+        {
+            shard_image.reduce([&](uint64_t _key, const auto *_row)
+            {
+                auto &_image = image_of(_key / ny);
+                uint64_t _offset = (_key % ny) * nx;
+                for (int c = 0; c < nx; c++) _image[_offset + c] += _row[c];
+            });
+        };
+
+        switch (functionType)
+        {
+            case FunctionType::vstem:
+            case FunctionType::multi_vstem:
+            case FunctionType::mask_vstem:
+                reduce_lines(shard.stem, [&](uint64_t _id) -> std::vector<size_t> & { return (*p_stem_data)[_id]; });
+                break;
+            case FunctionType::com:
+            case FunctionType::com_masked:
+                reduce_lines(shard.dose, [&](uint64_t _id) -> std::vector<size_t> & { return (*p_dose_data)[_id]; });
+                reduce_lines(shard.sumx, [&](uint64_t _id) -> std::vector<size_t> & { return (*p_sumx_data)[_id]; });
+                reduce_lines(shard.sumy, [&](uint64_t _id) -> std::vector<size_t> & { return (*p_sumy_data)[_id]; });
+                break;
+            case FunctionType::var:
+                reduce_lines(shard.var, [&](uint64_t _id) -> std::vector<size_t> & { return (*p_var_data)[_id]; });
+                break;
+            case FunctionType::pacbed:
+                shard.pattern.reduce([&](uint64_t, const size_t *_pattern)
+                {
+                    for (size_t k = 0; k < (size_t)n_cam*n_cam; k++) (*p_pacbed_data)[k] += _pattern[k];
+                });
+                break;
+            case FunctionType::roi:
+            case FunctionType::roi_ToT:
+            case FunctionType::roi_mask:
+            {
+                shard.pattern.reduce([&](uint64_t _id, const size_t *_pattern)
+                {
+                    for (size_t k = 0; k < (size_t)n_cam*n_cam; k++)
+                    {
+                        (*p_roi_diffraction_pattern_stack)[_id][k] += _pattern[k];
+                        (*p_roi_diffraction_pattern)[k] += _pattern[k];
+                    }
+                });
+                size_t _rows = (functionType == FunctionType::roi_mask) ? ny : L_1;
+                size_t _length = shard.scan.get_row_length();
+                shard.scan.reduce([&](uint64_t _key, const size_t *_row)
+                {
+                    uint64_t _id = _key / _rows;
+                    uint64_t _offset = (_key % _rows) * _length;
+                    for (size_t c = 0; c < _length; c++)
+                    {
+                        (*p_roi_scan_image_stack)[_id][_offset + c] += _row[c];
+                        (*p_roi_scan_image)[_offset + c] += _row[c];
+                    }
+                });
+                break;
+            }
+            default:
+                break;
+        }
+        n_events_processed += shard.n_events;
+        if (p_metrics) p_metrics->add(p_metrics->events_accepted, shard.n_events);
+        shard.n_events = 0;
+    };
+
+    // calls fn(Policy<F>{}) for the FunctionType selected by the enable_* methods
+    // (roi is weighted by ToT when b_tot is set)
+    template <typename Fn>
+    inline void with_policy(Fn &&fn)
+    {
+        switch (functionType)
+        {
+            case FunctionType::vstem: fn(Policy<FunctionType::vstem>{}); break;
+            case FunctionType::multi_vstem: fn(Policy<FunctionType::multi_vstem>{}); break;
+            case FunctionType::mask_vstem: fn(Policy<FunctionType::mask_vstem>{}); break;
+            case FunctionType::atomic_vstem: fn(Policy<FunctionType::atomic_vstem>{}); break;
+            case FunctionType::com: fn(Policy<FunctionType::com>{}); break;
+            case FunctionType::com_masked: fn(Policy<FunctionType::com_masked>{}); break;
+            case FunctionType::count_chunked_8: fn(Policy<FunctionType::count_chunked_8>{}); break;
+            case FunctionType::count_chunked_16: fn(Policy<FunctionType::count_chunked_16>{}); break;
+            case FunctionType::count_chunked_32: fn(Policy<FunctionType::count_chunked_32>{}); break;
+            case FunctionType::pacbed: fn(Policy<FunctionType::pacbed>{}); break;
+            case FunctionType::var: fn(Policy<FunctionType::var>{}); break;
+            case FunctionType::roi: if (b_tot) fn(Policy<FunctionType::roi_ToT>{}); else fn(Policy<FunctionType::roi>{}); break;
+            case FunctionType::roi_ToT: fn(Policy<FunctionType::roi_ToT>{}); break;
+            case FunctionType::roi_mask: fn(Policy<FunctionType::roi_mask>{}); break;
+            case FunctionType::roi_4D: fn(Policy<FunctionType::roi_4D>{}); break;
+            case FunctionType::write_electron: fn(Policy<FunctionType::write_electron>{}); break;
+            case FunctionType::write_declusterer_buffer: fn(Policy<FunctionType::write_declusterer_buffer>{}); break;
+            case FunctionType::information: fn(Policy<FunctionType::information>{}); break;
+            #ifdef GPRI_OPTION_ENABLED
+            case FunctionType::GPRI: fn(Policy<FunctionType::GPRI>{}); break;
+            #endif
+        }
+    };
+
 protected:
     
     FileConnector file;
     std::thread read_thread;
     std::thread proc_thread;
     int n_buf = n_buffer;
-    int n_buffer_filled=0;
-    int n_buffer_processed=0;
+    SpscRing ring = SpscRing(n_buffer); // reader -> decoder hand-over of the buffers
     uint16_t id_image = 0 ;
     uint64_t current_line = 0;
     uint64_t probe_position = 0;
@@ -301,43 +645,81 @@ protected:
     uint16_t ky;
     uint64_t n_events_processed = 0;
 
+    inline bool stopped()
+    {
+        return (*p_processor_line) == -1;
+    };
+
+    // marks the lines before 'line' as complete and wakes up the processor; with a scan pattern
+    // 'line' counts the lines of triggers, the processors get the complete lines of the scan
+    inline void publish_line(int line)
+    {
+        if (p_scan_pattern) line = (int)p_scan_pattern->lines_complete((uint64_t)line * nx);
+        if (p_line_notifier) p_line_notifier->publish(line);
+        if (p_tracer) p_tracer->line_published(line);
+    };
+
+    // tracing of ring buffer 'id', no-ops without a tracer; trace_span() returns the end time
+    inline int64_t trace_time()
+    {
+        return (p_tracer) ? p_tracer->now() : 0;
+    };
+
+    inline int64_t trace_span(const char *name, int64_t id, int64_t t_begin)
+    {
+        return (p_tracer) ? p_tracer->complete(name, id, t_begin) : 0;
+    };
+
+    inline void trace_thread(const char *name)
+    {
+        if (p_tracer) p_tracer->name_thread(name);
+    };
+
+    // buffer the decoders read slot buffer_id from: the mapped file or the own copy
+    inline std::array<event, buffer_size> *slot(int buffer_id)
+    {
+        return p_slot[buffer_id];
+    };
+
+    // A mapped file is decoded in place, only the last, incomplete buffer is copied. The mapping
+    // is released in terminate(), once the decoder is done with it.
     inline void read_file()
     {
         int buffer_id;
-        while ((!this->repetitions_reached) && (*p_processor_line!=-1))
+        trace_thread("read_thread");
+        while ((!this->repetitions_reached) && ring.wait_for_space([this]{ return stopped() || repetitions_reached; }))
         {
-            if (n_buffer_filled < (n_buffer + n_buffer_processed)) 
-            {
-                buffer_id = n_buffer_filled % n_buffer; 
-                file.read_data((char *)&(buffer[buffer_id]), sizeof(buffer[buffer_id]));
-                ++n_buffer_filled;
-            }
-            else
+            buffer_id = ring.filled() % n_buffer; 
+            int64_t t_read = trace_time();
             {
-                read_wait++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                PipelineMetrics::StageTimer timer(p_metrics, PipelineMetrics::READ);
+                p_slot[buffer_id] = (std::array<event, buffer_size> *)file.map_data(sizeof(buffer[buffer_id]));
+                if (!p_slot[buffer_id])
+                {
+                    p_slot[buffer_id] = &(buffer[buffer_id]);
+                    file.read_data((char *)&(buffer[buffer_id]), sizeof(buffer[buffer_id]));
+                }
             }
+            if (p_metrics) p_metrics->add(p_metrics->bytes_read, sizeof(buffer[buffer_id]));
+            trace_span("read", ring.filled(), t_read);
+            ring.push();
         }
-        file.close_file();
     };
 
     inline void read_socket()
     {
         int buffer_id;
-        while (*p_processor_line != -1)
+        trace_thread("read_thread");
+        while (ring.wait_for_space([this]{ return stopped(); }))
         {
-            if (n_buffer_filled < (n_buffer + n_buffer_processed))
-            {
-                buffer_id = n_buffer_filled % n_buffer;
-                socket.read_data((char *)&(buffer[buffer_id]), sizeof(buffer[buffer_id]));
-                ++n_buffer_filled;
-            }
-            else
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            }
+            buffer_id = ring.filled() % n_buffer;
+            p_slot[buffer_id] = &(buffer[buffer_id]);
+            int64_t t_read = trace_time();
+            socket.read_data((char *)&(buffer[buffer_id]), sizeof(buffer[buffer_id]));
+            if (p_metrics) p_metrics->add(p_metrics->bytes_read, sizeof(buffer[buffer_id]));
+            trace_span("read", ring.filled(), t_read);
+            ring.push();
         }
-       
     };
 
     void flush_image(int id_img)
@@ -353,8 +735,7 @@ protected:
 
     void reset()
     {
-        n_buffer_filled = 0;
-        n_buffer_processed = 0;
+        ring.reset();
         current_line = 0;
     };
 
@@ -366,7 +747,6 @@ public:
         radia_sqr = (*_p_radia_sqr);
         offsets = *_p_offsets;
         n_detectors = radia_sqr.size();
-        process.push_back(std::bind(&TIMEPIX::multi_vstem, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::multi_vstem;
         ++n_proc;
     }
@@ -378,7 +758,6 @@ public:
         out_radius_sqr = (int)(*_p_radius_sqr)[1];
         x_offset = (int)(*_p_offset)[0];
         y_offset = (int)(*_p_offset)[1];
-        process.push_back(std::bind(&TIMEPIX::vstem, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::vstem;
         ++n_proc;
     }
@@ -391,7 +770,6 @@ public:
         x_offset = (int)(*_p_offset)[0];
         y_offset = (int)(*_p_offset)[1];
         functionType = FunctionType::atomic_vstem;
-        process.push_back(std::bind(&TIMEPIX::atomic_vstem, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         ++n_proc;
     }
 
@@ -399,7 +777,6 @@ public:
     {
         p_stem_data = _p_stem_data;
         detector_mask = *_p_detector_mask;
-        process.push_back(std::bind(&TIMEPIX::mask_vstem, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::mask_vstem;
         ++n_proc;
     }
@@ -410,7 +787,6 @@ public:
         p_sumx_data = _p_sumx_data;
         p_sumy_data = _p_sumy_data;
 
-        process.push_back(std::bind(&TIMEPIX::com, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::com;
         p_images.push_back(p_sumx_data);
         p_images.push_back(p_sumy_data);
@@ -426,8 +802,7 @@ public:
         p_sumy_data = _p_sumy_data;
 
         com_mask = *_p_com_mask;
-        process.push_back(std::bind(&TIMEPIX::com_masked, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-        functionType = FunctionType::com;
+        functionType = FunctionType::com_masked;
         p_images.push_back(p_sumx_data);
         p_images.push_back(p_sumy_data);
         p_images.push_back(p_dose_data);
@@ -440,7 +815,6 @@ public:
     {
         p_counts_data = _p_counts_data;
         p_fourDchunk_data_8 = _p_fourD_data;
-        process.push_back(std::bind(&TIMEPIX::count_chunked_8, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::count_chunked_8;
         ++n_proc;
 
@@ -456,7 +830,6 @@ public:
     {
         p_counts_data = _p_counts_data;
         p_fourDchunk_data_16 = _p_fourD_data;
-        process.push_back(std::bind(&TIMEPIX::count_chunked_16, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::count_chunked_16;
         ++n_proc;
 
@@ -472,7 +845,6 @@ public:
     {
         p_counts_data = _p_counts_data;
         p_fourDchunk_data_32 = _p_fourD_data;
-        process.push_back(std::bind(&TIMEPIX::count_chunked_32, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::count_chunked_32;
         ++n_proc;
 
@@ -488,7 +860,6 @@ public:
     void enable_Pacbed(std::vector<size_t> *_p_pacbed_data)
     {
         p_pacbed_data = _p_pacbed_data;
-        process.push_back(std::bind(&TIMEPIX::pacbed, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::pacbed;
         ++n_proc;
     }
@@ -497,7 +868,6 @@ public:
     {
         p_var_data = _p_var_data;
         offset = _offset;
-        process.push_back(std::bind(&TIMEPIX::var, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         p_images.push_back(p_var_data);
         functionType = FunctionType::var;
         ++n_proc;
@@ -517,7 +887,6 @@ public:
         upper_right[1] = _upper_right[1];
         L_0 = upper_right[0]-lower_left[0];
         L_1 = upper_right[1]-lower_left[1];
-        process.push_back(std::bind(&TIMEPIX::roi, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::roi;
         ++n_proc;
         // this->b_tot = true;
@@ -532,7 +901,6 @@ public:
         p_roi_diffraction_pattern = _p_roi_diffraction_pattern;
         mask_roi = *_p_roi_mask;
 
-        process.push_back(std::bind(&TIMEPIX::roi_mask, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::roi_mask;
         ++n_proc;
 
@@ -552,7 +920,6 @@ public:
         upper_right[1] = _upper_right[1];
         L_0 = upper_right[0]-lower_left[0];
         L_1 = upper_right[1]-lower_left[1];
-        process.push_back(std::bind(&TIMEPIX::roi_4D, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::roi_4D;
         ++n_proc;
     }
@@ -585,7 +952,6 @@ public:
         GPRI_cam_bin = n_cam/detector_bin;
         p_N_electrons_map_scangrid = _p_N_electrons_map_scangrid;
     
-        process.push_back(std::bind(&TIMEPIX::GPRI, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::GPRI;
         ++n_proc;
     }
@@ -596,11 +962,58 @@ public:
         p_information_image = _p_information_image;
         p_probability_distribution = _p_probability_distribution;
         p_count_image = _p_count_image;
-        process.push_back(std::bind(&TIMEPIX::information, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
         functionType = FunctionType::information;
         ++n_proc;
     }
 
+    // spin instead of sleeping when the reader or the decoder has to wait for the other
+    void enable_busy_poll(bool _busy_poll)
+    {
+        ring.set_busy_poll(_busy_poll);
+    }
+
+    void enable_line_notification(LineNotifier *_p_line_notifier)
+    {
+        p_line_notifier = _p_line_notifier;
+    }
+
+    // count bytes, events and busy time of the stages into metrics (restarted here)
+    void enable_metrics(PipelineMetrics *_p_metrics)
+    {
+        p_metrics = _p_metrics;
+        if (p_metrics) p_metrics->reset();
+        ring.set_counters(p_metrics ? &p_metrics->ring : nullptr);
+    }
+
+    // record a timeline of the buffers and lines, written when the detector terminates
+    void enable_tracing(Tracer *_p_tracer)
+    {
+        p_tracer = (_p_tracer && _p_tracer->enabled()) ? _p_tracer : nullptr;
+        declusterer.p_tracer = p_tracer;
+        if (p_tracer) p_tracer->start();
+    }
+
+    // positions of the triggers for non-raster scans, see ScanPattern.h; only a reordering of the
+    // whole scan applies to the line timed detectors
+    void enable_scan_pattern(const ScanPattern *_p_scan_pattern)
+    {
+        p_scan_pattern = nullptr;
+        if ((!_p_scan_pattern) || _p_scan_pattern->empty() || _p_scan_pattern->is_raster()) return;
+        if ((_p_scan_pattern->nx != nx) || (_p_scan_pattern->ny != ny) || (!_p_scan_pattern->is_permutation()))
+        {
+            std::cout << "The scan pattern has to visit every position of the " << nx << "x" << ny << " scan once, ignored" << std::endl;
+            return;
+        }
+        p_scan_pattern = _p_scan_pattern;
+    }
+
+    // stream the file through the asynchronous read-ahead instead of mapping it
+    void enable_read_ahead(bool _read_ahead, bool _direct_io = false)
+    {
+        file.read_ahead = _read_ahead;
+        file.direct_io = _direct_io;
+    }
+
     //-------------------------------------------------------------------------------------------------
 
     void terminate()
@@ -608,6 +1021,7 @@ public:
         while ((!read_thread.joinable()) || (!proc_thread.joinable())) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
         read_thread.join();
         proc_thread.join();
+        file.close_file();
         if (decluster)
         {
             declusterer.still_reading = false;
@@ -615,6 +1029,9 @@ public:
             declusterer.terminate();
             decluster_thread.join();
         }
+        if (p_tracer) p_tracer->finish();
+        read_wait = ring.producer_waits;
+        process_wait = ring.consumer_waits;
         this->endtime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
         processing_rate = n_events_processed / ((endtime - starttime) / 1e9);
         std::cout << n_events_processed << " events processed at " << processing_rate/1000000 << " M events/s " << std::endl; 
@@ -622,6 +1039,7 @@ public:
         std::cout << "reading waited " << read_wait << " times, processing waited " << process_wait << " times"<< std::endl;
         std::cout << "atomic counter: " << atomic_counter << std::endl;
         // std::cout << "avg BM time: " << BM_duration_sum/BM_count << " us for " << BM_count << " calls" << std::endl;
+        buffer.release(); // back to the arena for the next run
     };
 
     float get_processing_rate(){
@@ -742,15 +1160,19 @@ public:
     //-----------------------------------------------------------------------------------------------------------------------
 
     int *p_processor_line;
-    int *p_preprocessor_line;
+    int *p_preprocessor_line; // not written, the decoded line is published through p_line_notifier
+    LineNotifier *p_line_notifier = nullptr;
+    PipelineMetrics *p_metrics = nullptr;
+    Tracer *p_tracer = nullptr;
+    const ScanPattern *p_scan_pattern = nullptr;
     int mode;
     std::string file_path;
     SocketConnector socket;
 
     //std::array<std::array<event, buffer_size>, n_buffer> buffer; // allocated on stack -> limited by 2gig stack frame 
-    std::array<event, buffer_size> *buffer = new std::array<event, buffer_size>[n_buffer]; // dynamic allocation on heap
+    ArenaBuffer<std::array<event, buffer_size>> buffer = ArenaBuffer<std::array<event, buffer_size>>(n_buffer); // reused across runs, see BufferArena.h
+    std::array<std::array<event, buffer_size> *, n_buffer> p_slot; // data of each ring slot, see slot()
 
-    std::vector<std::function<void(uint64_t, uint16_t, uint16_t, uint16_t)>> process; 
     TIMEPIX<event, buffer_size, n_buffer>::FunctionType functionType;
 
     int n_proc = 0;
@@ -796,6 +1218,7 @@ public:
         nxy = nx*ny;
         n_proc = 0;
         n_images = 0;
+        for (int i = 0; i < n_buffer; i++) p_slot[i] = &(buffer[i]);
     }
 };
 #endif // TIMEPIX_H
\ No newline at end of file
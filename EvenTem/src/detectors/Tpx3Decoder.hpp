@@ -0,0 +1,306 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef TPX3DECODER_H
+#define TPX3DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "CpuDispatch.h"
+#if defined(EVENTEM_X86)
+#include <immintrin.h>
+#endif
+#if defined(EVENTEM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "EventBatch.hpp"
+
+// Decoding of runs of TPX3 pixel hit packets. Between two header or TDC packets all hits share the
+// chip and the TDC state, so a run is decoded with constant parameters, 4 (AVX2) or 8 (AVX-512)
+// packets at a time. All variants are built into every binary, event_run_length and
+// decode_events point to the best one for the CPU (see CpuDispatch.h); the scalar decoder gives
+// identical results.
+//
+// Rollover: the ToA counts 2^34 units of 1.5625 ns (26.8 s), the TDC 2^35 units of 3.125 ns
+// (107.4 s). The TDC is unwrapped against the previous TDC or global time packet of the stream
+// (unwrap()), and a hit is taken relative to the unwrapped TDC rise of its chip modulo the ToA
+// range, so a hit always lands on the line it belongs to, however the ToA wraps inside it. This
+// only depends on the packet order, a file decodes the same at any speed.
+namespace TPX3_DECODER
+{
+    const int toa_bits = 34;
+    const uint64_t toa_mask = (1ULL << toa_bits) - 1;
+    const int tdc_bits = 35;
+
+    // the TDC counts in units of 2 ToA units, so one TDC period is 4 ToA periods (107.4 s)
+    const uint64_t toa_periods_per_tdc = 1ULL << (tdc_bits + 1 - toa_bits);
+
+    // a step of the time from ToA period 'from' to 'to' also wraps the TDC
+    constexpr bool is_tdc_rollover(uint64_t from, uint64_t to)
+    {
+        return (to / toa_periods_per_tdc) > (from / toa_periods_per_tdc);
+    };
+    static_assert(!is_tdc_rollover(0, 1) && !is_tdc_rollover(1, 2) && !is_tdc_rollover(2, 3) && is_tdc_rollover(3, 4) &&
+                  !is_tdc_rollover(4, 5) && !is_tdc_rollover(5, 6) && !is_tdc_rollover(6, 7) && is_tdc_rollover(7, 8),
+                  "only every 4th ToA rollover is a TDC rollover");
+
+    struct run_parameters
+    {
+        uint64_t rise_toa;    // unwrapped TDC rise in ToA units (2 * rise_t)
+        uint64_t dt;          // dwell time in ToA units
+        uint64_t nx;
+        uint64_t line_offset; // (line % ny) * nx
+        int multiplier;       // per-chip address transform
+        int bias_x;
+        int bias_y;
+        uint16_t id_image;
+    };
+
+    inline bool is_event(uint64_t packet)
+    {
+        return (packet >> 60) == 0xb;
+    };
+
+    // ToA of a hit packet modulo 2^34 (only the low 34 bits are meaningful)
+    template <bool w_tot>
+    inline uint64_t toa(uint64_t packet)
+    {
+        if constexpr (w_tot) return ((((packet & 0xFFFF) << 14) + ((packet >> 30) & 0x3FFF)) << 4) - ((packet >> 16) & 0xF);
+        else return ((((packet & 0xFFFF) << 14) + ((packet >> 30) & 0x3FFF)) << 4);
+    };
+
+    // the value congruent to raw modulo 2^bits that is closest to ref
+    inline uint64_t unwrap(uint64_t raw, uint64_t ref, int bits)
+    {
+        const uint64_t period = 1ULL << bits, half = period >> 1;
+        uint64_t t = (ref & ~(period - 1)) | (raw & (period - 1));
+        if (t + half < ref) t += period;
+        else if ((t > ref + half) && (t >= period)) t -= period;
+        return t;
+    };
+
+    // number of consecutive hit packets at the start of p[0..n)
+    inline size_t event_run_length_scalar(const uint64_t *p, size_t n)
+    {
+        size_t i = 0;
+        while (i < n && is_event(p[i])) ++i;
+        return i;
+    };
+
+#if defined(EVENTEM_X86)
+    EVENTEM_TARGET_AVX2 inline size_t event_run_length_avx2(const uint64_t *p, size_t n)
+    {
+        size_t i = 0;
+        const __m256i _event = _mm256_set1_epi64x(0xb);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+            unsigned m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_srli_epi64(v, 60), _event)));
+            if (m != 0xF) { while (m & 1) { m >>= 1; ++i; } return i; }
+        }
+        while (i < n && is_event(p[i])) ++i;
+        return i;
+    };
+
+    EVENTEM_TARGET_AVX512 inline size_t event_run_length_avx512(const uint64_t *p, size_t n)
+    {
+        size_t i = 0;
+        const __m512i _event = _mm512_set1_epi64(0xb);
+        for (; i + 8 <= n; i += 8)
+        {
+            unsigned m = _mm512_cmpeq_epi64_mask(_mm512_srli_epi64(_mm512_loadu_si512((const void *)(p + i)), 60), _event);
+            if (m != 0xFF) { while (m & 1) { m >>= 1; ++i; } return i; }
+        }
+        while (i < n && is_event(p[i])) ++i;
+        return i;
+    };
+#endif
+
+#if defined(EVENTEM_NEON)
+    inline size_t event_run_length_neon(const uint64_t *p, size_t n)
+    {
+        size_t i = 0;
+        const uint64x2_t _event = vdupq_n_u64(0xb);
+        for (; i + 4 <= n; i += 4)
+        {
+            uint64x2_t a = vceqq_u64(vshrq_n_u64(vld1q_u64(p + i), 60), _event);
+            uint64x2_t b = vceqq_u64(vshrq_n_u64(vld1q_u64(p + i + 2), 60), _event);
+            if (vminvq_u32(vreinterpretq_u32_u64(vandq_u64(a, b))) == 0) break; // the scalar loop finds the first non-hit
+        }
+        while (i < n && is_event(p[i])) ++i;
+        return i;
+    };
+#endif
+
+    template <bool w_tot>
+    inline void decode_event(uint64_t packet, const run_parameters &r, EventBatch &batch)
+    {
+        uint64_t d = (toa<w_tot>(packet) - r.rise_toa) & toa_mask;
+        uint64_t _probe_position = d / r.dt;
+        if (_probe_position < r.nx)
+        {
+            uint64_t _toa = r.rise_toa + d;
+            uint64_t pack_44 = packet >> 44;
+            uint16_t _kx = (r.multiplier * (((pack_44 & 0x0FE00) >> 8) + ((pack_44 & 0x00007) >> 2)) + r.bias_x);
+            uint16_t _ky = (r.multiplier * (((pack_44 & 0x001F8) >> 1) + (pack_44 & 0x00003)) + r.bias_y);
+            uint16_t _tot = w_tot ? (packet >> (16 + 4)) & 0x3ff : 0;
+            batch.push_back(_probe_position + r.line_offset, _kx, _ky, r.id_image, _toa, _tot);
+        }
+    };
+
+    // Decodes n hit packets into batch, keeping the hits that fall inside the current line.
+    // The vector variants divide the probe position in double precision and correct it by one
+    // step in integer arithmetic, so they match the integer division of decode_event() bit for bit.
+    template <bool w_tot>
+    inline void decode_events_scalar(const uint64_t *p, size_t n, const run_parameters &r, EventBatch &batch)
+    {
+        for (size_t i = 0; i < n; i++) decode_event<w_tot>(p[i], r, batch);
+    };
+
+#if defined(EVENTEM_X86)
+    template <bool w_tot>
+    EVENTEM_TARGET_AVX2 inline void decode_events_avx2(const uint64_t *p, size_t n, const run_parameters &r, EventBatch &batch)
+    {
+        size_t i = 0;
+        if (r.dt < 4294967296)
+        {
+            const __m256i _m16 = _mm256_set1_epi64x(0xFFFF), _m14 = _mm256_set1_epi64x(0x3FFF), _m4 = _mm256_set1_epi64x(0xF), _m10 = _mm256_set1_epi64x(0x3FF);
+            const __m256i _mask = _mm256_set1_epi64x(toa_mask), _rise = _mm256_set1_epi64x(r.rise_toa);
+            const __m256i _dt_m1 = _mm256_set1_epi64x(r.dt - 1), _nx = _mm256_set1_epi64x(r.nx), _dt = _mm256_set1_epi64x(r.dt);
+            const __m256i _zero = _mm256_setzero_si256(), _magic_i = _mm256_set1_epi64x(0x4330000000000000);
+            const __m256d _magic_d = _mm256_set1_pd(4503599627370496.0), _dt_d = _mm256_set1_pd((double)r.dt), _nx_d = _mm256_set1_pd((double)r.nx + 1.0);
+            const __m256i _sign = _mm256_set1_epi64x(r.multiplier < 0 ? -1 : 0), _bx = _mm256_set1_epi64x(r.bias_x), _by = _mm256_set1_epi64x(r.bias_y);
+            alignas(32) uint64_t l_pp[4], l_toa[4], l_kx[4], l_ky[4], l_tot[4];
+
+            for (; i + 4 <= n; i += 4)
+            {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+                __m256i t = _mm256_add_epi64(_mm256_slli_epi64(_mm256_and_si256(v, _m16), 14), _mm256_and_si256(_mm256_srli_epi64(v, 30), _m14));
+                t = _mm256_slli_epi64(t, 4);
+                if constexpr (w_tot) t = _mm256_sub_epi64(t, _mm256_and_si256(_mm256_srli_epi64(v, 16), _m4));
+
+                __m256i d = _mm256_and_si256(_mm256_sub_epi64(t, _rise), _mask); // 0 <= d < 2^34
+                t = _mm256_add_epi64(_rise, d);
+                __m256d q = _mm256_div_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(d, _magic_i)), _magic_d), _dt_d);
+                __m256i keep = _mm256_castpd_si256(_mm256_cmp_pd(q, _nx_d, _CMP_LT_OQ));
+                if (_mm256_testz_si256(keep, keep)) continue;
+
+                __m256i pp = _mm256_and_si256(_mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(q)), keep);
+                __m256i rem = _mm256_sub_epi64(d, _mm256_mul_epu32(pp, _dt));
+                pp = _mm256_add_epi64(pp, _mm256_cmpgt_epi64(_zero, rem));                         // rem < 0   -> pp - 1
+                pp = _mm256_sub_epi64(pp, _mm256_cmpgt_epi64(rem, _dt_m1));                        // rem >= dt -> pp + 1
+                keep = _mm256_and_si256(keep, _mm256_cmpgt_epi64(_nx, pp));
+                unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(keep));
+
+                __m256i pack = _mm256_srli_epi64(v, 44);
+                __m256i x = _mm256_add_epi64(_mm256_srli_epi64(_mm256_and_si256(pack, _mm256_set1_epi64x(0x0FE00)), 8), _mm256_srli_epi64(_mm256_and_si256(pack, _mm256_set1_epi64x(0x00007)), 2));
+                __m256i y = _mm256_add_epi64(_mm256_srli_epi64(_mm256_and_si256(pack, _mm256_set1_epi64x(0x001F8)), 1), _mm256_and_si256(pack, _mm256_set1_epi64x(0x00003)));
+                x = _mm256_add_epi64(_mm256_sub_epi64(_mm256_xor_si256(x, _sign), _sign), _bx);
+                y = _mm256_add_epi64(_mm256_sub_epi64(_mm256_xor_si256(y, _sign), _sign), _by);
+
+                _mm256_store_si256((__m256i *)l_pp, pp);
+                _mm256_store_si256((__m256i *)l_toa, t);
+                _mm256_store_si256((__m256i *)l_kx, x);
+                _mm256_store_si256((__m256i *)l_ky, y);
+                if constexpr (w_tot) _mm256_store_si256((__m256i *)l_tot, _mm256_and_si256(_mm256_srli_epi64(v, 16 + 4), _m10));
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if ((mask >> lane) & 1) batch.push_back(l_pp[lane] + r.line_offset, l_kx[lane], l_ky[lane], r.id_image, l_toa[lane], w_tot ? l_tot[lane] : 0);
+                }
+            }
+        }
+        for (; i < n; i++) decode_event<w_tot>(p[i], r, batch);
+    };
+
+    template <bool w_tot>
+    EVENTEM_TARGET_AVX512 inline void decode_events_avx512(const uint64_t *p, size_t n, const run_parameters &r, EventBatch &batch)
+    {
+        size_t i = 0;
+        if (r.dt < 4294967296)
+        {
+            const __m512i _m16 = _mm512_set1_epi64(0xFFFF), _m14 = _mm512_set1_epi64(0x3FFF), _m4 = _mm512_set1_epi64(0xF), _m10 = _mm512_set1_epi64(0x3FF);
+            const __m512i _mask = _mm512_set1_epi64(toa_mask), _rise = _mm512_set1_epi64(r.rise_toa);
+            const __m512i _dt = _mm512_set1_epi64(r.dt), _nx = _mm512_set1_epi64(r.nx), _one = _mm512_set1_epi64(1);
+            const __m512i _magic_i = _mm512_set1_epi64(0x4330000000000000);
+            const __m512d _magic_d = _mm512_set1_pd(4503599627370496.0), _dt_d = _mm512_set1_pd((double)r.dt), _nx_d = _mm512_set1_pd((double)r.nx + 1.0);
+            const __m512i _sign = _mm512_set1_epi64(r.multiplier < 0 ? -1 : 0), _bx = _mm512_set1_epi64(r.bias_x), _by = _mm512_set1_epi64(r.bias_y);
+            alignas(64) uint64_t l_pp[8], l_toa[8], l_kx[8], l_ky[8], l_tot[8];
+
+            for (; i + 8 <= n; i += 8)
+            {
+                __m512i v = _mm512_loadu_si512((const void *)(p + i));
+                __m512i t = _mm512_add_epi64(_mm512_slli_epi64(_mm512_and_si512(v, _m16), 14), _mm512_and_si512(_mm512_srli_epi64(v, 30), _m14));
+                t = _mm512_slli_epi64(t, 4);
+                if constexpr (w_tot) t = _mm512_sub_epi64(t, _mm512_and_si512(_mm512_srli_epi64(v, 16), _m4));
+
+                __m512i d = _mm512_and_si512(_mm512_sub_epi64(t, _rise), _mask); // 0 <= d < 2^34
+                t = _mm512_add_epi64(_rise, d);
+                __m512d q = _mm512_div_pd(_mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(d, _magic_i)), _magic_d), _dt_d);
+                __mmask8 keep = _mm512_cmp_pd_mask(q, _nx_d, _CMP_LT_OQ);
+                if (!keep) continue;
+
+                __m512i pp = _mm512_maskz_mov_epi64(keep, _mm512_cvtepi32_epi64(_mm512_cvttpd_epi32(q)));
+                __m512i rem = _mm512_sub_epi64(d, _mm512_mul_epu32(pp, _dt));
+                pp = _mm512_mask_sub_epi64(pp, _mm512_cmplt_epi64_mask(rem, _mm512_setzero_si512()), pp, _one);
+                pp = _mm512_mask_add_epi64(pp, _mm512_cmpge_epi64_mask(rem, _dt), pp, _one);
+                keep &= _mm512_cmplt_epi64_mask(pp, _nx);
+
+                __m512i pack = _mm512_srli_epi64(v, 44);
+                __m512i x = _mm512_add_epi64(_mm512_srli_epi64(_mm512_and_si512(pack, _mm512_set1_epi64(0x0FE00)), 8), _mm512_srli_epi64(_mm512_and_si512(pack, _mm512_set1_epi64(0x00007)), 2));
+                __m512i y = _mm512_add_epi64(_mm512_srli_epi64(_mm512_and_si512(pack, _mm512_set1_epi64(0x001F8)), 1), _mm512_and_si512(pack, _mm512_set1_epi64(0x00003)));
+                x = _mm512_add_epi64(_mm512_sub_epi64(_mm512_xor_si512(x, _sign), _sign), _bx);
+                y = _mm512_add_epi64(_mm512_sub_epi64(_mm512_xor_si512(y, _sign), _sign), _by);
+
+                _mm512_store_si512((void *)l_pp, pp);
+                _mm512_store_si512((void *)l_toa, t);
+                _mm512_store_si512((void *)l_kx, x);
+                _mm512_store_si512((void *)l_ky, y);
+                if constexpr (w_tot) _mm512_store_si512((void *)l_tot, _mm512_and_si512(_mm512_srli_epi64(v, 16 + 4), _m10));
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    if ((keep >> lane) & 1) batch.push_back(l_pp[lane] + r.line_offset, l_kx[lane], l_ky[lane], r.id_image, l_toa[lane], w_tot ? l_tot[lane] : 0);
+                }
+            }
+        }
+        for (; i < n; i++) decode_event<w_tot>(p[i], r, batch);
+    };
+#endif
+
+    typedef size_t (*run_length_fn)(const uint64_t *p, size_t n);
+    typedef void (*decode_fn)(const uint64_t *p, size_t n, const run_parameters &r, EventBatch &batch);
+
+    // selected once when the module is loaded
+#if defined(EVENTEM_X86)
+    inline const run_length_fn event_run_length = CPU::select<run_length_fn>(
+        {event_run_length_scalar, nullptr, event_run_length_avx2, event_run_length_avx512, nullptr});
+
+    template <bool w_tot>
+    inline const decode_fn decode_events = CPU::select<decode_fn>(
+        {decode_events_scalar<w_tot>, nullptr, decode_events_avx2<w_tot>, decode_events_avx512<w_tot>, nullptr});
+#else
+    #if defined(EVENTEM_NEON)
+    inline const run_length_fn event_run_length = CPU::select<run_length_fn>(
+        {event_run_length_scalar, nullptr, nullptr, nullptr, event_run_length_neon});
+    #else
+    inline const run_length_fn event_run_length = event_run_length_scalar;
+    #endif
+
+    template <bool w_tot>
+    inline const decode_fn decode_events = decode_events_scalar<w_tot>;
+#endif
+}
+
+#endif // TPX3DECODER_H
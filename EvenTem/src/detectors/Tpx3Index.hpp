@@ -0,0 +1,226 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef TPX3_INDEX_HPP
+#define TPX3_INDEX_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+// Complete decoder state between two buffers. Decoding a buffer only depends on this state, so a
+// copy taken before a buffer (a checkpoint) is enough to decode that buffer on any thread, or to
+// start decoding a file at that buffer (Tpx3Index).
+struct state_after_buffer
+{
+    // rollover: last TDC or global time of the stream, unwrapped (TDC units, 3.125 ns)
+    uint64_t time_ref = 0;
+    uint64_t toa_period = 0; // ToA rollovers seen (the time packets of the chips interleave)
+
+    // TDC
+    int chip_id = 0;
+    uint64_t rise_t[4] = {0, 0, 0, 0};
+    uint64_t fall_t[4] = {0, 0, 0, 0};
+    bool rise_fall[4] = {false, false, false, false};
+    int line_count[4] = {0, 0, 0, 0};
+    int most_advanced_line = 0;
+    uint64_t dt = 0;
+
+    // scan position
+    uint64_t current_line = 0;
+    uint16_t id_image = 0;
+    bool repetitions_reached = false;
+};
+
+// Sidecar index of a .tpx3 file (<file>.idx): the byte offset and the decoder state of the first
+// buffer boundary of every scan line. With it a run starts decoding right before a given line,
+// repetition or ROI instead of at the start of the file. CHEETAH fills the index while it decodes,
+// on the first run over a file or while a socket stream is recorded, and extends it whenever a
+// later run gets further into the file. One entry per line is ~150 bytes, 20 MB for 500
+// repetitions of 256 lines. The states are stored as they are in memory: an index written by a
+// different build (state layout) or for another scan size is ignored and built again. The index
+// also holds a hash of the first buffer of the data, so that an index left over from a different
+// recording under the same name is not used for it.
+class Tpx3Index
+{
+public:
+    struct entry
+    {
+        uint64_t offset;          // of the buffer in the file
+        state_after_buffer state; // before that buffer
+    };
+
+    // the settings the states depend on
+    struct layout
+    {
+        uint64_t buffer_bytes;
+        uint64_t nx;
+        uint64_t ny;
+    };
+
+    std::vector<entry> entries;
+    uint64_t next_offset = 0; // every buffer boundary before this one has been visited
+    uint64_t data_hash = 0;   // of the first buffer of the data
+    bool b_changed = false;
+
+    static std::string path_for(const std::string &data_path)
+    {
+        return data_path + ".idx";
+    };
+
+    void clear(const layout &_l)
+    {
+        l = _l;
+        entries.clear();
+        next_offset = 0;
+        data_hash = 0;
+        b_changed = false;
+    };
+
+    // FNV-1a
+    static uint64_t hash(const char *data, size_t size)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < size; i++) h = (h ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+        return h;
+    };
+
+    // called for every decoded buffer (buffer_bytes at data), in order, with the decoder state before it
+    void visit(uint64_t offset, const state_after_buffer &s, const char *data)
+    {
+        if ((offset != next_offset) || s.repetitions_reached) return; // indexed already, or past the scan
+        if (offset == 0) data_hash = hash(data, l.buffer_bytes);
+        int line = last_line(s);
+        if ((line > 0) && (entries.empty() || (line > last_line(entries.back().state))))
+        {
+            entries.push_back({offset, s});
+        }
+        next_offset += l.buffer_bytes;
+        b_changed = true;
+    };
+
+    // the last entry before the TDC rise of the line on any chip, nullptr to start at the
+    // beginning of the file
+    const entry *find(int line) const
+    {
+        auto it = std::upper_bound(entries.begin(), entries.end(), line,
+            [](int _line, const entry &e) { return _line <= last_line(e.state); });
+        return (it == entries.begin()) ? nullptr : &*(it - 1);
+    };
+
+    // false if there is no index for this layout, or for this data file (data_path, data_size
+    // bytes), or the file is shorter than the indexed part
+    bool load(const std::string &path, const layout &_l, const std::string &data_path, uint64_t data_size)
+    {
+        clear(_l);
+        std::ifstream f(path, std::ios::in | std::ios::binary);
+        if (!f.is_open()) return false;
+        file_header h;
+        f.read((char *)&h, sizeof(h));
+        if ((!f) || (h.magic != magic) || (h.version != version) || (h.state_bytes != sizeof(state_after_buffer)) ||
+            (h.buffer_bytes != l.buffer_bytes) || (h.nx != l.nx) || (h.ny != l.ny) || (h.next_offset > data_size + l.buffer_bytes))
+        {
+            std::cout << "Tpx3Index: " << path << " does not match the data, building it again" << std::endl;
+            return false;
+        }
+        if (h.data_hash != hash_file(data_path))
+        {
+            std::cout << "Tpx3Index: " << path << " was built for a different " << data_path << ", building it again" << std::endl;
+            return false;
+        }
+        entries.resize(h.n_entries);
+        f.read((char *)entries.data(), h.n_entries * sizeof(entry));
+        if (!f)
+        {
+            std::cout << "Tpx3Index: " << path << " is truncated, building it again" << std::endl;
+            entries.clear();
+            return false;
+        }
+        next_offset = h.next_offset;
+        data_hash = h.data_hash;
+        return true;
+    };
+
+    // written to a temporary file first, a reader never sees half an index
+    bool save(const std::string &path)
+    {
+        std::string tmp_path = path + ".tmp";
+        {
+            std::ofstream f(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!f.is_open())
+            {
+                std::cout << "Tpx3Index: Error opening " << tmp_path << "!" << std::endl;
+                return false;
+            }
+            file_header h = {magic, version, sizeof(state_after_buffer), l.buffer_bytes, l.nx, l.ny, next_offset, entries.size(), data_hash};
+            f.write((const char *)&h, sizeof(h));
+            f.write((const char *)entries.data(), entries.size() * sizeof(entry));
+            if (!f)
+            {
+                std::cout << "Tpx3Index: Error writing " << tmp_path << "!" << std::endl;
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec)
+        {
+            std::cout << "Tpx3Index: Error writing " << path << ": " << ec.message() << std::endl;
+            return false;
+        }
+        b_changed = false;
+        return true;
+    };
+
+private:
+    static constexpr uint64_t magic = 0x3158444933585054; // "TPX3IDX1"
+    static constexpr uint64_t version = 2;
+
+    struct file_header
+    {
+        uint64_t magic;
+        uint64_t version;
+        uint64_t state_bytes;
+        uint64_t buffer_bytes;
+        uint64_t nx;
+        uint64_t ny;
+        uint64_t next_offset;
+        uint64_t n_entries;
+        uint64_t data_hash;
+    };
+
+    layout l = {0, 0, 0};
+
+    // hash of the first buffer of the file, zero padded like the detector reads a short file
+    uint64_t hash_file(const std::string &data_path) const
+    {
+        std::vector<char> first(l.buffer_bytes, 0);
+        std::ifstream f(data_path, std::ios::in | std::ios::binary);
+        f.read(first.data(), first.size());
+        return hash(first.data(), first.size());
+    };
+
+    // line_count is the number of TDC falls: a chip with line_count < line has not started it
+    static int last_line(const state_after_buffer &s)
+    {
+        return std::max({s.line_count[0], s.line_count[1], s.line_count[2], s.line_count[3]});
+    };
+};
+
+#endif // TPX3_INDEX_HPP
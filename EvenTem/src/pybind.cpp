@@ -27,6 +27,11 @@
 #include "Electron.h"
 #include "EELS.h"
 #include "FourD.h"
+#include "ReplayServer.h"
+#include "DataGenerator.h"
+#include "CpuDispatch.h"
+#include "BufferArena.h"
+#include "ScanPattern.h"
 
 #ifdef GPRI_OPTION_ENABLED
         #include "GPRI.h"
@@ -44,6 +49,55 @@ namespace py = pybind11;
 
 PYBIND11_MODULE(MODULE_NAME, m) {
 
+        // instruction set of the dispatched kernels, chosen when the module is loaded
+        m.def("cpu_features", &CPU::features);
+        // detector buffers are kept for the next run, this gives the idle ones back to the OS
+        m.def("free_buffers", []() { return BufferArena::instance().trim(); });
+        m.def("buffer_bytes", []() { return std::make_pair(BufferArena::instance().bytes_in_use(), BufferArena::instance().bytes_idle()); });
+
+        py::class_<ScanPattern>(m, "ScanPattern")
+        .def(py::init<>())
+        .def_static("raster", &ScanPattern::raster, py::arg("nx"), py::arg("ny"))
+        .def_static("serpentine", &ScanPattern::serpentine, py::arg("nx"), py::arg("ny"))
+        .def_static("spiral", &ScanPattern::spiral, py::arg("nx"), py::arg("ny"))
+        .def_static("random_sparse", &ScanPattern::random_sparse, py::arg("nx"), py::arg("ny"), py::arg("fraction"), py::arg("seed") = 0)
+        .def_static("subsampled", &ScanPattern::subsampled, py::arg("nx"), py::arg("ny"), py::arg("step_x"), py::arg("step_y"))
+        .def_static("from_positions", &ScanPattern::from_positions, py::arg("nx"), py::arg("ny"), py::arg("positions"))
+        .def("load", &ScanPattern::load, py::arg("path"), py::arg("nx"), py::arg("ny"))
+        .def("save", &ScanPattern::save, py::arg("path"))
+        .def("positions", &ScanPattern::positions)
+        .def("__len__", &ScanPattern::size)
+        .def_readonly("nx", &ScanPattern::nx)
+        .def_readonly("ny", &ScanPattern::ny);
+
+        py::class_<PipelineMetrics::Snapshot>(m, "PipelineMetrics")
+        .def_readonly("time", &PipelineMetrics::Snapshot::time)
+        .def_readonly("interval", &PipelineMetrics::Snapshot::interval)
+        .def_readonly("bytes_read", &PipelineMetrics::Snapshot::bytes_read)
+        .def_readonly("buffers_filled", &PipelineMetrics::Snapshot::buffers_filled)
+        .def_readonly("buffers_processed", &PipelineMetrics::Snapshot::buffers_processed)
+        .def_readonly("ring_occupancy", &PipelineMetrics::Snapshot::ring_occupancy)
+        .def_readonly("ring_capacity", &PipelineMetrics::Snapshot::ring_capacity)
+        .def_readonly("reader_waits", &PipelineMetrics::Snapshot::reader_waits)
+        .def_readonly("decoder_waits", &PipelineMetrics::Snapshot::decoder_waits)
+        .def_readonly("events_decoded", &PipelineMetrics::Snapshot::events_decoded)
+        .def_readonly("events_accepted", &PipelineMetrics::Snapshot::events_accepted)
+        .def_readonly("events_out_of_scan", &PipelineMetrics::Snapshot::events_out_of_scan)
+        .def_readonly("frames_processed", &PipelineMetrics::Snapshot::frames_processed)
+        .def_readonly("positions_processed", &PipelineMetrics::Snapshot::positions_processed)
+        .def_readonly("line_decoded", &PipelineMetrics::Snapshot::line_decoded)
+        .def_readonly("line_processed", &PipelineMetrics::Snapshot::line_processed)
+        .def_readonly("socket_bytes_received", &PipelineMetrics::Snapshot::socket_bytes_received)
+        .def_readonly("socket_bytes_buffered", &PipelineMetrics::Snapshot::socket_bytes_buffered)
+        .def_readonly("read_rate", &PipelineMetrics::Snapshot::read_rate)
+        .def_readonly("event_rate", &PipelineMetrics::Snapshot::event_rate)
+        .def_readonly("frame_rate", &PipelineMetrics::Snapshot::frame_rate)
+        .def_readonly("socket_rate", &PipelineMetrics::Snapshot::socket_rate)
+        .def_readonly("read_busy", &PipelineMetrics::Snapshot::read_busy)
+        .def_readonly("decode_busy", &PipelineMetrics::Snapshot::decode_busy)
+        .def_readonly("process_busy", &PipelineMetrics::Snapshot::process_busy)
+        .def_readonly("bottleneck", &PipelineMetrics::Snapshot::bottleneck);
+
         py::class_<LiveProcessor>(m, "LiveProcessor")
         .def_readwrite("nx", &LiveProcessor::nx)
         .def_readwrite("ny", &LiveProcessor::ny)
@@ -53,6 +107,20 @@ PYBIND11_MODULE(MODULE_NAME, m) {
         .def("accept_socket", &LiveProcessor::accept_socket)
         .def("close_socket", &LiveProcessor::close_socket)
         .def_readwrite("n_threads", &LiveProcessor::n_threads)
+        .def_readwrite("n_decode_threads", &LiveProcessor::n_decode_threads)
+        .def_readwrite("b_busy_poll", &LiveProcessor::b_busy_poll)
+        .def_readwrite("b_read_ahead", &LiveProcessor::b_read_ahead)
+        .def_readwrite("b_direct_io", &LiveProcessor::b_direct_io)
+        .def_readwrite("b_index", &LiveProcessor::b_index)
+        .def_readwrite("first_line", &LiveProcessor::first_line)
+        .def_readwrite("end_line", &LiveProcessor::end_line)
+        .def_readwrite("experimental_t3r", &LiveProcessor::b_experimental_t3r)
+        .def("set_line_range", &LiveProcessor::set_line_range, py::arg("first"), py::arg("end"))
+        .def("set_repetition", &LiveProcessor::set_repetition)
+        .def_property("socket_rcvbuf", [](LiveProcessor &p) { return p.socket.rcvbuf_size; }, [](LiveProcessor &p, int size) { p.socket.rcvbuf_size = size; })
+        .def_property("socket_ring_size", [](LiveProcessor &p) { return p.socket.receive_ring_size; }, [](LiveProcessor &p, size_t size) { p.socket.receive_ring_size = size; })
+        .def_property("record_file", [](LiveProcessor &p) { return p.socket.record_path; }, [](LiveProcessor &p, std::string path) { p.socket.record_path = path; })
+        .def_property("record_compression", [](LiveProcessor &p) { return p.socket.record_compression; }, [](LiveProcessor &p, int level) { p.socket.record_compression = level; })
         .def_readwrite("file_path", &LiveProcessor::file_path)
         .def_readwrite("repetitions", &LiveProcessor::rep)
         .def("set_dwell_time", &LiveProcessor::set_dwell_time)
@@ -63,7 +131,11 @@ PYBIND11_MODULE(MODULE_NAME, m) {
         .def_readonly("elapsed_seconds", &LiveProcessor::elapsed_seconds_vec)
         .def_readonly("reached_pp_id", &LiveProcessor::reached_pp_id)
         .def("set_pattern_file", &LiveProcessor::set_pattern_file)
+        .def_readwrite("scan_pattern", &LiveProcessor::scan_pattern)
         .def_readonly("processing_rate", &LiveProcessor::processing_rate)
+        .def("metrics", &LiveProcessor::sample_metrics, py::call_guard<py::gil_scoped_release>())
+        .def_property("trace_file", [](LiveProcessor &p) { return p.tracer.path; }, [](LiveProcessor &p, std::string path) { p.tracer.path = path; })
+        .def("latency_report", [](LiveProcessor &p) { return p.tracer.report(); })
         .def("set_file", &LiveProcessor::set_file);
 
 
@@ -200,4 +272,60 @@ PYBIND11_MODULE(MODULE_NAME, m) {
         .def("run", &EELS::run)
         .def_readonly("EELS_data", &EELS::EELS_data);
 
+        py::class_<ReplayServer>(m, "ReplayServer")
+        .def(py::init<>())
+        .def_readwrite("file_path", &ReplayServer::file_path)
+        .def_readwrite("ip", &ReplayServer::ip)
+        .def_readwrite("port", &ReplayServer::port)
+        .def_readwrite("rate", &ReplayServer::rate)
+        .def_readwrite("frame_rate", &ReplayServer::frame_rate)
+        .def_readwrite("burst_size", &ReplayServer::burst_size)
+        .def_readwrite("burst_pause", &ReplayServer::burst_pause)
+        .def_readwrite("repetitions", &ReplayServer::repetitions)
+        .def("start_cheetah", &ReplayServer::start_cheetah)
+        .def("start_merlin", &ReplayServer::start_merlin)
+        .def("stop", &ReplayServer::stop, py::call_guard<py::gil_scoped_release>())
+        .def("wait", &ReplayServer::wait, py::call_guard<py::gil_scoped_release>())
+        .def("is_running", &ReplayServer::is_running)
+        .def_property_readonly("bytes_sent", [](ReplayServer &r) { return r.bytes_sent.load(); })
+        .def_property_readonly("frames_sent", [](ReplayServer &r) { return r.frames_sent.load(); })
+        .def_readonly("elapsed_seconds", &ReplayServer::elapsed_seconds);
+
+        py::class_<Scene>(m, "Scene")
+        .def(py::init<>())
+        .def_readwrite("nx", &Scene::nx)
+        .def_readwrite("ny", &Scene::ny)
+        .def_readwrite("detector_size", &Scene::n_cam)
+        .def_readwrite("dose", &Scene::dose)
+        .def_readwrite("disk_radius", &Scene::disk_radius)
+        .def_readwrite("center_x", &Scene::center_x)
+        .def_readwrite("center_y", &Scene::center_y)
+        .def_readwrite("deflection", &Scene::deflection)
+        .def_readwrite("background", &Scene::background)
+        .def_readwrite("seed", &Scene::seed);
+
+        py::class_<DataGenerator>(m, "DataGenerator")
+        .def(py::init<>())
+        .def_readwrite("scene", &DataGenerator::scene)
+        .def_readwrite("repetitions", &DataGenerator::repetitions)
+        .def_readwrite("dwell_time", &DataGenerator::dwell_time)
+        .def_readwrite("flyback_time", &DataGenerator::flyback_time)
+        .def_readwrite("start_time", &DataGenerator::start_time)
+        .def_readwrite("chunk_packets", &DataGenerator::chunk_packets)
+        .def_readwrite("global_time_interval", &DataGenerator::global_time_interval)
+        .def_readwrite("extra_lines", &DataGenerator::extra_lines)
+        .def_readwrite("merlin_dtype", &DataGenerator::merlin_dtype)
+        .def("write_tpx3", &DataGenerator::write_tpx3, py::call_guard<py::gil_scoped_release>())
+        .def("write_merlin", &DataGenerator::write_merlin, py::call_guard<py::gil_scoped_release>())
+        .def("write_npy", &DataGenerator::write_npy, py::arg("path"), py::arg("u16") = false, py::call_guard<py::gil_scoped_release>())
+        .def("write_electron", &DataGenerator::write_electron, py::call_guard<py::gil_scoped_release>())
+        .def("write_advapix", &DataGenerator::write_advapix, py::call_guard<py::gil_scoped_release>())
+        .def("write_advaraw", &DataGenerator::write_advaraw, py::call_guard<py::gil_scoped_release>())
+        .def("tpx3", [](DataGenerator &g) { auto v = g.tpx3(); return py::bytes(v.data(), v.size()); })
+        .def("merlin", [](DataGenerator &g) { auto v = g.merlin(); return py::bytes(v.data(), v.size()); })
+        .def("npy", [](DataGenerator &g, bool u16) { auto v = g.npy(u16); return py::bytes(v.data(), v.size()); }, py::arg("u16") = false)
+        .def("electron", [](DataGenerator &g) { auto v = g.electron(); return py::bytes(v.data(), v.size()); })
+        .def("advapix", [](DataGenerator &g) { auto v = g.advapix(); return py::bytes(v.data(), v.size()); })
+        .def("advaraw", [](DataGenerator &g) { auto v = g.advaraw(); return py::bytes(v.data(), v.size()); });
+
 }
@@ -0,0 +1,88 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef ACCUMULATORSHARD_HPP
+#define ACCUMULATORSHARD_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+// Private accumulator of one worker thread. The image is stored as rows (scan lines, or whole
+// detector images per id_image) that are allocated on first touch, so a shard only holds the rows
+// its events hit. reduce() hands every touched row to the owner, who adds it to the shared image,
+// and zeroes the rows for reuse without freeing them.
+template <typename T>
+class AccumulatorShard
+{
+private:
+    size_t row_length = 0;
+    std::unordered_map<uint64_t, size_t> rows; // row key -> index in storage
+    std::vector<std::vector<T>> storage;
+    size_t n_used = 0;
+    uint64_t last_key = UINT64_MAX;
+    T *last_row = nullptr;
+
+public:
+    inline T *row(uint64_t key)
+    {
+        if (key == last_key) return last_row;
+        auto it = rows.find(key);
+        if (it == rows.end())
+        {
+            if (n_used == storage.size()) storage.emplace_back(row_length, 0);
+            it = rows.emplace(key, n_used++).first;
+        }
+        last_key = key;
+        last_row = storage[it->second].data();
+        return last_row;
+    };
+
+    inline void add(uint64_t key, size_t col, T value)
+    {
+        row(key)[col] += value;
+    };
+
+    // calls fn(key, const T *row) for every touched row, then clears the shard
+    template <typename Fn>
+    void reduce(Fn &&fn)
+    {
+        for (auto &r : rows)
+        {
+            std::vector<T> &data = storage[r.second];
+            fn(r.first, (const T *)data.data());
+            std::fill(data.begin(), data.end(), 0);
+        }
+        rows.clear();
+        n_used = 0;
+        last_key = UINT64_MAX;
+        last_row = nullptr;
+    };
+
+    bool empty() const { return rows.empty(); };
+    size_t get_row_length() const { return row_length; };
+
+    void init(size_t _row_length)
+    {
+        row_length = _row_length;
+        rows.clear();
+        storage.clear();
+        n_used = 0;
+        last_key = UINT64_MAX;
+        last_row = nullptr;
+    };
+};
+
+#endif // ACCUMULATORSHARD_HPP
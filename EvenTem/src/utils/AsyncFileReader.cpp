@@ -0,0 +1,170 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "AsyncFileReader.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define DIRECT_IO_ALIGNMENT 4096
+
+bool AsyncFileReader::open(const std::filesystem::path &path, std::uintmax_t _file_size)
+{
+#ifndef _WIN32
+    close();
+    file_size = _file_size;
+    chunk_size = std::max<size_t>(chunk_size / DIRECT_IO_ALIGNMENT, 1) * DIRECT_IO_ALIGNMENT;
+    b_direct = false;
+    #ifdef O_DIRECT
+    if (direct_io)
+    {
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+        b_direct = (fd >= 0);
+        if (!b_direct) std::cout << "AsyncFileReader::open(): O_DIRECT not supported, using the page cache" << std::endl;
+    }
+    #endif
+    if (fd < 0) fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cout << "AsyncFileReader::open(): Error opening file!" << std::endl;
+        return false;
+    }
+    #ifdef POSIX_FADV_SEQUENTIAL
+    if (!b_direct) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    #endif
+
+    chunks.assign(depth, Chunk());
+    for (auto &c : chunks) c.data = static_cast<char *>(std::aligned_alloc(DIRECT_IO_ALIGNMENT, chunk_size));
+    base = 0;
+    skip = 0;
+    n_issued = 0;
+    n_consumed = 0;
+    n_loading = 0;
+    b_running = true;
+    for (int i = 0; i < n_threads; i++) threads.push_back(std::thread(&AsyncFileReader::loader, this));
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AsyncFileReader::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        b_running = false;
+    }
+    cnd_free.notify_all();
+    for (auto &t : threads) t.join();
+    threads.clear();
+    for (auto &c : chunks) std::free(c.data);
+    chunks.clear();
+#ifndef _WIN32
+    if (fd >= 0) ::close(fd);
+#endif
+    fd = -1;
+}
+
+// Loaders take the next chunk as long as fewer than 'depth' chunks are ahead of the consumer
+void AsyncFileReader::loader()
+{
+#ifndef _WIN32
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true)
+    {
+        cnd_free.wait(lock, [this]{ return (!b_running) || ((!b_seeking) && (n_issued - n_consumed < (uint64_t)depth) && (base + n_issued * chunk_size < file_size)); });
+        if (!b_running) return;
+        uint64_t seq = n_issued++;
+        Chunk &c = chunks[seq % depth];
+        std::uintmax_t offset = base + seq * chunk_size;
+        ++n_loading;
+        lock.unlock();
+
+        size_t n = 0;
+        while (n < chunk_size)
+        {
+            ssize_t r = pread(fd, c.data + n, chunk_size - n, offset + n);
+            if (r <= 0) break;
+            n += r;
+            if (b_direct && (n % DIRECT_IO_ALIGNMENT)) break; // short read at the end of the file
+        }
+
+        lock.lock();
+        c.size = n;
+        c.ready = true;
+        --n_loading;
+        cnd_loaded.notify_all();
+    }
+#endif
+}
+
+void AsyncFileReader::drop_behind(uint64_t seq)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    if (!b_direct) posix_fadvise(fd, base + seq * chunk_size, chunk_size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+size_t AsyncFileReader::read(char *buffer, size_t data_size)
+{
+    size_t n_read = 0;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (n_read < data_size)
+    {
+        if (base + n_consumed * chunk_size >= file_size) break;
+        Chunk &c = chunks[n_consumed % depth];
+        cnd_loaded.wait(lock, [&c]{ return c.ready; });
+        size_t n = (c.size > skip) ? std::min(data_size - n_read, c.size - skip) : 0;
+        lock.unlock();
+        std::memcpy(buffer + n_read, c.data + skip, n);
+        lock.lock();
+        n_read += n;
+        skip += n;
+        if (skip < c.size) continue;
+        // chunk done, a short one is the end of the file
+        drop_behind(n_consumed);
+        c.ready = false;
+        ++n_consumed;
+        skip = 0;
+        cnd_free.notify_all();
+        if (c.size < chunk_size) break;
+    }
+    return n_read;
+}
+
+void AsyncFileReader::seek(std::uintmax_t pos)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    // hold back the loaders and wait for the reads in flight, then restart ahead of pos
+    b_seeking = true;
+    cnd_loaded.wait(lock, [this]{ return n_loading == 0; });
+    for (auto &c : chunks) c.ready = false;
+    base = pos / chunk_size * chunk_size;
+    skip = pos - base;
+    n_issued = 0;
+    n_consumed = 0;
+    b_seeking = false;
+    cnd_free.notify_all();
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    close();
+}
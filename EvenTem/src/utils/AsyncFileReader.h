@@ -0,0 +1,75 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef ASYNC_FILE_READER_H
+#define ASYNC_FILE_READER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+// Sequential reader that keeps 'depth' chunks of 'chunk_size' bytes in flight. A few threads
+// pread() the chunks ahead of the consumer, so the device sees a deep queue of large aligned
+// reads. Consumed chunks are dropped from the page cache (posix_fadvise DONTNEED), or the page
+// cache is bypassed completely with direct_io (O_DIRECT), so scanning a file much larger than
+// the memory does not evict everything else.
+class AsyncFileReader
+{
+public:
+    size_t chunk_size = 8 << 20;
+    int depth = 8;
+    int n_threads = 2;
+    bool direct_io = false;
+
+    bool open(const std::filesystem::path &path, std::uintmax_t file_size);
+    void close();
+    size_t read(char *buffer, size_t data_size); // blocks until the data is loaded, returns bytes copied
+    void seek(std::uintmax_t pos);
+    bool is_open() const { return fd >= 0; };
+
+    AsyncFileReader() {};
+    ~AsyncFileReader();
+
+private:
+    struct Chunk
+    {
+        char *data = nullptr;
+        size_t size = 0;
+        bool ready = false;
+    };
+
+    int fd = -1;
+    bool b_direct = false;
+    std::uintmax_t file_size = 0;
+    std::uintmax_t base = 0;    // file offset of chunk 0, aligned to the chunk size
+    size_t skip = 0;            // bytes of chunk n_consumed that were already read
+    uint64_t n_issued = 0;      // chunks handed to the loaders
+    uint64_t n_consumed = 0;    // chunks fully read by the consumer
+    int n_loading = 0;
+    bool b_running = false;
+    bool b_seeking = false;
+    std::vector<Chunk> chunks;
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cnd_loaded;
+    std::condition_variable cnd_free;
+
+    void loader();
+    void drop_behind(uint64_t seq);
+};
+#endif // ASYNC_FILE_READER_H
@@ -16,6 +16,10 @@ struct atomwrapper
     :_a()
   {}
 
+  atomwrapper(T v)
+    :_a(v)
+  {}
+
   atomwrapper(const std::atomic<T> &a)
     :_a(a.load())
   {}
@@ -27,6 +31,13 @@ struct atomwrapper
   atomwrapper &operator=(const atomwrapper &other)
   {
     _a.store(other._a.load());
+    return *this;
+  }
+
+  atomwrapper &operator+=(T v)
+  {
+    _a.fetch_add(v);
+    return *this;
   }
 
   // Overload for ++ operator
@@ -47,6 +58,11 @@ struct atomwrapper
   {
     return _a.load();
   }
+
+  void store(T v)
+  {
+    _a.store(v);
+  }
 };
 
 #endif // ATOMICWRAPPER_H
\ No newline at end of file
@@ -1,12 +1,12 @@
 /* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
- * University of Antwerp - All Rights Reserved. 
+ * University of Antwerp - All Rights Reserved.
  * You may use, distribute and modify
  * this code under the terms of the GPL3 license.
  * You should have received a copy of the GPL3 license with
- * this file. If not, please visit: 
+ * this file. If not, please visit:
  * https://www.gnu.org/licenses/gpl-3.0.en.html
- * 
- * Authors: 
+ *
+ * Authors:
  *   Thomas Friedrich <>
  *   Chu-Ping Yu <>
  *   Arno Annys <arno.annys@uantwerpen.be>
@@ -16,65 +16,278 @@
 #define BOUNDED_THREAD_POOL_H
 
 #include <thread>
-#include <queue>
-#include <functional>
+#include <vector>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <iostream>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <new>
 
+// Tasks that can be waited for independently of the rest of the pool
+class TaskGroup
+{
+private:
+    std::atomic<int> n_pending{0};
+    std::mutex mtx;
+    std::condition_variable cnd;
+
+    friend class BoundedThreadPool;
+
+    inline void add() { ++n_pending; };
+
+    inline void done()
+    {
+        if (--n_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            cnd.notify_all();
+        }
+    };
+
+public:
+    // blocks until every task pushed with this group has finished running
+    void wait()
+    {
+        if (n_pending.load() == 0) return;
+        std::unique_lock<std::mutex> lock(mtx);
+        cnd.wait(lock, [this] { return n_pending.load() == 0; });
+    };
+};
+
+// Fixed size task slot. Callables up to inline_size bytes are stored in place, so pushing a
+// task does not allocate; larger ones fall back to the heap.
+class PoolTask
+{
+private:
+    static constexpr size_t inline_size = 64;
+    alignas(std::max_align_t) unsigned char storage[inline_size];
+    void (*p_invoke)(void *) = nullptr;
+    void (*p_relocate)(void *, void *) = nullptr; // move from src to dst, destroys src
+    void (*p_destroy)(void *) = nullptr;
+
+    template <typename Fn>
+    static constexpr bool fits_inline()
+    {
+        return (sizeof(Fn) <= inline_size) && (alignof(Fn) <= alignof(std::max_align_t)) && std::is_nothrow_move_constructible<Fn>::value;
+    };
+
+public:
+    TaskGroup *group = nullptr;
+
+    template <typename F>
+    void set(F &&f, TaskGroup *_group)
+    {
+        using Fn = typename std::decay<F>::type;
+        reset();
+        group = _group;
+        if constexpr (fits_inline<Fn>())
+        {
+            new (storage) Fn(std::forward<F>(f));
+            p_invoke = [](void *p) { (*static_cast<Fn *>(p))(); };
+            p_relocate = [](void *dst, void *src) { new (dst) Fn(std::move(*static_cast<Fn *>(src))); static_cast<Fn *>(src)->~Fn(); };
+            p_destroy = [](void *p) { static_cast<Fn *>(p)->~Fn(); };
+        }
+        else
+        {
+            new (storage) Fn *(new Fn(std::forward<F>(f)));
+            p_invoke = [](void *p) { (**static_cast<Fn **>(p))(); };
+            p_relocate = [](void *dst, void *src) { new (dst) Fn *(*static_cast<Fn **>(src)); };
+            p_destroy = [](void *p) { delete *static_cast<Fn **>(p); };
+        }
+    };
+
+    inline void operator()() { p_invoke(storage); };
+
+    inline bool empty() const { return p_invoke == nullptr; };
+
+    void reset()
+    {
+        if (p_destroy) p_destroy(storage);
+        p_invoke = nullptr;
+        p_relocate = nullptr;
+        p_destroy = nullptr;
+        group = nullptr;
+    };
+
+    PoolTask() {};
+    PoolTask(const PoolTask &) = delete;
+    PoolTask &operator=(const PoolTask &) = delete;
+    PoolTask &operator=(PoolTask &&other) noexcept
+    {
+        if (this == &other) return *this;
+        reset();
+        if (other.p_relocate) other.p_relocate(storage, other.storage);
+        p_invoke = other.p_invoke;
+        p_relocate = other.p_relocate;
+        p_destroy = other.p_destroy;
+        group = other.group;
+        other.p_invoke = nullptr;
+        other.p_relocate = nullptr;
+        other.p_destroy = nullptr;
+        other.group = nullptr;
+        return *this;
+    };
+    ~PoolTask() { reset(); };
+};
+
+// Work-stealing pool. Every worker owns a fixed ring of task slots; submitted tasks are dealt
+// round-robin over the workers, a worker runs its own tasks in submission order and steals from
+// the back of the others when it runs dry. At most 'limit' tasks are queued at a time, push_task
+// blocks (try_push_task returns false) when that bound is reached. wait_for_completion waits
+// until every task has finished running, not only until the queues are empty.
 class BoundedThreadPool
 {
 private:
+    struct Worker
+    {
+        std::mutex mtx;
+        std::vector<PoolTask> slots;
+        size_t head = 0;
+        size_t n = 0;
+    };
+
     std::vector<std::thread> threads;
-    std::queue<std::function<void()>> tasks;
+    std::vector<std::unique_ptr<Worker>> workers;
     std::atomic<bool> b_running;
-    std::mutex mtx_queue_full;
-    std::mutex mtx_queue_empty;
-    std::condition_variable cnd_buffer_full;
-    std::condition_variable cnd_buffer_empty;
+    std::atomic<int> n_queued{0};  // reserved slots, bounded by limit
+    std::atomic<int> n_ready{0};   // tasks sitting in a worker ring
+    std::atomic<int> n_pending{0}; // queued or running
+    std::atomic<int> n_idle{0};
+    std::atomic<int> n_submit_waiting{0};
+    std::atomic<unsigned> next_worker{0};
+    std::mutex mtx_idle;
+    std::condition_variable cnd_idle;
+    std::mutex mtx_space;
+    std::condition_variable cnd_space;
+    std::mutex mtx_done;
+    std::condition_variable cnd_done;
 
     void create_threads()
     {
+        workers.clear();
+        for (int i = 0; i < n_threads; i++)
+        {
+            workers.emplace_back(new Worker);
+            workers.back()->slots = std::vector<PoolTask>(limit);
+        }
         for (int i = 0; i < n_threads; i++)
         {
-            threads.push_back(std::thread(&BoundedThreadPool::worker, this));
+            threads.push_back(std::thread(&BoundedThreadPool::worker, this, i));
         }
         std::cout << "Created " << n_threads << " threads." << std::endl;
     }
 
-    inline void execute_task(std::unique_lock<std::mutex> *lock)
+    inline bool reserve_slot()
+    {
+        int n = n_queued.load();
+        while (n < limit)
+        {
+            if (n_queued.compare_exchange_weak(n, n + 1)) return true;
+        }
+        return false;
+    }
+
+    inline void wait_for_slot()
     {
-        std::function<void()> task = std::move(tasks.front());
-        tasks.pop();
-        cnd_buffer_full.notify_one();
-        lock->unlock();
-        task();
-        lock->lock();
+        if (reserve_slot()) return;
+        std::unique_lock<std::mutex> lock(mtx_space);
+        ++n_submit_waiting;
+        cnd_space.wait(lock, [this] { return reserve_slot(); });
+        --n_submit_waiting;
     }
-    inline void wait_for_task()
+
+    template <typename T>
+    inline void enqueue(T &&task, TaskGroup *group)
     {
-        std::unique_lock<std::mutex> lock(mtx_queue_empty);
-        cnd_buffer_empty.wait(lock, [this]
-                              { return !tasks.empty() || !b_running; });
-        if (!tasks.empty())
+        if (group) group->add();
+        ++n_pending;
+        Worker &w = *workers[next_worker++ % (unsigned)n_threads];
+        {
+            std::lock_guard<std::mutex> lock(w.mtx);
+            w.slots[(w.head + w.n) % w.slots.size()].set(std::forward<T>(task), group);
+            ++w.n;
+        }
+        ++n_ready;
+        if (n_idle.load() > 0)
         {
-            execute_task(&lock);
+            std::lock_guard<std::mutex> lock(mtx_idle);
+            cnd_idle.notify_one();
         }
     }
 
-    void worker()
+    // own ring: oldest first
+    inline bool pop(int id, PoolTask &task)
     {
-        while (b_running)
+        Worker &w = *workers[id];
+        std::lock_guard<std::mutex> lock(w.mtx);
+        if (w.n == 0) return false;
+        task = std::move(w.slots[w.head]);
+        w.head = (w.head + 1) % w.slots.size();
+        --w.n;
+        return true;
+    }
+
+    // other rings: newest first, to stay out of the owner's way
+    inline bool steal(int id, PoolTask &task)
+    {
+        for (int k = 1; k < n_threads; k++)
         {
-            try
-            {
-                wait_for_task();
-            }
-            catch (const std::exception &e)
+            Worker &w = *workers[(id + k) % n_threads];
+            std::unique_lock<std::mutex> lock(w.mtx, std::try_to_lock);
+            if ((!lock.owns_lock()) || (w.n == 0)) continue;
+            --w.n;
+            task = std::move(w.slots[(w.head + w.n) % w.slots.size()]);
+            return true;
+        }
+        return false;
+    }
+
+    inline void execute_task(PoolTask &task)
+    {
+        --n_ready;
+        --n_queued;
+        if (n_submit_waiting.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx_space);
+            cnd_space.notify_one();
+        }
+        try
+        {
+            task();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+        TaskGroup *group = task.group;
+        task.reset();
+        if (group) group->done();
+        if (--n_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx_done);
+            cnd_done.notify_all();
+        }
+    }
+
+    void worker(int id)
+    {
+        PoolTask task;
+        while (true)
+        {
+            if (pop(id, task) || steal(id, task))
             {
-                std::cerr << e.what() << std::endl;
+                execute_task(task);
+                continue;
             }
+            std::unique_lock<std::mutex> lock(mtx_idle);
+            ++n_idle;
+            cnd_idle.wait(lock, [this] { return (n_ready.load() > 0) || !b_running; });
+            --n_idle;
+            if ((!b_running) && (n_ready.load() == 0)) return;
         }
     }
 
@@ -82,35 +295,59 @@ public:
     int n_threads;
     int limit;
 
+    // submits a task, blocks while 'limit' tasks are queued
     template <typename T>
-    inline void push_task(const T &task)
+    inline void push_task(T &&task)
     {
-        std::unique_lock<std::mutex> lock(mtx_queue_full);
-        cnd_buffer_full.wait(lock, [this]
-                             { return ((int)tasks.size() < limit); });
-        tasks.push(std::function<void()>(task));
-        cnd_buffer_empty.notify_one();
+        wait_for_slot();
+        enqueue(std::forward<T>(task), nullptr);
     }
 
-    template <typename T, typename... A>
-    inline void push_task(const T &task, const A &...args)
+    template <typename T>
+    inline void push_task(TaskGroup &group, T &&task)
+    {
+        wait_for_slot();
+        enqueue(std::forward<T>(task), &group);
+    }
+
+    // submits a task if there is room in the queue, returns false otherwise
+    template <typename T>
+    inline bool try_push_task(T &&task)
     {
-        push_task([task, args...]
-                  { task(args...); });
+        if (!reserve_slot()) return false;
+        enqueue(std::forward<T>(task), nullptr);
+        return true;
     }
 
+    template <typename T>
+    inline bool try_push_task(TaskGroup &group, T &&task)
+    {
+        if (!reserve_slot()) return false;
+        enqueue(std::forward<T>(task), &group);
+        return true;
+    }
+
+    template <typename T, typename A, typename... B>
+    inline void push_task(const T &task, const A &arg, const B &...args)
+    {
+        push_task([task, arg, args...]
+                  { task(arg, args...); });
+    }
+
+    // waits until all submitted tasks have finished running
     void wait_for_completion()
     {
-        std::unique_lock<std::mutex> lock(mtx_queue_full);
-        cnd_buffer_full.wait(lock, [this]
-                             { return tasks.empty(); });
+        if (n_pending.load() == 0) return;
+        std::unique_lock<std::mutex> lock(mtx_done);
+        cnd_done.wait(lock, [this]
+                      { return n_pending.load() == 0; });
     }
 
     void join_threads()
     {
-        for (int i = 0; i < n_threads; i++)
+        for (auto &t : threads)
         {
-            threads[i].join();
+            if (t.joinable()) t.join();
         }
     }
 
@@ -145,10 +382,13 @@ public:
     ~BoundedThreadPool()
     {
         wait_for_completion();
-        b_running = false;
-        cnd_buffer_empty.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(mtx_idle);
+            b_running = false;
+        }
+        cnd_idle.notify_all();
         join_threads();
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,129 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "BufferArena.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    const size_t page_size = 4096;
+    const size_t huge_page_size = 2 << 20;
+
+    inline size_t alignment(size_t size)
+    {
+        return (size >= huge_page_size) ? huge_page_size : page_size;
+    }
+
+    void *allocate(size_t size)
+    {
+        void *p = nullptr;
+#ifdef _WIN32
+        p = _aligned_malloc(size, alignment(size));
+#else
+        if (posix_memalign(&p, alignment(size), size) != 0) p = nullptr;
+#endif
+        if (!p) throw std::bad_alloc();
+#ifdef __linux__
+        if (size >= huge_page_size) madvise(p, size, MADV_HUGEPAGE);
+#endif
+        std::memset(p, 0, size); // pre-fault
+        return p;
+    }
+
+    void deallocate(void *p)
+    {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+}
+
+// never destroyed: detectors in other static objects may still give buffers back at exit
+BufferArena &BufferArena::instance()
+{
+    static BufferArena *arena = new BufferArena();
+    return *arena;
+}
+
+void *BufferArena::acquire(size_t size)
+{
+    size_t a = alignment(size);
+    size = (size + a - 1) / a * a;
+    void *p = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = idle.find(size);
+        if (it != idle.end())
+        {
+            p = it->second;
+            idle.erase(it);
+            n_idle -= size;
+        }
+    }
+    if (!p) p = allocate(size);
+    std::lock_guard<std::mutex> lock(mtx);
+    in_use[p] = size;
+    n_in_use += size;
+    return p;
+}
+
+void BufferArena::release(void *p)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = in_use.find(p);
+    if (it == in_use.end())
+    {
+        std::cout << "BufferArena::release(): unknown buffer" << std::endl;
+        return;
+    }
+    idle.emplace(it->second, p);
+    n_idle += it->second;
+    n_in_use -= it->second;
+    in_use.erase(it);
+}
+
+size_t BufferArena::trim()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &b : idle) deallocate(b.second);
+    idle.clear();
+    size_t n = n_idle;
+    n_idle = 0;
+    return n;
+}
+
+size_t BufferArena::bytes_idle()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return n_idle;
+}
+
+size_t BufferArena::bytes_in_use()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return n_in_use;
+}
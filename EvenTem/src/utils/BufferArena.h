@@ -0,0 +1,95 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef BUFFER_ARENA_H
+#define BUFFER_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <utility>
+
+// Process wide pool of the large detector buffers (ring slots, frame buffers). A detector lives
+// for one run() only, but the buffers of the same detector type have the same size every run,
+// so released buffers are kept, keyed by size, and handed out again to the next detector
+// instead of going back to the OS. New buffers are page aligned (2 MB and transparent huge pages
+// from 2 MB on, Linux) and pre-faulted, so the first run does not take the page faults in the
+// reader thread and later runs do not take them at all. RSS stays at the largest set of buffers
+// used at the same time; trim() returns the idle ones to the OS.
+class BufferArena
+{
+public:
+    static BufferArena &instance();
+
+    void *acquire(size_t size);
+    void release(void *p);
+
+    size_t trim();              // frees the idle buffers, returns the bytes freed
+    size_t bytes_idle();
+    size_t bytes_in_use();
+
+private:
+    std::mutex mtx;
+    std::multimap<size_t, void *> idle;       // size -> buffer
+    std::unordered_map<void *, size_t> in_use; // buffer -> size
+    size_t n_idle = 0;
+    size_t n_in_use = 0;
+
+    BufferArena() {};
+    BufferArena(const BufferArena &) = delete;
+    BufferArena &operator=(const BufferArena &) = delete;
+};
+
+// n elements of a trivially constructible T from the arena, given back on release() or
+// destruction. The contents are whatever the previous user left.
+template <typename T>
+class ArenaBuffer
+{
+private:
+    T *p = nullptr;
+    size_t n = 0;
+
+public:
+    ArenaBuffer() {};
+    explicit ArenaBuffer(size_t _n) : p(static_cast<T *>(BufferArena::instance().acquire(_n * sizeof(T)))), n(_n) {};
+    ArenaBuffer(const ArenaBuffer &) = delete;
+    ArenaBuffer &operator=(const ArenaBuffer &) = delete;
+    ArenaBuffer(ArenaBuffer &&other) : p(std::exchange(other.p, nullptr)), n(std::exchange(other.n, 0)) {};
+    ArenaBuffer &operator=(ArenaBuffer &&other)
+    {
+        if (this != &other)
+        {
+            release();
+            p = std::exchange(other.p, nullptr);
+            n = std::exchange(other.n, 0);
+        }
+        return *this;
+    };
+    ~ArenaBuffer() { release(); };
+
+    void release()
+    {
+        if (p) BufferArena::instance().release(p);
+        p = nullptr;
+        n = 0;
+    };
+
+    T *data() { return p; };
+    size_t size() const { return n; };
+    T &operator[](size_t i) { return p[i]; };
+};
+
+#endif // BUFFER_ARENA_H
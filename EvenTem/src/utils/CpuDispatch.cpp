@@ -0,0 +1,117 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "CpuDispatch.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if defined(EVENTEM_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const char *isa_names[CPU::N_ISA] = {"scalar", "sse4", "avx2", "avx512", "neon"};
+
+#if defined(EVENTEM_X86) && defined(_MSC_VER) && !defined(__clang__)
+    // cpuid leaf 1 / 7 bits, and the OS has to save the ymm / zmm registers (xgetbv)
+    CPU::Isa probe()
+    {
+        int r1[4], r7[4] = {0, 0, 0, 0};
+        __cpuid(r1, 0);
+        int n_leaves = r1[0];
+        __cpuid(r1, 1);
+        if (n_leaves >= 7) __cpuidex(r7, 7, 0);
+        bool sse4 = (r1[2] & (1 << 20)) && (r1[2] & (1 << 23));
+        bool osxsave = (r1[2] & (1 << 27)) != 0;
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool ymm = (xcr0 & 0x6) == 0x6;
+        bool zmm = (xcr0 & 0xe6) == 0xe6;
+        bool avx2 = ymm && (r1[2] & (1 << 28)) && (r7[1] & (1 << 5));
+        bool avx512 = zmm && (r7[1] & (1 << 16)) && (r7[1] & (1 << 17)) && (r7[1] & (1 << 30)) && (r7[1] & (1 << 31));
+        if (avx2 && avx512) return CPU::AVX512;
+        if (avx2) return CPU::AVX2;
+        if (sse4) return CPU::SSE4;
+        return CPU::SCALAR;
+    }
+#elif defined(EVENTEM_X86)
+    CPU::Isa probe()
+    {
+        __builtin_cpu_init();
+        bool avx2 = __builtin_cpu_supports("avx2");
+        bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                      __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+        if (avx2 && avx512) return CPU::AVX512;
+        if (avx2) return CPU::AVX2;
+        if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) return CPU::SSE4;
+        return CPU::SCALAR;
+    }
+#elif defined(EVENTEM_NEON)
+    CPU::Isa probe()
+    {
+        return CPU::NEON;
+    }
+#else
+    CPU::Isa probe()
+    {
+        return CPU::SCALAR;
+    }
+#endif
+
+    CPU::Isa cap(CPU::Isa isa)
+    {
+        const char *env = std::getenv("EVENTEM_ISA");
+        if (env == nullptr) return isa;
+        for (int i = 0; i < CPU::N_ISA; i++)
+        {
+            if (std::strcmp(env, isa_names[i]) == 0)
+            {
+                // a cap of another family (neon on x86) only drops to scalar
+                if ((i == CPU::NEON) != (isa == CPU::NEON)) return CPU::SCALAR;
+                return (CPU::Isa)std::min((int)isa, i);
+            }
+        }
+        return isa;
+    }
+}
+
+namespace CPU
+{
+    Isa detected()
+    {
+        static const Isa isa = probe();
+        return isa;
+    }
+
+    Isa active()
+    {
+        static const Isa isa = cap(detected());
+        return isa;
+    }
+
+    const char *name(Isa isa)
+    {
+        return ((isa >= 0) && (isa < N_ISA)) ? isa_names[isa] : "unknown";
+    }
+
+    std::string features()
+    {
+        std::string s = name(active());
+        if (active() != detected()) s += std::string(" (detected ") + name(detected()) + ")";
+        return s;
+    }
+}
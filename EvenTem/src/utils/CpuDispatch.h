@@ -0,0 +1,80 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+// Runtime selection of the hot kernels. The module is built for the baseline ISA (no -march), the
+// kernels are compiled again for each wider instruction set with a target attribute, and a
+// dispatch table per kernel picks the best variant the CPU supports when the module is imported.
+// One binary then runs everywhere and still uses AVX2 / AVX-512 where available. On AArch64 NEON
+// is part of the baseline: the NEON entries are the plainly compiled kernels or hand written ones.
+//
+// A target attribute can not depend on a template argument, so the variants of a kernel are thin
+// wrappers with a fixed attribute around one EVENTEM_ALWAYS_INLINE body, which the compiler
+// inlines into each wrapper and vectorises for that instruction set:
+//   EVENTEM_ALWAYS_INLINE void sum_body(...) { plain loop }
+//   EVENTEM_TARGET_AVX2 void sum_avx2(...) { sum_body(...); }
+//   const auto sum = CPU::select<sum_fn>({sum_body, nullptr, sum_avx2, sum_avx512, nullptr});
+// The x86 entries are only built with EVENTEM_X86. EVENTEM_ISA=scalar|sse4|avx2|avx512 in the
+// environment caps the selection (benchmarks, bug reports).
+
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EVENTEM_X86 1
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define EVENTEM_NEON 1
+#endif
+
+#if defined(EVENTEM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define EVENTEM_TARGET_SSE4 __attribute__((target("sse4.2,popcnt")))
+#define EVENTEM_TARGET_AVX2 __attribute__((target("avx2")))
+#define EVENTEM_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl")))
+#else
+// MSVC accepts all intrinsics without flags, but vectorises the shared bodies only for /arch
+#define EVENTEM_TARGET_SSE4
+#define EVENTEM_TARGET_AVX2
+#define EVENTEM_TARGET_AVX512
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define EVENTEM_ALWAYS_INLINE __forceinline
+#else
+#define EVENTEM_ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace CPU
+{
+    enum Isa {SCALAR, SSE4, AVX2, AVX512, NEON, N_ISA};
+
+    Isa detected();               // best instruction set of this CPU
+    Isa active();                 // detected(), capped by EVENTEM_ISA
+    const char *name(Isa isa);
+    std::string features();       // e.g. "avx2 (detected avx512)", for the logs and python
+
+    // The best entry of table (indexed by Isa, nullptr where no variant is built) for active()
+    template <typename F>
+    F select(const F (&table)[N_ISA])
+    {
+        for (int i = active(); i > SCALAR; i--)
+        {
+            if (table[i] != nullptr) return table[i];
+        }
+        return table[SCALAR];
+    };
+}
+
+#endif // CPU_DISPATCH_H
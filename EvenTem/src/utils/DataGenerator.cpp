@@ -0,0 +1,535 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#define _USE_MATH_DEFINES
+#include "DataGenerator.h"
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#define TPX3_HEADER 0x33585054ULL  // 'TPX3'
+#define TOA_UNIT_NS 1.5625
+#define MERLIN_HEAD_SIZE_256 384
+#define MERLIN_HEAD_SIZE_512 768
+
+// Small counter based generator: the same position always gives the same numbers, on every
+// platform (the distributions of <random> are implementation defined).
+class SplitMix
+{
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix(uint64_t seed) : state(seed) {};
+
+    inline uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    };
+
+    inline double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); };
+
+    inline int poisson(double mean)
+    {
+        if (mean <= 0) return 0;
+        if (mean > 64) // normal approximation
+        {
+            double u1 = std::max(uniform(), 1e-300), u2 = uniform();
+            double n = mean + std::sqrt(mean) * std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+            return std::max(0, (int)std::lround(n));
+        }
+        double l = std::exp(-mean), p = 1;
+        int k = 0;
+        do
+        {
+            ++k;
+            p *= uniform();
+        } while (p > l);
+        return k - 1;
+    };
+};
+
+void DataGenerator::probe_hits(int rx, int ry, int rep, std::vector<Hit> &hits)
+{
+    hits.clear();
+    uint64_t id = ((uint64_t)rep * scene.ny + ry) * scene.nx + rx;
+    SplitMix rng(SplitMix(scene.seed).next() ^ (id * 0xD1B54A32D192ED03ULL));
+    double cx = (scene.center_x < 0) ? scene.n_cam / 2.0 : scene.center_x;
+    double cy = (scene.center_y < 0) ? scene.n_cam / 2.0 : scene.center_y;
+    cx += scene.deflection * std::sin(2 * M_PI * rx / scene.nx);
+    cy += scene.deflection * std::sin(2 * M_PI * ry / scene.ny);
+
+    int n = rng.poisson(scene.dose);
+    for (int i = 0; i < n; i++)
+    {
+        double x, y;
+        if (rng.uniform() < scene.background)
+        {
+            x = rng.uniform() * scene.n_cam;
+            y = rng.uniform() * scene.n_cam;
+        }
+        else
+        {
+            double r = scene.disk_radius * std::sqrt(rng.uniform()), phi = 2 * M_PI * rng.uniform();
+            x = cx + r * std::cos(phi);
+            y = cy + r * std::sin(phi);
+        }
+        double t = rng.uniform();
+        uint16_t tot = (uint16_t)(20 + rng.next() % 400);
+        if (x < 0 || y < 0 || x >= scene.n_cam || y >= scene.n_cam) continue;
+        hits.push_back({(uint16_t)x, (uint16_t)y, t, tot});
+    }
+}
+
+void DataGenerator::probe_image(int rx, int ry, int rep, std::vector<uint16_t> &image, std::vector<Hit> &hits)
+{
+    std::fill(image.begin(), image.end(), 0);
+    probe_hits(rx, ry, rep, hits);
+    for (auto &h : hits) ++image[h.ky * scene.n_cam + h.kx];
+}
+
+//--------------------------------------------------------------------------------------------------
+// TPX3
+//--------------------------------------------------------------------------------------------------
+
+// Detector pixel to chip and pixel address, the inverse of the per chip transform of CHEETAH
+static inline void tpx3_address(int kx, int ky, int &chip, uint64_t &addr)
+{
+    static const int multiplier[4] = {1, -1, -1, 1};
+    static const int bias_x[4] = {256, 511, 255, 0};
+    static const int bias_y[4] = {0, 511, 511, 0};
+    chip = (ky < 256) ? ((kx >= 256) ? 0 : 3) : ((kx >= 256) ? 1 : 2);
+    int x = multiplier[chip] * (kx - bias_x[chip]);
+    int y = multiplier[chip] * (ky - bias_y[chip]);
+    uint64_t dcol = x >> 1, spix = y >> 2, pix = ((x & 1) << 2) | (y & 3);
+    addr = (dcol << 9) | (spix << 3) | pix;
+}
+
+// t in ToA units (1.5625 ns), the TDC counts in units of 3.125 ns
+static inline uint64_t tdc_packet(bool rise, uint64_t t, uint64_t trigger)
+{
+    return (0x6ULL << 60) | ((rise ? 0xFULL : 0xAULL) << 56) | ((trigger & 0xFFF) << 44) | (((t / 2) & 0x7FFFFFFFFULL) << 9);
+}
+
+static inline uint64_t global_time_packet(uint64_t t)
+{
+    return (0x44ULL << 56) | (((t / 16) & 0xFFFFFFFFULL) << 16);
+}
+
+void DataGenerator::generate_tpx3(const Sink &sink)
+{
+    uint64_t dt = std::max<uint64_t>(2, 2 * (uint64_t)std::llround(dwell_time / TOA_UNIT_NS / 2)); // even, so nx * dt / 2 is whole
+    uint64_t flyback = 2 * (uint64_t)std::llround(flyback_time / TOA_UNIT_NS / 2);
+    uint64_t t0 = 2 * (uint64_t)std::llround(start_time * 1e9 / TOA_UNIT_NS / 2);
+    uint64_t line_time = scene.nx * dt + flyback;
+    int n_lines = scene.ny * repetitions + extra_lines;
+
+    std::vector<Hit> hits;
+    std::vector<std::pair<uint64_t, uint64_t>> chip_hits[4]; // (toa, packet)
+    std::vector<uint64_t> chip_packets[4];
+    std::vector<uint64_t> out;
+    uint64_t n_packets = 0;
+
+    for (int line = 0; line < n_lines; line++)
+    {
+        uint64_t rise = t0 + line * line_time;
+        uint64_t fall = rise + scene.nx * dt;
+        for (int c = 0; c < 4; c++) chip_hits[c].clear();
+
+        for (int rx = 0; rx < scene.nx; rx++)
+        {
+            probe_hits(rx, line % scene.ny, line / scene.ny, hits);
+            uint64_t start = rise + rx * dt;
+            for (auto &h : hits)
+            {
+                int chip;
+                uint64_t addr;
+                if (h.kx >= 512 || h.ky >= 512) continue;
+                tpx3_address(h.kx, h.ky, chip, addr);
+                // coarse ToA (25 ns) inside the dwell time, so decoding with and without the
+                // fine ToA lands on the same probe position
+                uint64_t first = (start + 15) / 16, last = (start + dt - 1) / 16;
+                uint64_t coarse = (last > first) ? first + (uint64_t)(h.t * (last - first + 1)) : first;
+                uint64_t ftoa = std::min<uint64_t>((uint64_t)(h.t * 4096) % 16, coarse * 16 - std::min(start, coarse * 16));
+                uint64_t toa = coarse * 16 - ftoa;
+                uint64_t c30 = coarse & 0x3FFFFFFF;
+                uint64_t packet = (0xbULL << 60) | (addr << 44) | ((c30 & 0x3FFF) << 30) | ((uint64_t)(h.tot & 0x3FF) << 20) | (ftoa << 16) | (c30 >> 14);
+                chip_hits[chip].push_back({toa, packet});
+            }
+        }
+
+        for (int c = 0; c < 4; c++)
+        {
+            std::sort(chip_hits[c].begin(), chip_hits[c].end());
+            chip_packets[c].clear();
+            chip_packets[c].push_back(tdc_packet(true, rise, 2 * line));
+            if (global_time_interval > 0 && line % global_time_interval == 0) chip_packets[c].push_back(global_time_packet(rise));
+            for (auto &h : chip_hits[c]) chip_packets[c].push_back(h.second);
+            chip_packets[c].push_back(tdc_packet(false, fall, 2 * line + 1));
+        }
+
+        // chunks of the four chips in turn, as the readout interleaves them
+        size_t pos[4] = {0, 0, 0, 0};
+        out.clear();
+        bool b_left = true;
+        while (b_left)
+        {
+            b_left = false;
+            for (int c = 0; c < 4; c++)
+            {
+                size_t n = std::min<size_t>(chunk_packets, chip_packets[c].size() - pos[c]);
+                if (n == 0) continue;
+                out.push_back(TPX3_HEADER | ((uint64_t)c << 32) | ((uint64_t)(n * 8) << 48));
+                out.insert(out.end(), chip_packets[c].begin() + pos[c], chip_packets[c].begin() + pos[c] + n);
+                pos[c] += n;
+                b_left |= (pos[c] < chip_packets[c].size());
+            }
+        }
+        sink((const char *)out.data(), out.size() * sizeof(uint64_t));
+        n_packets += out.size();
+    }
+
+    if (tpx3_buffer_size > 0 && n_packets % tpx3_buffer_size)
+    {
+        out.assign(tpx3_buffer_size - n_packets % tpx3_buffer_size, TPX3_HEADER | (3ULL << 32));
+        sink((const char *)out.data(), out.size() * sizeof(uint64_t));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Merlin
+//--------------------------------------------------------------------------------------------------
+
+void DataGenerator::generate_merlin(const Sink &sink)
+{
+    int n = scene.n_cam;
+    int head_size = (n > 256) ? MERLIN_HEAD_SIZE_512 : MERLIN_HEAD_SIZE_256;
+    size_t data_size;
+    if (merlin_dtype == "U08") data_size = (size_t)n * n;
+    else if (merlin_dtype == "U16") data_size = (size_t)n * n * 2;
+    else if (merlin_dtype == "R64") data_size = (size_t)n * n / 8;
+    else
+    {
+        std::cout << "DataGenerator: unknown Merlin dtype " << merlin_dtype << std::endl;
+        return;
+    }
+
+    std::vector<char> frame(head_size + data_size);
+    std::vector<uint16_t> image((size_t)n * n);
+    std::vector<Hit> hits;
+    uint64_t id = 0;
+    for (int rep = 0; rep < repetitions; rep++)
+    {
+        for (int ry = 0; ry < scene.ny; ry++)
+        {
+            for (int rx = 0; rx < scene.nx; rx++)
+            {
+                std::fill(frame.begin(), frame.begin() + head_size, ' ');
+                int l = snprintf(frame.data(), head_size, "MQ1,%06llu,%05d,%02d,%04d,%04d,%s,%6s,%s,1970-01-01 00:00:00.000000,%.6f,0,0,0,",
+                                 (unsigned long long)(++id % 1000000), head_size, (n > 256) ? 4 : 1, n, n, merlin_dtype.c_str(),
+                                 (n > 256) ? "2x2" : "1x1", (n > 256) ? "0F" : "01", dwell_time * 1e-9);
+                frame[l] = ' ';
+
+                probe_image(rx, ry, rep, image, hits);
+                char *data = frame.data() + head_size;
+                if (merlin_dtype == "U08")
+                {
+                    for (size_t i = 0; i < image.size(); i++) data[i] = (char)std::min<uint16_t>(image[i], 255);
+                }
+                else if (merlin_dtype == "U16")
+                {
+                    for (size_t i = 0; i < image.size(); i++)
+                    {
+                        data[2 * i] = (char)(image[i] >> 8);
+                        data[2 * i + 1] = (char)(image[i] & 0xFF);
+                    }
+                }
+                else // R64 1 bit: 8 pixels per byte, lowest bit first, reversed in groups of 64 pixels
+                {
+                    std::memset(data, 0, data_size);
+                    for (int y = 0; y < n; y++)
+                    {
+                        for (int x = 0; x < n; x++)
+                        {
+                            if (!image[(size_t)y * n + x]) continue;
+                            size_t i = (size_t)y * n + (x & ~63) + (63 - (x & 63));
+                            data[i / 8] |= (char)(1 << (i % 8));
+                        }
+                    }
+                }
+                sink(frame.data(), frame.size());
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// numpy
+//--------------------------------------------------------------------------------------------------
+
+void DataGenerator::generate_npy(const Sink &sink, bool u16)
+{
+    int n = scene.n_cam;
+    std::string header = "{'descr': '" + std::string(u16 ? "<u2" : "|u1") + "', 'fortran_order': False, 'shape': (" +
+                         std::to_string(scene.ny) + ", " + std::to_string(scene.nx) + ", " + std::to_string(n) + ", " + std::to_string(n) + "), }";
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' '); // data aligned to 64 bytes as numpy writes it
+    header += '\n';
+    uint16_t header_len = (uint16_t)header.size();
+
+    std::string preamble("\x93NUMPY\x01\x00", 8);
+    preamble.append((const char *)&header_len, 2);
+    preamble += header;
+    sink(preamble.data(), preamble.size());
+
+    std::vector<uint16_t> image((size_t)n * n);
+    std::vector<uint8_t> image_u8((size_t)n * n);
+    std::vector<Hit> hits;
+    for (int ry = 0; ry < scene.ny; ry++)
+    {
+        for (int rx = 0; rx < scene.nx; rx++)
+        {
+            probe_image(rx, ry, 0, image, hits);
+            if (u16)
+            {
+                sink((const char *)image.data(), image.size() * sizeof(uint16_t));
+                continue;
+            }
+            for (size_t i = 0; i < image.size(); i++) image_u8[i] = (uint8_t)std::min<uint16_t>(image[i], 255);
+            sink((const char *)image_u8.data(), image_u8.size());
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// .electron
+//--------------------------------------------------------------------------------------------------
+
+void DataGenerator::generate_electron(const Sink &sink)
+{
+    std::vector<uint16_t> events;
+    std::vector<Hit> hits;
+    uint64_t n_events = 0;
+    for (int rep = 0; rep < repetitions; rep++)
+    {
+        for (int ry = 0; ry < scene.ny; ry++)
+        {
+            events.clear();
+            for (int rx = 0; rx < scene.nx; rx++)
+            {
+                probe_hits(rx, ry, rep, hits);
+                for (auto &h : hits)
+                {
+                    uint16_t e[5] = {h.kx, h.ky, (uint16_t)rx, (uint16_t)ry, (uint16_t)rep};
+                    events.insert(events.end(), e, e + 5);
+                }
+            }
+            sink((const char *)events.data(), events.size() * sizeof(uint16_t));
+            n_events += events.size() / 5;
+        }
+    }
+    // pad the last buffer and add a full one, so the reader sees id_image == repetitions
+    size_t n_pad = electron_buffer_size + (electron_buffer_size - n_events % electron_buffer_size) % electron_buffer_size;
+    uint16_t e[5] = {0, 0, 0, 0, (uint16_t)repetitions};
+    events.clear();
+    for (size_t i = 0; i < n_pad; i++) events.insert(events.end(), e, e + 5);
+    sink((const char *)events.data(), events.size() * sizeof(uint16_t));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Advapix
+//--------------------------------------------------------------------------------------------------
+
+#pragma pack(push, 1)
+struct AdvapixEvent
+{
+    uint32_t index;
+    uint64_t toa;
+    uint8_t overflow;
+    uint8_t ftoa;
+    uint16_t tot;
+};
+#pragma pack(pop)
+
+// the events of the scan line by line, in ToA units (25 ns); returns the ToA of the last one
+static uint64_t advapix_lines(DataGenerator &g, const std::function<void(const std::vector<AdvapixEvent> &)> &line)
+{
+    const int n_cam = 256; // ADVAPIX is a single chip
+    uint64_t dt = std::max<uint64_t>(1, (uint64_t)std::llround(g.dwell_time / 25)); // ToA units per probe position
+    uint64_t n_lines = (uint64_t)g.scene.ny * g.repetitions + g.extra_lines;
+
+    std::vector<DataGenerator::Hit> hits;
+    std::vector<AdvapixEvent> events;
+    uint64_t toa = 0;
+    for (uint64_t l = 0; l < n_lines; l++)
+    {
+        events.clear();
+        for (int rx = 0; rx < g.scene.nx; rx++)
+        {
+            g.probe_hits(rx, (int)(l % g.scene.ny), (int)(l / g.scene.ny), hits);
+            std::sort(hits.begin(), hits.end(), [](const DataGenerator::Hit &a, const DataGenerator::Hit &b) { return a.t < b.t; });
+            uint64_t start = (l * g.scene.nx + rx) * dt;
+            for (auto &h : hits)
+            {
+                if (h.kx >= n_cam || h.ky >= n_cam) continue;
+                toa = start + std::min<uint64_t>((uint64_t)(h.t * dt), dt - 1);
+                events.push_back({(uint32_t)(h.ky * n_cam + h.kx), toa, 0, 0, h.tot});
+            }
+        }
+        line(events);
+    }
+    return std::max(toa, (n_lines * g.scene.nx - 1) * dt);
+}
+
+void DataGenerator::generate_advapix(const Sink &sink)
+{
+    uint64_t n_events = 0;
+    uint64_t toa = advapix_lines(*this, [&](const std::vector<AdvapixEvent> &events)
+    {
+        sink((const char *)events.data(), events.size() * sizeof(AdvapixEvent));
+        n_events += events.size();
+    });
+    // the decoder takes the line from the last event of a buffer, so the padding stays in the last line
+    if (advapix_buffer_size > 0 && n_events % advapix_buffer_size)
+    {
+        std::vector<AdvapixEvent> events(advapix_buffer_size - n_events % advapix_buffer_size, {0, toa, 0, 0, 0});
+        sink((const char *)events.data(), events.size() * sizeof(AdvapixEvent));
+    }
+}
+
+// hit packet of the single chip: address (dcol, spix, pix), 14 bit ToA, ToT, fToA = 0 and the
+// ToA extension in the low 16 bits
+static inline uint64_t advaraw_packet(const AdvapixEvent &e)
+{
+    uint64_t kx = e.index % 256, ky = e.index / 256;
+    uint64_t address = ((kx / 2) << 9) | ((ky / 4) << 3) | ((kx % 2) * 4 + ky % 4);
+    return (0xBULL << 60) | (address << 44) | ((e.toa & 0x3FFF) << 30) | ((uint64_t)(e.tot & 0x3FF) << 20) | ((e.toa >> 14) & 0xFFFF);
+}
+
+void DataGenerator::generate_advaraw(const Sink &sink)
+{
+    std::vector<uint64_t> packets;
+    uint64_t n_packets = 0;
+    advapix_lines(*this, [&](const std::vector<AdvapixEvent> &events)
+    {
+        packets.resize(events.size());
+        for (size_t i = 0; i < events.size(); i++) packets[i] = advaraw_packet(events[i]);
+        sink((const char *)packets.data(), packets.size() * sizeof(uint64_t));
+        n_packets += packets.size();
+    });
+    // empty packets, the decoder skips them
+    if (advaraw_buffer_size > 0 && n_packets % advaraw_buffer_size)
+    {
+        packets.assign(advaraw_buffer_size - n_packets % advaraw_buffer_size, 0);
+        sink((const char *)packets.data(), packets.size() * sizeof(uint64_t));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+
+bool DataGenerator::write(const std::string &path, const std::function<void(const Sink &)> &generate)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "DataGenerator: Error opening " << path << std::endl;
+        return false;
+    }
+    generate([&file](const char *data, size_t size) { file.write(data, size); });
+    return file.good();
+}
+
+bool DataGenerator::write_tpx3(const std::string &path)
+{
+    return write(path, [this](const Sink &sink) { generate_tpx3(sink); });
+}
+
+bool DataGenerator::write_merlin(const std::string &path)
+{
+    return write(path, [this](const Sink &sink) { generate_merlin(sink); });
+}
+
+bool DataGenerator::write_npy(const std::string &path, bool u16)
+{
+    return write(path, [this, u16](const Sink &sink) { generate_npy(sink, u16); });
+}
+
+bool DataGenerator::write_electron(const std::string &path)
+{
+    return write(path, [this](const Sink &sink) { generate_electron(sink); });
+}
+
+bool DataGenerator::write_advapix(const std::string &path)
+{
+    return write(path, [this](const Sink &sink) { generate_advapix(sink); });
+}
+
+bool DataGenerator::write_advaraw(const std::string &path)
+{
+    return write(path, [this](const Sink &sink) { generate_advaraw(sink); });
+}
+
+static inline DataGenerator::Sink append_to(std::vector<char> &v)
+{
+    return [&v](const char *data, size_t size) { v.insert(v.end(), data, data + size); };
+}
+
+std::vector<char> DataGenerator::tpx3()
+{
+    std::vector<char> v;
+    generate_tpx3(append_to(v));
+    return v;
+}
+
+std::vector<char> DataGenerator::merlin()
+{
+    std::vector<char> v;
+    generate_merlin(append_to(v));
+    return v;
+}
+
+std::vector<char> DataGenerator::npy(bool u16)
+{
+    std::vector<char> v;
+    generate_npy(append_to(v), u16);
+    return v;
+}
+
+std::vector<char> DataGenerator::electron()
+{
+    std::vector<char> v;
+    generate_electron(append_to(v));
+    return v;
+}
+
+std::vector<char> DataGenerator::advapix()
+{
+    std::vector<char> v;
+    generate_advapix(append_to(v));
+    return v;
+}
+
+std::vector<char> DataGenerator::advaraw()
+{
+    std::vector<char> v;
+    generate_advaraw(append_to(v));
+    return v;
+}
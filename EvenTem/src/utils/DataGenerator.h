@@ -0,0 +1,118 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef DATA_GENERATOR_H
+#define DATA_GENERATOR_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Simple scene: at every probe position a Poisson number of electrons (mean dose) lands in a
+// bright field disk, whose centre is deflected sinusoidally over the scan, plus a uniform
+// background fraction. The electrons of a probe position only depend on seed and position, so
+// every output format of the same scene contains the same electrons.
+struct Scene
+{
+    int nx = 64;
+    int ny = 64;
+    int n_cam = 256;          // detector size, 512 for a quad TPX3 / Merlin
+    double dose = 10;         // mean electrons per probe position
+    double disk_radius = 20;  // detector pixels
+    double center_x = -1;     // disk centre, negative for the detector centre
+    double center_y = -1;
+    double deflection = 2;    // amplitude of the disk shift over the scan, detector pixels
+    double background = 0.05; // fraction of the electrons spread over the whole detector
+    uint64_t seed = 1;
+};
+
+// Writes reproducible synthetic data in the formats the detectors read:
+//   tpx3:     4-chip Cheetah stream. Per line and chip a TDC1 rise and fall packet, the hits in
+//             time order, global time packets, cut into chunks with TPX3 chip headers. ToA and
+//             TDC wrap like on the detector, set start_time just below 26.8 s (ToA) or 107.4 s
+//             (TDC) to cross an overflow.
+//   merlin:   .mib frames with header, U08, U16 (big endian) or R64 1-bit in the raw pixel order
+//             of the Merlin (pixels reversed in groups of 64).
+//   npy:      4D (ny, nx, n_cam, n_cam) uint8 or uint16 array.
+//   electron: SIMULATED events (kx, ky, rx, ry, id_image as uint16), terminated by a full buffer
+//             of events with id_image == repetitions.
+//   advapix:  ADVAPIX file events (pixel index, ToA in 25 ns), single chip, continuous scan without
+//             flyback, followed by extra_lines and padded to whole buffers.
+//   advaraw:  the same events as .t3r hit packets (layout of the .tpx3 hits, ToA extended in the
+//             low 16 bits), padded with empty packets.
+// The write_* functions stream to disk line by line, so the size is only limited by the disk.
+class DataGenerator
+{
+public:
+    Scene scene;
+    int repetitions = 1;
+
+    // TPX3
+    double dwell_time = 1000;       // ns per probe position
+    double flyback_time = 5000;     // ns between the TDC fall and the next rise
+    double start_time = 0;          // s, detector time of the first line
+    int chunk_packets = 1024;       // packets per chip chunk
+    int global_time_interval = 1;   // lines between global time packets, 0 for none
+    int extra_lines = 3;            // lines after the last scan, so every line gets closed
+    int tpx3_buffer_size = 4096;    // packets, the stream is padded to a multiple
+
+    // Merlin
+    std::string merlin_dtype = "U08"; // U08, U16 or R64 (1 bit)
+
+    // .electron
+    int electron_buffer_size = 115200; // events, the stream is padded to a multiple
+
+    // Advapix
+    int advapix_buffer_size = 14400;   // events, the stream is padded to a multiple
+    int advaraw_buffer_size = 28800;   // packets
+
+    using Sink = std::function<void(const char *, size_t)>;
+
+    void generate_tpx3(const Sink &sink);
+    void generate_merlin(const Sink &sink);
+    void generate_npy(const Sink &sink, bool u16 = false);
+    void generate_electron(const Sink &sink);
+    void generate_advapix(const Sink &sink);
+    void generate_advaraw(const Sink &sink);
+
+    bool write_tpx3(const std::string &path);
+    bool write_merlin(const std::string &path);
+    bool write_npy(const std::string &path, bool u16 = false);
+    bool write_electron(const std::string &path);
+    bool write_advapix(const std::string &path);
+    bool write_advaraw(const std::string &path);
+
+    std::vector<char> tpx3();
+    std::vector<char> merlin();
+    std::vector<char> npy(bool u16 = false);
+    std::vector<char> electron();
+    std::vector<char> advapix();
+    std::vector<char> advaraw();
+
+    struct Hit
+    {
+        uint16_t kx;
+        uint16_t ky;
+        double t;     // arrival within the dwell time, [0, 1)
+        uint16_t tot;
+    };
+    // electrons of probe position (rx, ry) in scan repetition rep
+    void probe_hits(int rx, int ry, int rep, std::vector<Hit> &hits);
+
+private:
+    void probe_image(int rx, int ry, int rep, std::vector<uint16_t> &image, std::vector<Hit> &hits);
+    bool write(const std::string &path, const std::function<void(const Sink &)> &generate);
+};
+#endif // DATA_GENERATOR_H
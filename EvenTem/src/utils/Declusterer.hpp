@@ -22,6 +22,7 @@
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <algorithm>
 #include <cstdlib>
 
@@ -29,6 +30,7 @@
 #include "BoundedThreadPool.hpp"
 
 #include "Logger.hpp"
+#include "Tracer.h"
 
 
 #pragma pack(push, 1)
@@ -65,7 +67,7 @@ private:
     std::thread decluster_thread;
     std::thread write_thread;
 
-    BoundedThreadPool *pool = new BoundedThreadPool;
+    BoundedThreadPool pool;
 
     void decluster(int _buffer_id)
     {
@@ -133,15 +135,17 @@ private:
 
     void schedule_declustering()
     {
+        if (p_tracer) p_tracer->name_thread("decluster_thread");
         while ((still_reading) || (n_buffer_declustered < n_buffer_filled))
         {
             if (n_buffer_declustered < n_buffer_filled)
             {
-                // pool->push_task([=]{decluster(n_buffer_declustered % n_buffer);}); 
-                #ifdef LOG 
-                    Logger::getInstance().log("Declustering buffer " + std::to_string(n_buffer_declustered) + " of " + std::to_string(n_buffer_filled));
-                #endif
+                // pool.push_task([=]{decluster(n_buffer_declustered % n_buffer);}); 
+                ELOG_DEBUG("Declustering buffer %d of %d", n_buffer_declustered.load(), n_buffer_filled);
+                int64_t t0 = (p_tracer) ? p_tracer->now() : 0;
+                int64_t id = n_buffer_declustered;
                 decluster(n_buffer_declustered % n_buffer);   
+                if (p_tracer) p_tracer->complete("decluster", id, t0);
             }
             else
             {
@@ -154,16 +158,17 @@ private:
     void schedule_writing()
     {
         int _buffer_id;
+        if (p_tracer) p_tracer->name_thread("write_thread");
         while (still_processing || n_buffer_written < n_buffer_declustered)
         {
             if (n_buffer_written < n_buffer_declustered)
             {
                 _buffer_id = n_buffer_written % n_buffer;
+                int64_t t0 = (p_tracer) ? p_tracer->now() : 0;
                 write_to_file(_buffer_id);
+                if (p_tracer) p_tracer->complete("write", n_buffer_written, t0);
                 buffer[_buffer_id]->clear();
-                #ifdef LOG 
-                    Logger::getInstance().log("clearing buffer " + std::to_string(n_buffer_written) + " of " + std::to_string(n_buffer_filled));
-                #endif
+                ELOG_DEBUG("clearing buffer %d of %d", n_buffer_written, n_buffer_filled);
                 ++n_buffer_written;
             }
             else
@@ -176,7 +181,7 @@ private:
 
 
 public:
-    std::vector<cluster_event> *buffer[n_buffer];
+    std::unique_ptr<std::vector<cluster_event>> buffer[n_buffer];
     std::shared_ptr<std::vector<int>> keep[n_buffer];
     
     bool still_reading = true;
@@ -189,6 +194,7 @@ public:
     std::atomic<int> n_electrons_kept = 0;
     std::vector<int> *p_clustersize_histogram;
     int max_clustersize = 0;
+    Tracer *p_tracer = nullptr;
 
     void init(uint64_t dtime, uint16_t dspace, int cluster_range,int x_crop,int y_crop,int scan_bin, int det_bin, std::ofstream& _p_file, int n_threads, std::vector<int> *_p_clustersize_histogram)
     {
@@ -205,7 +211,7 @@ public:
 
         std::cout << "Declustering param: dtime = " << dtime << ", dspace = " << dspace << ", cluster_range = " << cluster_range << std::endl;
 
-        // pool->init(n_threads,n_threads);
+        // pool.init(n_threads,n_threads);
     };
 
     void set_buffer_read()
@@ -234,7 +240,7 @@ public:
 
     Declusterer(){
         for (int i = 0; i < n_buffer; ++i) {
-            buffer[i] = new std::vector<cluster_event>();
+            buffer[i] = std::make_unique<std::vector<cluster_event>>();
             keep[i] = std::make_shared<std::vector<int>>();
         }
     }
@@ -0,0 +1,63 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef EVENTBATCH_HPP
+#define EVENTBATCH_HPP
+
+#include <stdint.h>
+#include <vector>
+
+// Struct-of-arrays batch of decoded events. Filled by the detector decoders, consumed by the
+// accumulation kernels. The capacity is fixed at construction, so filling never reallocates.
+struct EventBatch
+{
+    std::vector<uint64_t> probe_position;
+    std::vector<uint64_t> toa;
+    std::vector<uint16_t> kx;
+    std::vector<uint16_t> ky;
+    std::vector<uint16_t> id_image;
+    std::vector<uint16_t> tot;
+    size_t n = 0;
+
+    inline void push_back(uint64_t _probe_position, uint16_t _kx, uint16_t _ky, uint16_t _id_image, uint64_t _toa, uint16_t _tot)
+    {
+        probe_position[n] = _probe_position;
+        kx[n] = _kx;
+        ky[n] = _ky;
+        id_image[n] = _id_image;
+        toa[n] = _toa;
+        tot[n] = _tot;
+        ++n;
+    };
+
+    inline void clear() { n = 0; };
+    inline size_t size() const { return n; };
+    inline size_t capacity() const { return probe_position.size(); };
+
+    void resize(size_t _capacity)
+    {
+        probe_position.resize(_capacity);
+        toa.resize(_capacity);
+        kx.resize(_capacity);
+        ky.resize(_capacity);
+        id_image.resize(_capacity);
+        tot.resize(_capacity);
+        n = 0;
+    };
+
+    EventBatch() {};
+    explicit EventBatch(size_t _capacity) { resize(_capacity); };
+};
+
+#endif // EVENTBATCH_HPP
@@ -14,11 +14,31 @@
 
 #include "FileConnector.h"
 
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 void FileConnector::open_file()
 {
     if (!path.empty())
     {
         file_size = std::filesystem::file_size(path);
+        reader.direct_io = direct_io;
+        if (read_ahead && reader.open(path, file_size))
+        {
+            reset_file();
+            return;
+        }
+        if (memory_mapped && map_file())
+        {
+            reset_file();
+            return;
+        }
         stream.open(path, std::ios::in | std::ios::binary);
         if (stream.is_open())
         {
@@ -37,6 +57,8 @@ void FileConnector::open_file()
 
 void FileConnector::close_file()
 {
+    unmap_file();
+    reader.close();
     if (stream.is_open())
     {
         stream.close();
@@ -44,9 +66,26 @@ void FileConnector::close_file()
 }
 
 // Reading data stream from File
+// Past the end of the file the rest of the buffer is zeroed: the buffers are reused (BufferArena)
+// and would otherwise hand the data of an earlier run to the decoder.
 void FileConnector::read_data(char *buffer, size_t data_size)
 {
-    stream.read(buffer, data_size);
+    size_t n;
+    if (mapping)
+    {
+        n = (pos < file_size) ? std::min<std::uintmax_t>(data_size, file_size - pos) : 0;
+        std::memcpy(buffer, mapping + pos, n);
+    }
+    else if (reader.is_open())
+    {
+        n = reader.read(buffer, data_size);
+    }
+    else
+    {
+        stream.read(buffer, data_size);
+        n = (size_t)stream.gcount();
+    }
+    if (n < data_size) std::memset(buffer + n, 0, data_size - n);
     pos += data_size;
     // Reset file to the beginning for repeat reading
     // if (file_size - pos < data_size)
@@ -55,17 +94,70 @@ void FileConnector::read_data(char *buffer, size_t data_size)
     // }
 };
 
+// Pointer to the next data_size bytes of the mapping, nullptr if the file is not mapped or fewer
+// bytes are left (read_data() then copies the remainder). The pointer stays valid until close_file().
+const char *FileConnector::map_data(size_t data_size)
+{
+    if ((!mapping) || (pos + data_size > file_size)) return nullptr;
+    const char *p = mapping + pos;
+    pos += data_size;
+    return p;
+};
+
 void FileConnector::reset_file()
 {
     //std::cout << "FileConnector::reset_file(): Resetting file to the beginning!" << std::endl;
     pos = 0;
+    if (mapping || reader.is_open()) return;
     stream.clear();
     stream.seekg(0, std::ios::beg);
 }
 
 void FileConnector::seek_to(std::uintmax_t pos)
 {
+    this->pos = pos;
+    if (mapping) return;
+    if (reader.is_open())
+    {
+        reader.seek(pos);
+        return;
+    }
     stream.seekg(pos, std::ios::beg);
 }
 
-FileConnector::FileConnector(): path(), stream(), file_size(0), pos(0) {};
\ No newline at end of file
+bool FileConnector::map_file()
+{
+#ifndef _WIN32
+    if (file_size == 0) return false;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    void *p = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::cout << "FileConnector::map_file(): mmap failed, falling back to reading the file" << std::endl;
+        return false;
+    }
+    // the detectors stream through the file once: read ahead aggressively, drop pages behind
+    madvise(p, file_size, MADV_SEQUENTIAL);
+    mapping = static_cast<char *>(p);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FileConnector::unmap_file()
+{
+#ifndef _WIN32
+    if (mapping) munmap(mapping, file_size);
+#endif
+    mapping = nullptr;
+}
+
+FileConnector::FileConnector(): path(), file_size(0), pos(0), memory_mapped(true), read_ahead(false), direct_io(false), stream(), mapping(nullptr), reader() {};
+
+FileConnector::~FileConnector()
+{
+    unmap_file();
+}
@@ -21,22 +21,39 @@
 #include <fstream>
 #include <filesystem> 
 
+#include "AsyncFileReader.h"
 
+
+// Reads a file either through an ifstream or, with memory_mapped set (default where mmap is
+// available), from a read-only mapping of the whole file. In the mapped mode map_data() hands
+// out pointers into the mapping, so the detectors can decode without copying the data.
+// read_ahead instead streams the file through an AsyncFileReader (deep queue of large reads,
+// page cache dropped behind or bypassed with direct_io), meant for files larger than the memory.
 class FileConnector
 {
 public:
     std::filesystem::path path;
     std::uintmax_t file_size;
     std::uintmax_t pos;
+    bool memory_mapped;
+    bool read_ahead;
+    bool direct_io;
     void open_file();
     void close_file();
     void read_data(char *buffer, size_t data_size);
+    const char *map_data(size_t data_size);
     void seek_to(std::uintmax_t pos);
+    bool is_mapped() const { return mapping != nullptr; };
     FileConnector();
+    ~FileConnector();
 
 private:
     std::ifstream stream;
+    char *mapping;
+    AsyncFileReader reader;
 
     void reset_file();
+    bool map_file();
+    void unmap_file();
 };
 #endif // FILE_CONNECTOR_H
\ No newline at end of file
@@ -0,0 +1,96 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef FRAME_KERNELS_HPP
+#define FRAME_KERNELS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "CpuDispatch.h"
+
+// Per frame loops of the frame based detectors, written as plain loops and compiled for every
+// instruction set of CpuDispatch.h; accumulate, row_col_sums and unpack_bits point to the best
+// variant for the CPU. T is the pixel type of the detector.
+namespace FRAME_KERNELS
+{
+    // acc[k] += frame[k]
+    template <typename T>
+    EVENTEM_ALWAYS_INLINE void accumulate_body(const T *frame, size_t n, size_t *acc)
+    {
+        for (size_t k = 0; k < n; k++) acc[k] += (size_t)frame[k];
+    };
+
+    // row_sums[y] = sum of row y, col_sums[x] += sum of column x (col_sums zeroed by the caller)
+    template <typename T>
+    EVENTEM_ALWAYS_INLINE void row_col_sums_body(const T *frame, size_t n_cam, size_t *row_sums, size_t *col_sums)
+    {
+        for (size_t y = 0; y < n_cam; y++)
+        {
+            const T *row = frame + y * n_cam;
+            size_t sum = 0;
+            for (size_t x = 0; x < n_cam; x++)
+            {
+                sum += (size_t)row[x];
+                col_sums[x] += (size_t)row[x];
+            }
+            row_sums[y] = sum;
+        }
+    };
+
+    // Expands the n bits packed at the start of data into one pixel per bit, in place, least
+    // significant bit first (Merlin 1-bit frames). Runs backwards so no packed word is overwritten
+    // before it is read.
+    template <typename T>
+    EVENTEM_ALWAYS_INLINE void unpack_bits_body(T *data, size_t n)
+    {
+        const size_t bits = sizeof(T) * 8;
+        for (size_t i = n / bits; i-- > 0;)
+        {
+            const T word = data[i];
+            T *out = data + i * bits;
+            for (size_t j = 0; j < bits; j++) out[j] = (T)((word >> j) & 1);
+        }
+    };
+
+    // scalar, SSE4, AVX2 and AVX-512 builds of <name>_body, and the dispatch table <name>
+    #define FRAME_KERNEL(name, params, args)                                                            \
+        template <typename T> inline void name##_scalar params { name##_body<T> args; }                 \
+        FRAME_KERNEL_X86(name, params, args)                                                            \
+        template <typename T> using name##_fn = void (*) params;                                        \
+        template <typename T>                                                                           \
+        inline const name##_fn<T> name = CPU::select<name##_fn<T>>(                                     \
+            {name##_scalar<T>, FRAME_KERNEL_X86_ENTRIES(name), nullptr});
+
+#if defined(EVENTEM_X86)
+    #define FRAME_KERNEL_X86(name, params, args)                                                        \
+        template <typename T> EVENTEM_TARGET_SSE4 inline void name##_sse4 params { name##_body<T> args; } \
+        template <typename T> EVENTEM_TARGET_AVX2 inline void name##_avx2 params { name##_body<T> args; } \
+        template <typename T> EVENTEM_TARGET_AVX512 inline void name##_avx512 params { name##_body<T> args; }
+    #define FRAME_KERNEL_X86_ENTRIES(name) name##_sse4<T>, name##_avx2<T>, name##_avx512<T>
+#else
+    #define FRAME_KERNEL_X86(name, params, args)
+    #define FRAME_KERNEL_X86_ENTRIES(name) nullptr, nullptr, nullptr
+#endif
+
+    FRAME_KERNEL(accumulate, (const T *frame, size_t n, size_t *acc), (frame, n, acc))
+    FRAME_KERNEL(row_col_sums, (const T *frame, size_t n_cam, size_t *row_sums, size_t *col_sums), (frame, n_cam, row_sums, col_sums))
+    FRAME_KERNEL(unpack_bits, (T *data, size_t n), (data, n))
+
+    #undef FRAME_KERNEL
+    #undef FRAME_KERNEL_X86
+    #undef FRAME_KERNEL_X86_ENTRIES
+}
+
+#endif // FRAME_KERNELS_HPP
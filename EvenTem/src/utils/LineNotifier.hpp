@@ -0,0 +1,65 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef LINENOTIFIER_HPP
+#define LINENOTIFIER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Scan line up to which the detector has finished decoding. The detector publishes it after
+// every buffer, the processors sleep in wait_past() until there is a line they have not yet
+// handled, instead of polling the shared line counter.
+class LineNotifier
+{
+private:
+    std::atomic<int> n_line{0};
+    std::atomic<int> n_waiting{0};
+    std::mutex mtx;
+    std::condition_variable cnd;
+
+public:
+    inline int line() const { return n_line.load(std::memory_order_acquire); };
+
+    inline void publish(int _line)
+    {
+        if (_line == n_line.load(std::memory_order_relaxed)) return;
+        n_line.store(_line, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (n_waiting.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            cnd.notify_all();
+        }
+    };
+
+    // blocks until a line after 'seen' is published or the timeout expires, returns the current line
+    template <typename Rep, typename Period>
+    inline int wait_past(int seen, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        if (line() > seen) return line();
+        std::unique_lock<std::mutex> lock(mtx);
+        ++n_waiting;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cnd.wait_for(lock, timeout, [&]{ return line() > seen; });
+        --n_waiting;
+        return line();
+    };
+
+    void reset() { n_line.store(0); };
+};
+
+#endif // LINENOTIFIER_HPP
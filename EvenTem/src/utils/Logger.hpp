@@ -1,12 +1,12 @@
 /* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
- * University of Antwerp - All Rights Reserved. 
+ * University of Antwerp - All Rights Reserved.
  * You may use, distribute and modify
  * this code under the terms of the GPL3 license.
  * You should have received a copy of the GPL3 license with
- * this file. If not, please visit: 
+ * this file. If not, please visit:
  * https://www.gnu.org/licenses/gpl-3.0.en.html
- * 
- * Authors: 
+ *
+ * Authors:
  *   Thomas Friedrich <>
  *   Chu-Ping Yu <>
  *   Arno Annys <arno.annys@uantwerpen.be>
@@ -17,71 +17,194 @@
 
 #include <fstream>
 #include <iostream>
-#include <mutex>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
 
-class Logger {
+// Compile time log level: the ELOG_* macros below the level compile to nothing, so their
+// arguments are not even evaluated. Set with -DELOG_LEVEL=ELOG_LEVEL_DEBUG (cmake -DLOG_LEVEL=DEBUG).
+#define ELOG_LEVEL_TRACE 0
+#define ELOG_LEVEL_DEBUG 1
+#define ELOG_LEVEL_INFO  2
+#define ELOG_LEVEL_WARN  3
+#define ELOG_LEVEL_ERROR 4
+#define ELOG_LEVEL_OFF   5
+
+#ifndef ELOG_LEVEL
+#if defined(DBG_LOG) || defined(LOG)
+#define ELOG_LEVEL ELOG_LEVEL_DEBUG
+#else
+#define ELOG_LEVEL ELOG_LEVEL_INFO
+#endif
+#endif
+
+// printf style: ELOG_DEBUG("filled buffer %d", id), written to debug.log by the background thread
+#define ELOG_AT(level, ...) do { if constexpr (ELOG_LEVEL <= (level)) Logger::getInstance().logf((level), __VA_ARGS__); } while (0)
+#define ELOG_TRACE(...) ELOG_AT(ELOG_LEVEL_TRACE, __VA_ARGS__)
+#define ELOG_DEBUG(...) ELOG_AT(ELOG_LEVEL_DEBUG, __VA_ARGS__)
+#define ELOG_INFO(...)  ELOG_AT(ELOG_LEVEL_INFO, __VA_ARGS__)
+#define ELOG_WARN(...)  ELOG_AT(ELOG_LEVEL_WARN, __VA_ARGS__)
+#define ELOG_ERROR(...) ELOG_AT(ELOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Log file written by a background thread. Any thread formats its message straight into a slot
+// of a bounded lock-free ring (multi-producer, single consumer), the background thread writes
+// the slots to the file and flushes once the ring is drained. Callers never wait for the disk
+// and never block: if the ring is full the message is dropped and counted instead.
+class AsyncLog
+{
 public:
-    static Logger& getInstance() {
-        static Logger instance;
-        return instance;
-    }
+    static const size_t capacity = 4096;  // messages, power of 2
+    static const size_t message_size = 256; // longer messages are truncated
 
     void log(const std::string& message) {
-        std::lock_guard<std::mutex> guard(log_mutex);
-        log_file << message << std::endl;
+        write(ELOG_LEVEL_INFO, message.data(), message.size());
     }
 
-private:
-    Logger() : log_file("debug.log", std::ios_base::app) {
+    void logf(int level, const char *format, ...) {
+        Slot *slot = acquire();
+        if (!slot) return;
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(slot->text, message_size, format, args);
+        va_end(args);
+        publish(slot, level, (n < 0) ? 0 : std::min((size_t)n, message_size - 1));
+    }
+
+    // blocks until everything logged so far is written
+    void flush() {
+        size_t target = head.load();
+        while (written.load() < target) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t dropped() const { return n_dropped.load(std::memory_order_relaxed); }
+
+protected:
+    explicit AsyncLog(const char *path) : log_file(path, std::ios_base::app), slots(new Slot[capacity]) {
         if (!log_file.is_open()) {
-            std::cerr << "Failed to open log file" << std::endl;
+            std::cerr << "Failed to open " << path << std::endl;
         }
+        for (size_t i = 0; i < capacity; i++) slots[i].seq.store(i, std::memory_order_relaxed);
+        flusher = std::thread(&AsyncLog::run, this);
     }
 
-    ~Logger() {
+    ~AsyncLog() {
+        b_stop = true;
+        flusher.join();
+        if (n_dropped > 0) log_file << n_dropped << " log messages dropped (ring full)" << "\n";
         if (log_file.is_open()) {
             log_file.close();
         }
     }
 
-    Logger(const Logger&) = delete;
-    Logger& operator=(const Logger&) = delete;
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        int level;
+        size_t length;
+        char text[message_size];
+    };
 
     std::ofstream log_file;
-    std::mutex log_mutex;
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> head{0};  // next slot to claim by a producer
+    alignas(64) std::atomic<size_t> written{0}; // slots written by the flusher
+    std::atomic<uint64_t> n_dropped{0};
+    std::atomic<bool> b_stop{false};
+    std::thread flusher;
+
+    // claims the next free slot, nullptr if the ring is full
+    Slot *acquire() {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot *slot = &slots[pos & (capacity - 1)];
+            intptr_t diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return slot;
+            }
+            else if (diff < 0) {
+                n_dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            else pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    void publish(Slot *slot, int level, size_t length) {
+        slot->level = level;
+        slot->length = length;
+        slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void write(int level, const char *text, size_t length) {
+        Slot *slot = acquire();
+        if (!slot) return;
+        length = std::min(length, message_size - 1);
+        std::memcpy(slot->text, text, length);
+        publish(slot, level, length);
+    }
+
+    static const char *level_name(int level) {
+        static const char *names[] = {"trace: ", "debug: ", "", "warning: ", "error: "};
+        return ((level >= 0) && (level < ELOG_LEVEL_OFF)) ? names[level] : "";
+    }
+
+    // background thread: writes the published slots in order, flushes when the ring is empty
+    void run() {
+        size_t tail = 0;
+        while (true) {
+            bool stop = b_stop.load();
+            size_t n = 0;
+            while (true) {
+                Slot *slot = &slots[tail & (capacity - 1)];
+                if (slot->seq.load(std::memory_order_acquire) != tail + 1) break;
+                log_file << level_name(slot->level);
+                log_file.write(slot->text, slot->length);
+                log_file << '\n';
+                slot->seq.store(tail + capacity, std::memory_order_release);
+                ++tail;
+                ++n;
+            }
+            if (n > 0) {
+                log_file.flush();
+                written.store(tail);
+            }
+            else if (stop) break;
+            else std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
 };
 
-class TXT_Logger {
+class Logger : public AsyncLog {
+public:
+    static Logger& getInstance() {
+        static Logger instance;
+        return instance;
+    }
+
+private:
+    Logger() : AsyncLog("debug.log") {}
+};
+
+class TXT_Logger : public AsyncLog {
     public:
         static TXT_Logger& getInstance() {
             static TXT_Logger instance;
             return instance;
         }
-    
-        void log(const std::string& message) {
-            std::lock_guard<std::mutex> guard(log_mutex);
-            log_file << message << std::endl;
-        }
-    
+
     private:
-        TXT_Logger() : log_file("output.txt", std::ios_base::app) {
-            if (!log_file.is_open()) {
-                std::cerr << "Failed to open txt output file" << std::endl;
-            }
-        }
-    
-        ~TXT_Logger() {
-            if (log_file.is_open()) {
-                log_file.close();
-            }
-        }
-    
-        TXT_Logger(const TXT_Logger&) = delete;
-        TXT_Logger& operator=(const TXT_Logger&) = delete;
-    
-        std::ofstream log_file;
-        std::mutex log_mutex;
+        TXT_Logger() : AsyncLog("output.txt") {}
     };
 
-#endif // LOGGER_HPP
\ No newline at end of file
+#endif // LOGGER_HPP
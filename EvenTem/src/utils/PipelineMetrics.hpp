@@ -0,0 +1,188 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef PIPELINEMETRICS_HPP
+#define PIPELINEMETRICS_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <algorithm>
+
+#include "SpscRing.hpp"
+
+// Counters of the reader -> decoder -> line processor pipeline. The stages only add to them with
+// relaxed atomics (once per buffer or line, not per event); sample() may be called from any
+// thread at any time and turns them into totals and rates since the previous sample. The
+// metrics outlive the detector, so the detector writes into them, they never point back into
+// the detector. Socket reads are not counted as busy time, they mostly wait for the network;
+// the receive side shows in socket_rate and socket_bytes_buffered instead.
+class PipelineMetrics
+{
+public:
+    enum Stage {READ, DECODE, PROCESS, N_STAGES};
+
+    std::atomic<uint64_t> bytes_read{0};          // file or socket bytes the reader put into the ring
+    std::atomic<uint64_t> events_decoded{0};      // events taken out of the data stream
+    std::atomic<uint64_t> events_accepted{0};     // events handed to the process methods
+    std::atomic<uint64_t> events_out_of_scan{0};  // hits during the flyback or outside the scan
+    std::atomic<uint64_t> frames_processed{0};    // frame based detectors
+    std::atomic<uint64_t> positions_processed{0}; // probe positions completed by the line processor
+    std::atomic<uint64_t> busy_ns[N_STAGES] = {};  // time spent working (not waiting) per stage
+    RingCounters ring;                            // reader -> decoder buffer ring
+
+    struct Snapshot
+    {
+        double time = 0;      // s since reset()
+        double interval = 0;  // s since the previous sample
+        uint64_t bytes_read = 0;
+        uint64_t buffers_filled = 0;
+        uint64_t buffers_processed = 0;
+        uint64_t ring_occupancy = 0;   // buffers filled and waiting for the decoder
+        uint64_t ring_capacity = 0;
+        uint64_t reader_waits = 0;     // reader found the ring full
+        uint64_t decoder_waits = 0;    // decoder found the ring empty
+        uint64_t events_decoded = 0;
+        uint64_t events_accepted = 0;
+        uint64_t events_out_of_scan = 0;
+        uint64_t frames_processed = 0;
+        uint64_t positions_processed = 0;
+        int line_decoded = 0;          // lines published by the detector
+        int line_processed = 0;        // lines completed by the line processor
+        uint64_t socket_bytes_received = 0;
+        uint64_t socket_bytes_buffered = 0; // received but not yet read by the detector
+        // rates and busy fractions over the interval
+        double read_rate = 0;   // bytes/s
+        double event_rate = 0;  // accepted events/s
+        double frame_rate = 0;
+        double socket_rate = 0; // bytes/s
+        double read_busy = 0;   // fraction of the interval the stage was working
+        double decode_busy = 0;
+        double process_busy = 0;
+        std::string bottleneck = "none"; // "reader", "decoder" or "processor" when one is busy > 90%
+    };
+
+    // Adds the time between construction and destruction to a stage, no-op for nullptr
+    class StageTimer
+    {
+    private:
+        PipelineMetrics *p_metrics;
+        Stage stage;
+        std::chrono::steady_clock::time_point t0;
+
+    public:
+        StageTimer(PipelineMetrics *_p_metrics, Stage _stage) : p_metrics(_p_metrics), stage(_stage)
+        {
+            if (p_metrics) t0 = std::chrono::steady_clock::now();
+        };
+        ~StageTimer()
+        {
+            if (p_metrics) p_metrics->add(p_metrics->busy_ns[stage],
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+        };
+    };
+
+    static inline void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    };
+
+    // events taken from the stream, of which n_kept were inside the scan
+    inline void count_decoded(uint64_t n_decoded, uint64_t n_kept)
+    {
+        add(events_decoded, n_decoded);
+        if (n_decoded > n_kept) add(events_out_of_scan, n_decoded - n_kept);
+    };
+
+    Snapshot sample() { return sample(Snapshot()); };
+
+    // s carries what the metrics can not see themselves (lines, socket), the rest is filled in
+    Snapshot sample(Snapshot s)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = std::chrono::steady_clock::now();
+        s.time = std::chrono::duration<double>(now - t_reset).count();
+        s.interval = std::chrono::duration<double>(now - t_last).count();
+        s.bytes_read = bytes_read.load(std::memory_order_relaxed);
+        s.buffers_filled = ring.filled.load(std::memory_order_relaxed);
+        s.buffers_processed = ring.processed.load(std::memory_order_relaxed);
+        s.ring_occupancy = (s.buffers_filled > s.buffers_processed) ? s.buffers_filled - s.buffers_processed : 0;
+        s.ring_capacity = ring.capacity.load(std::memory_order_relaxed);
+        s.reader_waits = ring.producer_waits.load(std::memory_order_relaxed);
+        s.decoder_waits = ring.consumer_waits.load(std::memory_order_relaxed);
+        s.events_decoded = events_decoded.load(std::memory_order_relaxed);
+        s.events_accepted = events_accepted.load(std::memory_order_relaxed);
+        s.events_out_of_scan = events_out_of_scan.load(std::memory_order_relaxed);
+        s.frames_processed = frames_processed.load(std::memory_order_relaxed);
+        s.positions_processed = positions_processed.load(std::memory_order_relaxed);
+        uint64_t busy[N_STAGES];
+        for (int i = 0; i < N_STAGES; i++) busy[i] = busy_ns[i].load(std::memory_order_relaxed);
+
+        if (s.interval > 0)
+        {
+            auto rate = [&](uint64_t now_count, uint64_t last_count)
+            {
+                return (now_count >= last_count) ? (now_count - last_count) / s.interval : 0.;
+            };
+            auto fraction = [&](int i)
+            {
+                return std::min(1., rate(busy[i], last_busy[i]) / 1e9);
+            };
+            s.read_rate = rate(s.bytes_read, last.bytes_read);
+            s.event_rate = rate(s.events_accepted, last.events_accepted);
+            s.frame_rate = rate(s.frames_processed, last.frames_processed);
+            s.socket_rate = rate(s.socket_bytes_received, last.socket_bytes_received);
+            s.read_busy = fraction(READ);
+            s.decode_busy = fraction(DECODE);
+            s.process_busy = fraction(PROCESS);
+        }
+        double max_busy = std::max({s.read_busy, s.decode_busy, s.process_busy});
+        if (max_busy > 0.9)
+        {
+            if (max_busy == s.decode_busy) s.bottleneck = "decoder";
+            else if (max_busy == s.process_busy) s.bottleneck = "processor";
+            else s.bottleneck = "reader";
+        }
+
+        last = s;
+        std::copy(busy, busy + N_STAGES, last_busy);
+        t_last = now;
+        return s;
+    };
+
+    // called when a detector attaches, before its threads start
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto *c : {&bytes_read, &events_decoded, &events_accepted, &events_out_of_scan, &frames_processed, &positions_processed})
+            c->store(0, std::memory_order_relaxed);
+        for (auto &b : busy_ns) b.store(0, std::memory_order_relaxed);
+        last = Snapshot();
+        std::fill(last_busy, last_busy + N_STAGES, 0);
+        t_reset = t_last = std::chrono::steady_clock::now();
+    };
+
+    PipelineMetrics() { reset(); };
+
+private:
+    std::mutex mtx;
+    Snapshot last;
+    uint64_t last_busy[N_STAGES] = {};
+    std::chrono::steady_clock::time_point t_reset;
+    std::chrono::steady_clock::time_point t_last;
+};
+
+#endif // PIPELINEMETRICS_HPP
@@ -14,11 +14,16 @@
 
 #include "ProgressMonitor.h"
 
+#include <sstream>
+#include <cstdint>
+
 ProgressMonitor::ProgressMonitor(size_t fr_total, bool b_bar, float report_interval, std::ostream &out) : fr_count(0), fr_count_i(0), fr_freq(0),
                                                                                                           report_set(false), report_set_public(false),
                                                                                                           first_frame(true), fr(0), fr_avg(0), fr_count_a(0),
                                                                                                           time_stamp(chc::high_resolution_clock::now()), unit("kHz"),
-                                                                                                          unit_bar("#"), unit_space("-")
+                                                                                                          unit_bar("#"), unit_space("-"),
+                                                                                                          report_pending(false), report_stop(false),
+                                                                                                          report_idx(0), report_total(0), report_val(0)
 {
     this->fr_total = fr_total;
     this->b_bar = b_bar;
@@ -27,6 +32,19 @@ ProgressMonitor::ProgressMonitor(size_t fr_total, bool b_bar, float report_inter
 
 }
 
+ProgressMonitor::~ProgressMonitor()
+{
+    if (report_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(report_mtx);
+            report_stop = true;
+        }
+        report_cnd.notify_one();
+        report_thread.join();
+    }
+}
+
 int ProgressMonitor::GetBarLength()
 {
     // get console width and according adjust the length of the progress bar
@@ -104,17 +122,48 @@ void ProgressMonitor::reset_flags()
     time_stamp = chc::high_resolution_clock::now();
 }
 
+// processing thread: publishes the numbers, the reporting thread prints them
 void ProgressMonitor::Report(size_t idx, float print_val)
+{
+    progress_percent = idx * TOTAL_PERCENTAGE / fr_total;
+    report_idx = idx;
+    report_total = fr_total;
+    report_val = print_val;
+    report_pending = true;
+    if (!report_thread.joinable()) report_thread = std::thread(&ProgressMonitor::ReportLoop, this);
+    report_cnd.notify_one();
+}
+
+void ProgressMonitor::ReportLoop()
+{
+    size_t last_idx = SIZE_MAX;
+    std::unique_lock<std::mutex> lock(report_mtx);
+    while (true)
+    {
+        report_cnd.wait_for(lock, float_ms(report_interval), [this]{ return report_pending.load() || report_stop.load(); });
+        if (report_pending.exchange(false))
+        {
+            size_t idx = report_idx;
+            if (idx != last_idx) Print(idx, report_val, report_total);
+            last_idx = idx;
+            // at most one bar per interval, the last report is printed on destruction
+            report_cnd.wait_for(lock, float_ms(report_interval), [this]{ return report_stop.load(); });
+        }
+        else if (report_stop) return;
+    }
+}
+
+void ProgressMonitor::Print(size_t idx, float print_val, size_t total)
 {
     try
     {
-        if (idx > fr_total)
+        if (idx > total)
             throw idx;
 
         if (b_bar) // Print out the Progressbar and Frequency
         {
             // calculate percentage of progress
-            progress_percent = idx * TOTAL_PERCENTAGE / fr_total;
+            double percent = idx * TOTAL_PERCENTAGE / total;
 
             // calculate the size of the progress bar
             int bar_size = GetBarLength();
@@ -122,25 +171,27 @@ void ProgressMonitor::Report(size_t idx, float print_val)
             // calculate the percentage value of a unit bar
             double percent_per_unit_bar = TOTAL_PERCENTAGE / bar_size;
 
-            // display progress bar
-            *out << "\r"
+            // display progress bar, assembled first so it reaches the terminal in one write
+            std::ostringstream line;
+            line << "\r"
                  << "[";
 
             for (int bar_length = 0; bar_length <= bar_size - 1; ++bar_length)
             {
-                if (bar_length * percent_per_unit_bar < progress_percent)
+                if (bar_length * percent_per_unit_bar < percent)
                 {
-                    *out << unit_bar;
+                    line << unit_bar;
                 }
                 else
                 {
-                    *out << unit_space;
+                    line << unit_space;
                 }
             }
-            *out << "]" << std::setw(CHARACTER_WIDTH_PERCENTAGE + 1);
-            *out << std::setprecision(2) << std::fixed << print_val << std::fixed << " " << unit << std::flush;
+            line << "]" << std::setw(CHARACTER_WIDTH_PERCENTAGE + 1);
+            line << std::setprecision(2) << std::fixed << print_val << std::fixed << " " << unit;
+            *out << line.str() << std::flush;
         }
-        if (idx >= fr_total)
+        if (idx >= total)
         {
             *out << " " << std::endl
                  << std::flush;
@@ -149,7 +200,7 @@ void ProgressMonitor::Report(size_t idx, float print_val)
     catch (size_t e)
     {
         ClearBarField();
-        std::cerr << "EXCEPTION: frame index (" << e << ") went out of bounds (fr_total = " << fr_total << ")." << std::endl
+        std::cerr << "EXCEPTION: frame index (" << e << ") went out of bounds (fr_total = " << total << ")." << std::endl
                   << std::flush;
     }
 }
\ No newline at end of file
@@ -26,6 +26,9 @@
 #include <chrono>
 #include <cmath>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace chc = std::chrono;
 typedef chc::duration<float, std::milli> float_ms;
@@ -33,6 +36,10 @@ typedef chc::duration<float, std::milli> float_ms;
 #define TOTAL_PERCENTAGE 100.0
 #define CHARACTER_WIDTH_PERCENTAGE 4
 #define TERMINAL_WIDTH 120
+
+// Counts the processed frames and their rate. The progress bar is printed by a reporting thread,
+// started with the first report, so the processing thread never waits on the terminal: Report()
+// only hands over the latest numbers.
 class ProgressMonitor
 {
 
@@ -51,6 +58,7 @@ public:
     void set(int value);
     void reset_flags();
     explicit ProgressMonitor(size_t fr_total, bool b_bar = true, float report_interval = 250.0, std::ostream &out = std::cerr);
+    ~ProgressMonitor();
     double progress_percent;
 
     bool verbose = true;
@@ -70,7 +78,19 @@ private:
     const char *unit_bar;
     const char *unit_space;
 
+    // latest report, handed to the reporting thread
+    std::thread report_thread;
+    std::mutex report_mtx;
+    std::condition_variable report_cnd;
+    std::atomic<bool> report_pending;
+    std::atomic<bool> report_stop;
+    std::atomic<size_t> report_idx;
+    std::atomic<size_t> report_total;
+    std::atomic<float> report_val;
+
     inline void Report(size_t idx, float print_val);
+    void ReportLoop();
+    void Print(size_t idx, float print_val, size_t total);
     inline void ClearBarField();
     inline int GetBarLength();
 };
@@ -0,0 +1,269 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "ReplayServer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+#define MERLIN_FRAME_MAGIC "MQ1,"
+
+void ReplayServer::start_cheetah()
+{
+    start(Socket_type::CLIENT, &ReplayServer::replay_cheetah);
+}
+
+void ReplayServer::start_merlin()
+{
+    start(Socket_type::SERVER, &ReplayServer::replay_merlin);
+}
+
+void ReplayServer::start(Socket_type socket_type, void (ReplayServer::*replay)())
+{
+    stop();
+    file.path = file_path;
+    if (!std::filesystem::exists(file.path))
+    {
+        std::cout << "ReplayServer: " << file_path << " does not exist!" << std::endl;
+        return;
+    }
+    connector.ip = ip;
+    connector.port = port;
+    connector.socket_type = socket_type;
+    connector.rcvbuf_size = 0;
+    connector.receive_ring_size = 0;
+    bytes_sent = 0;
+    frames_sent = 0;
+    elapsed_seconds = 0;
+    b_stop = false;
+    b_running = true;
+    replay_thread = std::thread([this, replay]
+    {
+        connector.connect_socket();
+        if ((connector.socket_type == Socket_type::CLIENT) || wait_for_client())
+        {
+            std::lock_guard<std::mutex> lock(mtx_socket);
+            b_socket_open = !b_stop;
+        }
+        if (b_socket_open) (this->*replay)();
+        {
+            std::lock_guard<std::mutex> lock(mtx_socket);
+            b_socket_open = false;
+            connector.close_socket();
+        }
+        b_running = false;
+    });
+}
+
+// Only the replay thread opens and closes the socket. stop() shuts down an open connection to
+// unblock send(), under mtx_socket so that it never sees a closed (or reused) descriptor.
+void ReplayServer::stop()
+{
+    if (!replay_thread.joinable()) return;
+    b_stop = true;
+    {
+        std::lock_guard<std::mutex> lock(mtx_socket);
+        if (b_socket_open) connector.shutdown_socket();
+    }
+    replay_thread.join();
+}
+
+// Accepts the processor's connection, polling b_stop while no one connects
+bool ReplayServer::wait_for_client()
+{
+    while (!b_stop)
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(connector.rc_socket, &fds);
+        timeval timeout = {0, 50000};
+        int r = select((int)connector.rc_socket + 1, &fds, nullptr, nullptr, &timeout);
+        if (r > 0)
+        {
+            connector.accept_socket();
+            return true;
+        }
+#ifndef _WIN32
+        if ((r < 0) && (errno != EINTR)) return false;
+#else
+        if (r < 0) return false;
+#endif
+    }
+    return false;
+}
+
+void ReplayServer::wait()
+{
+    if (replay_thread.joinable()) replay_thread.join();
+}
+
+ReplayServer::~ReplayServer()
+{
+    stop();
+}
+
+// Pointer to the next data_size bytes of the file, from the mapping if there is one
+const char *ReplayServer::next_data(size_t data_size)
+{
+    const char *p = file.map_data(data_size);
+    if (p) return p;
+    scratch.resize(data_size);
+    file.read_data(scratch.data(), data_size);
+    return scratch.data();
+}
+
+// Sleeps until the bytes sent so far are due at bytes_per_second, and between bursts
+void ReplayServer::pace(size_t n)
+{
+    bytes_paced += n;
+    if (bytes_per_second > 0)
+    {
+        std::this_thread::sleep_until(start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                       std::chrono::duration<double>(bytes_paced / bytes_per_second)));
+    }
+    if (burst_size > 0)
+    {
+        bytes_in_burst += n;
+        if (bytes_in_burst >= burst_size)
+        {
+            bytes_in_burst = 0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(burst_pause));
+            start_time += std::chrono::milliseconds(burst_pause); // the pause does not count towards the rate
+        }
+    }
+}
+
+bool ReplayServer::send_paced(const char *data, size_t data_size)
+{
+    size_t n_sent = 0;
+    while (n_sent < data_size)
+    {
+        if (b_stop) return false;
+        size_t n = std::min(data_size - n_sent, chunk_size);
+        if (burst_size > 0) n = std::min(n, burst_size - bytes_in_burst);
+        if (connector.send_data(data + n_sent, n) == -1) return false;
+        n_sent += n;
+        bytes_sent += n;
+        pace(n);
+    }
+    return true;
+}
+
+bool ReplayServer::next_repetition(int rep)
+{
+    if (b_stop || ((repetitions > 0) && (rep >= repetitions))) return false;
+    if (rep > 0) file.seek_to(0);
+    return true;
+}
+
+void ReplayServer::replay_cheetah()
+{
+    file.open_file();
+    bytes_per_second = rate * 1e6;
+    bytes_paced = 0;
+    bytes_in_burst = 0;
+    start_time = std::chrono::steady_clock::now();
+    for (int rep = 0; next_repetition(rep); rep++)
+    {
+        std::uintmax_t remaining = file.file_size;
+        while (remaining > 0)
+        {
+            size_t n = (size_t)std::min<std::uintmax_t>(remaining, chunk_size);
+            if (!send_paced(next_data(n), n)) break;
+            remaining -= n;
+        }
+        if (remaining > 0) break;
+    }
+    elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "ReplayServer: sent " << bytes_sent / (1024 * 1024) << " MB in " << elapsed_seconds << " s ("
+              << bytes_sent / elapsed_seconds / 1e6 << " MB/s)" << std::endl;
+    file.close_file();
+}
+
+// Size of one .mib frame (header and pixels), found from the position of the second header
+size_t ReplayServer::find_frame_size(size_t &head_size)
+{
+    std::vector<char> probe(std::min<std::uintmax_t>(file.file_size, 64 << 20));
+    file.read_data(probe.data(), probe.size());
+    file.seek_to(0);
+
+    std::string head(probe.data(), std::min<size_t>(probe.size(), 64));
+    std::stringstream ss(head);
+    std::string field;
+    head_size = 0;
+    for (int i = 0; (i < 3) && std::getline(ss, field, ','); i++)
+    {
+        if (i == 0 && field != "MQ1") return 0;
+        if (i == 2) head_size = std::stoul(field);
+    }
+    const char *magic = MERLIN_FRAME_MAGIC;
+    auto it = std::search(probe.begin() + std::min(head_size, probe.size()), probe.end(), magic, magic + std::strlen(magic));
+    if (it == probe.end()) return (size_t)file.file_size; // a single frame
+    return (size_t)(it - probe.begin());
+}
+
+void ReplayServer::replay_merlin()
+{
+    file.open_file();
+    size_t head_size = 0;
+    size_t frame_size = find_frame_size(head_size);
+    if (frame_size == 0)
+    {
+        std::cout << "ReplayServer: " << file_path << " is not a Merlin .mib file!" << std::endl;
+        file.close_file();
+        return;
+    }
+    // the TCP header "MPX,<size>," has 10 digits for the size of the frame
+    const size_t max_mpx_size = 9999999999ULL;
+    if (frame_size > max_mpx_size)
+    {
+        std::cout << "ReplayServer: frames of " << frame_size << " bytes do not fit the MPX header!" << std::endl;
+        file.close_file();
+        return;
+    }
+    size_t n_frames = (size_t)(file.file_size / frame_size);
+    char tcp_head[32];
+
+    std::string acq = "HDR,\nFrames in Acquisition (Number):\t" + std::to_string(n_frames) + "\nReplayed from:\t" + file_path + "\nEnd\t";
+    snprintf(tcp_head, sizeof(tcp_head), "MPX,%010zu,", acq.size());
+    if ((connector.send_data(tcp_head, 15) == -1) || (connector.send_data(acq.data(), acq.size()) == -1))
+    {
+        file.close_file();
+        return;
+    }
+
+    bytes_per_second = (frame_rate > 0) ? frame_rate * (frame_size + 15) : rate * 1e6;
+    bytes_paced = 0;
+    bytes_in_burst = 0;
+    start_time = std::chrono::steady_clock::now();
+    snprintf(tcp_head, sizeof(tcp_head), "MPX,%010zu,", frame_size);
+    bool b_sending = true;
+    for (int rep = 0; b_sending && next_repetition(rep); rep++)
+    {
+        for (size_t i = 0; i < n_frames; i++)
+        {
+            if (!(b_sending = send_paced(tcp_head, 15) && send_paced(next_data(frame_size), frame_size))) break;
+            ++frames_sent;
+        }
+    }
+    elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "ReplayServer: sent " << frames_sent << " frames (" << bytes_sent / (1024 * 1024) << " MB) in "
+              << elapsed_seconds << " s (" << frames_sent / elapsed_seconds << " frames/s)" << std::endl;
+    file.close_file();
+}
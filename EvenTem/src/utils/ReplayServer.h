@@ -0,0 +1,87 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef REPLAY_SERVER_H
+#define REPLAY_SERVER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "SocketConnector.h"
+#include "FileConnector.h"
+
+// Stand-in for a detector in live mode: streams a recorded file to a LiveProcessor over TCP.
+//   start_cheetah(): connects as client to the SERVER socket of set_socket(..., "CHEETAH") and
+//                    sends the .tpx3 file as it is.
+//   start_merlin():  listens like the Merlin does for set_socket(..., "MERLIN"), sends an
+//                    acquisition header and then every frame of the .mib file with its TCP header.
+// The stream is paced to 'rate' MB/s (Merlin: 'frame_rate' frames/s), 0 sends as fast as
+// possible. With burst_size set, the data goes out in bursts of burst_size bytes separated by
+// burst_pause ms. The replay runs on its own thread, so the processor can run in the same process.
+class ReplayServer
+{
+public:
+    std::string file_path;
+    std::string ip = "127.0.0.1";
+    int port = 6342;
+    double rate = 0;          // MB/s, 0 for as fast as possible
+    double frame_rate = 0;    // Merlin frames/s, overrides rate
+    size_t burst_size = 0;    // bytes per burst, 0 for a continuous stream
+    int burst_pause = 0;      // ms between bursts
+    int repetitions = 1;      // times the file is sent, 0 repeats until stop()
+    size_t chunk_size = 1 << 20;
+
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> frames_sent{0};
+    double elapsed_seconds = 0;
+
+    void start_cheetah();
+    void start_merlin();
+    void stop();
+    void wait();
+    bool is_running() const { return b_running.load(); };
+
+    ReplayServer() {};
+    ~ReplayServer();
+
+private:
+    SocketConnector connector;
+    FileConnector file;
+    std::thread replay_thread;
+    std::atomic<bool> b_running{false};
+    std::atomic<bool> b_stop{false};
+    std::mutex mtx_socket;      // stop() against the replay thread closing the socket
+    bool b_socket_open = false; // connected and not yet closed, guarded by mtx_socket
+    std::vector<char> scratch;
+
+    std::chrono::steady_clock::time_point start_time;
+    double bytes_per_second = 0;
+    uint64_t bytes_paced = 0;
+    uint64_t bytes_in_burst = 0;
+
+    void start(Socket_type socket_type, void (ReplayServer::*replay)());
+    bool wait_for_client();
+    void replay_cheetah();
+    void replay_merlin();
+    size_t find_frame_size(size_t &head_size);
+    const char *next_data(size_t data_size);
+    bool send_paced(const char *data, size_t data_size);
+    void pace(size_t n);
+    bool next_repetition(int rep);
+};
+#endif // REPLAY_SERVER_H
@@ -0,0 +1,215 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "ScanPattern.h"
+
+#include <cmath>
+#include <random>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    const uint64_t magic = 0x314E414353545645; // "EVTSCAN1"
+
+    struct file_header
+    {
+        uint64_t magic;
+        uint32_t nx;
+        uint32_t ny;
+        uint64_t n;
+    };
+}
+
+ScanPattern ScanPattern::raster(int nx, int ny)
+{
+    ScanPattern p;
+    p.lut.resize((size_t)nx * ny);
+    for (size_t i = 0; i < p.lut.size(); i++) p.lut[i] = (uint32_t)i;
+    p.finish(nx, ny);
+    return p;
+}
+
+ScanPattern ScanPattern::serpentine(int nx, int ny)
+{
+    ScanPattern p;
+    p.lut.reserve((size_t)nx * ny);
+    for (int y = 0; y < ny; y++)
+    {
+        for (int i = 0; i < nx; i++) p.lut.push_back(y * nx + ((y % 2 == 0) ? i : nx - 1 - i));
+    }
+    p.finish(nx, ny);
+    return p;
+}
+
+ScanPattern ScanPattern::spiral(int nx, int ny)
+{
+    ScanPattern p;
+    p.lut.reserve((size_t)nx * ny);
+    int x0 = 0, x1 = nx - 1, y0 = 0, y1 = ny - 1;
+    while ((x0 <= x1) && (y0 <= y1))
+    {
+        for (int x = x0; x <= x1; x++) p.lut.push_back(y0 * nx + x);
+        for (int y = y0 + 1; y <= y1; y++) p.lut.push_back(y * nx + x1);
+        if (y0 < y1) for (int x = x1 - 1; x >= x0; x--) p.lut.push_back(y1 * nx + x);
+        if (x0 < x1) for (int y = y1 - 1; y > y0; y--) p.lut.push_back(y * nx + x0);
+        x0++; x1--; y0++; y1--;
+    }
+    p.finish(nx, ny);
+    return p;
+}
+
+ScanPattern ScanPattern::random_sparse(int nx, int ny, double fraction, uint64_t seed)
+{
+    if ((fraction <= 0) || (fraction > 1)) throw std::invalid_argument("fraction must be in (0, 1]");
+    ScanPattern p = raster(nx, ny);
+    std::mt19937_64 rng(seed);
+    std::shuffle(p.lut.begin(), p.lut.end(), rng);
+    p.lut.resize(std::max<size_t>(1, (size_t)std::llround(fraction * p.lut.size())));
+    std::sort(p.lut.begin(), p.lut.end());
+    p.finish(nx, ny);
+    return p;
+}
+
+ScanPattern ScanPattern::subsampled(int nx, int ny, int step_x, int step_y)
+{
+    if ((step_x < 1) || (step_y < 1)) throw std::invalid_argument("steps must be >= 1");
+    ScanPattern p;
+    for (int y = 0; y < ny; y += step_y)
+    {
+        for (int x = 0; x < nx; x += step_x) p.lut.push_back(y * nx + x);
+    }
+    p.finish(nx, ny);
+    return p;
+}
+
+ScanPattern ScanPattern::from_positions(int nx, int ny, const std::vector<uint32_t> &positions)
+{
+    ScanPattern p;
+    p.lut = positions;
+    p.finish(nx, ny);
+    return p;
+}
+
+bool ScanPattern::load(const std::string &path, int _nx, int _ny)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "ScanPattern: Unable to open " << path << std::endl;
+        return false;
+    }
+    file_header h = {0, 0, 0, 0};
+    file.read((char *)&h, sizeof(h));
+    std::vector<uint32_t> positions;
+    if (file && (h.magic == magic))
+    {
+        if (((int)h.nx != _nx) || ((int)h.ny != _ny))
+        {
+            std::cout << "ScanPattern: " << path << " is a " << h.nx << "x" << h.ny << " scan, not " << _nx << "x" << _ny << std::endl;
+            return false;
+        }
+        positions.resize(h.n);
+        file.read((char *)positions.data(), h.n * sizeof(uint32_t));
+        if (!file)
+        {
+            std::cout << "ScanPattern: " << path << " is truncated" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        // text: one position per line, written as numbers of any format
+        file.clear();
+        file.seekg(0);
+        double element;
+        while (file >> element) positions.push_back(((element >= 0) && (element < (double)_nx * _ny)) ? (uint32_t)element : skip);
+    }
+    try
+    {
+        *this = from_positions(_nx, _ny, positions);
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cout << "ScanPattern: " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+    std::cout << "Scan pattern read: " << lut.size() << " positions" << std::endl;
+    return true;
+}
+
+bool ScanPattern::save(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "ScanPattern: Error opening " << path << "!" << std::endl;
+        return false;
+    }
+    file_header h = {magic, (uint32_t)nx, (uint32_t)ny, lut.size()};
+    file.write((const char *)&h, sizeof(h));
+    file.write((const char *)lut.data(), lut.size() * sizeof(uint32_t));
+    return (bool)file;
+}
+
+bool ScanPattern::is_raster() const
+{
+    if (lut.size() != (size_t)nx * ny) return false;
+    for (size_t i = 0; i < lut.size(); i++)
+    {
+        if (lut[i] != i) return false;
+    }
+    return true;
+}
+
+bool ScanPattern::is_permutation() const
+{
+    if (lut.size() != (size_t)nx * ny) return false;
+    std::vector<bool> seen(lut.size(), false);
+    for (uint32_t pp : lut)
+    {
+        if ((pp == skip) || seen[pp]) return false;
+        seen[pp] = true;
+    }
+    return true;
+}
+
+// Checks the positions and tabulates lines_complete(): line y is done once the last trigger
+// visiting it has passed, a prefix of lines once all of them are.
+void ScanPattern::finish(int _nx, int _ny)
+{
+    if ((_nx <= 0) || (_ny <= 0)) throw std::invalid_argument("scan size must be positive");
+    if (lut.empty()) throw std::invalid_argument("scan pattern has no triggers");
+    nx = _nx;
+    ny = _ny;
+    std::vector<uint64_t> line_done_at(ny, 0); // triggers after which the line is done
+    for (size_t i = 0; i < lut.size(); i++)
+    {
+        if (lut[i] == skip) continue;
+        if (lut[i] >= (uint64_t)nx * ny) throw std::invalid_argument("scan position outside of the scan");
+        line_done_at[lut[i] / nx] = i + 1;
+    }
+    lines_done.assign(lut.size(), 0);
+    uint64_t prefix_done_at = 0;
+    size_t t = 0;
+    for (int y = 0; y < ny; y++)
+    {
+        prefix_done_at = std::max(prefix_done_at, line_done_at[y]);
+        // lines 0..y are done from prefix_done_at triggers on
+        for (; (t < lines_done.size()) && (t < prefix_done_at); t++) lines_done[t] = y;
+    }
+    for (; t < lines_done.size(); t++) lines_done[t] = ny;
+}
@@ -0,0 +1,76 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef SCAN_PATTERN_H
+#define SCAN_PATTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+
+// Order in which the probe visits the nx * ny scan positions: a lookup table from the trigger
+// index within one frame to the probe position (row major, y * nx + x), repeated every frame.
+// Triggers without a position (flyback, dead time) hold skip.
+//
+// The processors work on complete scan lines. For a non-raster order, lines_complete() gives the
+// number of leading scan lines whose visited positions are all done after a number of triggers;
+// positions the pattern never visits count as done. For a raster scan this is triggers / nx.
+//
+// Pixel triggered detectors (CHEETAH_pixeltrig, the frame based ones) take any pattern. The line
+// timed detectors derive the position from the time within a line, they take a reordering of the
+// whole frame (is_permutation(), e.g. serpentine or spiral), applied to the decoded positions.
+class ScanPattern
+{
+public:
+    static const uint32_t skip = 0xFFFFFFFF;
+
+    int nx = 0;
+    int ny = 0;
+
+    static ScanPattern raster(int nx, int ny);
+    static ScanPattern serpentine(int nx, int ny);                   // odd lines right to left
+    static ScanPattern spiral(int nx, int ny);                       // clockwise from (0, 0) inwards
+    static ScanPattern random_sparse(int nx, int ny, double fraction, uint64_t seed = 0); // in raster order
+    static ScanPattern subsampled(int nx, int ny, int step_x, int step_y);
+    static ScanPattern from_positions(int nx, int ny, const std::vector<uint32_t> &positions);
+
+    // binary LUT written by save(), or the older text files with one position per line
+    bool load(const std::string &path, int nx, int ny);
+    bool save(const std::string &path) const;
+
+    size_t size() const { return lut.size(); };
+    bool empty() const { return lut.empty(); };
+    bool is_raster() const;
+    bool is_permutation() const;
+    const std::vector<uint32_t> &positions() const { return lut; };
+
+    inline uint32_t position(uint64_t trigger) const
+    {
+        return lut[trigger % lut.size()];
+    };
+
+    inline uint64_t lines_complete(uint64_t triggers) const
+    {
+        return (triggers / lut.size()) * ny + lines_done[triggers % lut.size()];
+    };
+
+private:
+    std::vector<uint32_t> lut;        // trigger -> probe position
+    std::vector<uint32_t> lines_done; // triggers in the frame -> complete leading lines
+
+    void finish(int _nx, int _ny);
+};
+
+#endif // SCAN_PATTERN_H
@@ -15,9 +15,308 @@
 #include "SocketConnector.h"
 #include<vector>
 #include<cstdint>
+#include<cstring>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#include<cstdlib>
+#include<filesystem>
+
+#ifdef ZSTD_ENABLED
+#include <zstd.h>
+#endif
+
+// Sum of the TcpExt counters of packets the kernel dropped on the receive side. TCP has no per
+// socket drop counter, so this is system wide and only meaningful as a difference.
+static uint64_t tcp_receive_drops()
+{
+    uint64_t drops = 0;
+#ifdef __linux__
+    std::ifstream netstat("/proc/net/netstat");
+    std::string names, values;
+    while (std::getline(netstat, names) && std::getline(netstat, values))
+    {
+        if (names.rfind("TcpExt:", 0) != 0) continue;
+        std::istringstream n(names), v(values);
+        std::string name, value;
+        while ((n >> name) && (v >> value))
+        {
+            if (name == "TCPRcvQDrop" || name == "TCPBacklogDrop" || name == "TCPZeroWindowDrop" || name == "TCPOFODrop")
+            {
+                drops += std::stoull(value);
+            }
+        }
+    }
+#endif
+    return drops;
+}
+
+// the last recv() or send() was interrupted by a signal before it transferred anything: retry it
+static bool interrupted()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEINTR;
+#else
+    return errno == EINTR;
+#endif
+}
+
+void SocketReceiver::start(SOCKET _socket, size_t _ring_size, const std::string &record_path, int _compression_level,
+                           Record_format _record_format)
+{
+    stop();
+    socket = _socket;
+    if ((!ring) || (ring_size != _ring_size))
+    {
+        ring_size = _ring_size;
+        ring.reset(new char[ring_size]);
+    }
+    p_index.reset(new SpscRing(ring_size));
+    bytes_received = 0;
+    bytes_read = 0;
+    peak_occupancy = 0;
+    kernel_drops = 0;
+    kernel_drops_at_start = tcp_receive_drops();
+    b_finished = false;
+    b_running = true;
+    p_record_index.reset();
+    record_format = _record_format;
+    if ((!record_path.empty()) && open_record(record_path, _compression_level))
+    {
+        p_record_index.reset(new SpscRing(ring_size));
+        record_thread = std::thread(&SocketReceiver::record, this);
+    }
+    receive_thread = std::thread(&SocketReceiver::receive, this);
+}
+
+void SocketReceiver::receive()
+{
+    auto stop = [this]{ return !b_running.load(); };
+    while (b_running)
+    {
+        if (!p_index->wait_for_space(stop)) break;
+        if (p_record_index && !p_record_index->wait_for_space(stop)) break;
+        uint64_t w = p_index->filled();
+        size_t space = (p_record_index) ? std::min(p_index->space(), p_record_index->space()) : p_index->space();
+        size_t n = std::min({space, ring_size - (size_t)(w % ring_size), chunk_size});
+        int r = recv(socket, &ring[w % ring_size], (int)n, 0);
+        if ((r < 0) && interrupted()) continue;
+        if (r <= 0)
+        {
+            if (r == -1 && b_running) perror("SocketReceiver::receive(): Error reading Data!");
+            break;
+        }
+        p_index->push(r);
+        if (p_record_index) p_record_index->push(r);
+        bytes_received.fetch_add(r, std::memory_order_relaxed);
+        peak_occupancy = std::max(peak_occupancy, p_index->filled() - p_index->processed());
+    }
+    b_finished = true;
+    p_index->push(0); // wakes a waiting reader
+    if (p_record_index) p_record_index->push(0);
+}
+
+bool SocketReceiver::open_record(const std::string &record_path, int _compression_level)
+{
+    compression_level = _compression_level;
+    std::string path = record_path;
+#ifdef ZSTD_ENABLED
+    if (compression_level > 0)
+    {
+        if ((path.size() < 4) || (path.compare(path.size() - 4, 4, ".zst") != 0)) path += ".zst";
+        compressed.resize(ZSTD_compressBound(chunk_size));
+    }
+#else
+    if (compression_level > 0)
+    {
+        std::cout << "SocketReceiver: built without ZSTD, recording uncompressed" << std::endl;
+        compression_level = 0;
+    }
+#endif
+    record_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!record_file.is_open())
+    {
+        std::cout << "SocketReceiver: Error opening " << path << " for recording!" << std::endl;
+        return false;
+    }
+    bytes_recorded = 0;
+    bytes_written = 0;
+    std::cout << "Recording socket stream to " << path << std::endl;
+    if (record_format == RECORD_MIB)
+    {
+        std::filesystem::path header_path = std::filesystem::path(record_path).replace_extension(".hdr");
+        header_file.open(header_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!header_file.is_open()) std::cout << "SocketReceiver: Error opening " << header_path << " for the acquisition header!" << std::endl;
+        mpx_head_n = 0;
+        mpx_left = 0;
+        n_messages = 0;
+    }
+    return true;
+}
+
+// Second consumer of the ring: writes the blocks in the order received, as they are or as .mib
+void SocketReceiver::record()
+{
+    while (true)
+    {
+        uint64_t n_available = p_record_index->available();
+        if (n_available == 0)
+        {
+            if (!p_record_index->wait_for_data([this]{ return b_finished.load(); }) && (p_record_index->available() == 0)) break;
+            continue;
+        }
+        uint64_t r = p_record_index->processed();
+        size_t n = std::min({(size_t)n_available, ring_size - (size_t)(r % ring_size), chunk_size});
+        if (record_format == RECORD_MIB) record_mib(&ring[r % ring_size], n);
+        else write_block(&ring[r % ring_size], n);
+        p_record_index->pop(n);
+        bytes_recorded += n;
+    }
+    record_file.close();
+    if (header_file.is_open()) header_file.close();
+}
+
+// Merlin stream: messages of a 15 byte prefix "MPX,%010zu," and that many bytes of payload,
+// split anywhere between the blocks. The first payload is the acquisition header, the others
+// are the frames with their "MQ1," headers, which are the .mib file.
+void SocketReceiver::record_mib(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        if (mpx_left == 0)
+        {
+            size_t n = std::min(size, sizeof(mpx_head) - mpx_head_n);
+            std::memcpy(mpx_head + mpx_head_n, data, n);
+            mpx_head_n += n;
+            data += n;
+            size -= n;
+            if (mpx_head_n < sizeof(mpx_head)) return;
+            mpx_head_n = 0;
+            if (std::strncmp(mpx_head, "MPX,", 4) != 0)
+            {
+                std::cout << "SocketReceiver: no MPX header in the Merlin stream, recording the rest as received" << std::endl;
+                record_format = RECORD_RAW;
+                write_block(mpx_head, sizeof(mpx_head));
+                write_block(data, size);
+                return;
+            }
+            mpx_left = std::strtoull(std::string(mpx_head + 4, 10).c_str(), nullptr, 10);
+            if (mpx_left == 0) end_message();
+            continue;
+        }
+        size_t n = (size_t)std::min<uint64_t>(size, mpx_left);
+        if (n_messages == 0) header_file.write(data, n);
+        else write_block(data, n);
+        mpx_left -= n;
+        data += n;
+        size -= n;
+        if (mpx_left == 0) end_message();
+    }
+}
+
+void SocketReceiver::end_message()
+{
+    if ((n_messages == 0) && header_file.is_open()) header_file.close();
+    ++n_messages;
+}
+
+void SocketReceiver::write_block(const char *data, size_t size)
+{
+#ifdef ZSTD_ENABLED
+    if (compression_level > 0)
+    {
+        size_t n = ZSTD_compress(compressed.data(), compressed.size(), data, size, compression_level);
+        if (!ZSTD_isError(n))
+        {
+            record_file.write(compressed.data(), n);
+            bytes_written += n;
+            return;
+        }
+        std::cout << "SocketReceiver: " << ZSTD_getErrorName(n) << ", recording uncompressed" << std::endl;
+        compression_level = 0;
+    }
+#endif
+    record_file.write(data, size);
+    bytes_written += size;
+}
+
+int SocketReceiver::read(char *buffer, size_t data_size)
+{
+    size_t n_read = 0;
+    while (n_read < data_size)
+    {
+        uint64_t n_available = p_index->available();
+        if (n_available == 0)
+        {
+            if (!p_index->wait_for_data([this]{ return b_finished.load(); }))
+            {
+                // the stream ended, take what arrived before
+                n_available = p_index->available();
+                if (n_available == 0) return -1;
+            }
+            continue;
+        }
+        uint64_t r = p_index->processed();
+        size_t n = std::min({(size_t)n_available, data_size - n_read, ring_size - (size_t)(r % ring_size)});
+        std::memcpy(buffer + n_read, &ring[r % ring_size], n);
+        p_index->pop(n);
+        bytes_read.fetch_add(n, std::memory_order_relaxed);
+        n_read += n;
+    }
+    return 0;
+}
+
+void SocketReceiver::stop()
+{
+    if (receive_thread.joinable())
+    {
+        b_running = false;
+#ifdef WIN32
+        shutdown(socket, SD_BOTH);
+#else
+        shutdown(socket, SHUT_RDWR);
+#endif
+        receive_thread.join();
+        if (record_thread.joinable()) record_thread.join();
+        print_statistics();
+    }
+    b_running = false;
+}
+
+void SocketReceiver::print_statistics()
+{
+    kernel_drops = tcp_receive_drops() - kernel_drops_at_start;
+    std::cout << "Socket received " << bytes_received / (1024 * 1024) << " MB, ring peak "
+              << peak_occupancy / (1024 * 1024) << " of " << ring_size / (1024 * 1024) << " MB, "
+              << receiver_stalls() << " stalls (ring full)";
+#ifdef __linux__
+    std::cout << ", " << kernel_drops << " TCP receive drops (system wide)";
+#endif
+    std::cout << std::endl;
+    if (p_record_index)
+    {
+        std::cout << "Recorded " << bytes_recorded / (1024 * 1024) << " MB (" << bytes_written / (1024 * 1024) << " MB written), "
+                  << recorder_stalls() << " stalls waiting for the disk" << std::endl;
+    }
+}
+
+SocketReceiver::~SocketReceiver()
+{
+    stop();
+}
+
+void SocketConnector::start_receiver()
+{
+    if (!receiver->is_running()) receiver->start(*socket_ptr, receive_ring_size, record_path, record_compression, record_format);
+}
 
 int SocketConnector::read_data(char *buffer, int data_size)
 {
+    if (receive_ring_size > 0)
+    {
+        start_receiver();
+        return receiver->read(buffer, data_size);
+    }
     int bytes_payload_total = 0;
     while (bytes_payload_total < data_size)
     {
@@ -27,6 +326,7 @@ int SocketConnector::read_data(char *buffer, int data_size)
                                    &buffer[bytes_payload_total],
                                    data_size - bytes_payload_total,
                                    0);
+        if ((bytes_payload_count == -1) && interrupted()) continue;
         if (bytes_payload_count == -1)
         {
             perror("Error reading Data!");
@@ -43,18 +343,43 @@ int SocketConnector::read_data(char *buffer, int data_size)
     
 }
 
+int SocketConnector::send_data(const char *buffer, size_t data_size)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // a closed peer returns an error instead of raising SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    size_t bytes_total = 0;
+    while (bytes_total < data_size)
+    {
+        int bytes_count = send(*socket_ptr,
+                               &buffer[bytes_total],
+                               (int)std::min<size_t>(data_size - bytes_total, 1 << 30),
+                               flags);
+        if ((bytes_count < 0) && interrupted()) continue;
+        if (bytes_count <= 0)
+        {
+            perror("Error sending Data!");
+            return -1;
+        }
+        bytes_total += bytes_count;
+    }
+    return 0;
+}
+
 void SocketConnector::flush_socket()
 {
     close_socket();
     connect_socket();
-    char *buffer = {0};
+    std::vector<char> buffer(1 << 16);
     int bytes_total = 0;
 
     while (true)
     {
         // int bytes_count = recv(client_socket, &buffer[0], 1, 0); //worked for cheetah
         // int bytes_count = recv(rc_socket, &buffer[0], 1, 0); //worked for merlin
-        int bytes_count = recv(*socket_ptr, &buffer[0], 1, 0);
+        int bytes_count = recv(*socket_ptr, &buffer[0], buffer.size(), 0);
 
         if (bytes_count <= 0)
         {
@@ -70,7 +395,7 @@ void SocketConnector::accept_socket(){
     std::cout << "accepting socket" << std::endl;
     client_socket = -1;
     socklen_t addrlen = sizeof(c_address);
-    while (client_socket == -1) {
+    while (client_socket == -1 && b_connected) {
         client_socket = accept(rc_socket, (struct sockaddr*)&c_address, &addrlen);
     }
     std::cout << "accepted socket" << std::endl;
@@ -138,6 +463,7 @@ void SocketConnector::connect_socket()
     {
         handle_socket_errors("setting socket options");
     }
+    set_receive_buffer();
 
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = inet_addr(ip.c_str());
@@ -156,6 +482,38 @@ void SocketConnector::connect_socket()
     std::cout << "connected socket" << std::endl;
 }
 
+// A large kernel buffer lets the TCP window open wide enough for the detector line rate. It has
+// to be set before connect/listen, accepted sockets inherit it.
+void SocketConnector::set_receive_buffer()
+{
+    if (rcvbuf_size <= 0) return;
+    if (setsockopt(rc_socket, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf_size, sizeof(rcvbuf_size)) == SOCKET_ERROR)
+    {
+        handle_socket_errors("setting the receive buffer size");
+    }
+    int actual_size = 0;
+    socklen_t size_len = sizeof(actual_size);
+    getsockopt(rc_socket, SOL_SOCKET, SO_RCVBUF, (char *)&actual_size, &size_len);
+    std::cout << "Socket receive buffer: " << actual_size / 1024 << " kB (requested " << rcvbuf_size / 1024 << " kB)" << std::endl;
+#ifdef __linux__
+    if (actual_size < rcvbuf_size) std::cout << "Raise net.core.rmem_max to allow a larger receive buffer." << std::endl;
+#endif
+}
+
+// Unblocks a thread waiting in accept(), recv() or send() on this connection, close_socket()
+// is still up to that thread.
+void SocketConnector::shutdown_socket()
+{
+    b_connected = false;
+#ifdef WIN32
+    if (client_socket != INVALID_SOCKET) shutdown(client_socket, SD_BOTH);
+    shutdown(rc_socket, SD_BOTH);
+#else
+    if (client_socket != INVALID_SOCKET) shutdown(client_socket, SHUT_RDWR);
+    shutdown(rc_socket, SHUT_RDWR);
+#endif
+}
+
 #ifdef WIN32
 void SocketConnector::handle_socket_errors(const std::string &raised_at)
 {
@@ -171,6 +529,9 @@ void SocketConnector::handle_socket_errors(const std::string &raised_at)
 
 void SocketConnector::close_socket()
 {
+    receiver->stop();
+    if (client_socket != INVALID_SOCKET) closesocket(client_socket);
+    client_socket = INVALID_SOCKET;
     closesocket(rc_socket);
     b_connected = false;
     WSACleanup();
@@ -185,6 +546,9 @@ void SocketConnector::handle_socket_errors(const std::string &raised_at)
 
 void SocketConnector::close_socket()
 {
+    receiver->stop();
+    if (client_socket != INVALID_SOCKET) close(client_socket);
+    client_socket = INVALID_SOCKET;
     close(rc_socket);
     b_connected = false;
 }
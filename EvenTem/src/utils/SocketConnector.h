@@ -33,8 +33,85 @@
 
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "SpscRing.hpp"
 
 enum Socket_type {SERVER,CLIENT};
+
+// What the recorder writes: the stream as received, or a Merlin stream without its TCP framing
+enum Record_format {RECORD_RAW,RECORD_MIB};
+
+// Receives a TCP stream on its own thread into a large contiguous ring, in chunks as large as
+// the free space allows. The detectors take their frames out of the ring with read(), so the
+// kernel buffer is drained at line rate however the consumer reads.
+// Optionally a second reader of the same ring writes the received bytes unchanged to a file
+// (record_path), on its own thread and straight from the ring. With compression_level > 0 (and
+// a build with ZSTD) every block is written as an independent zstd frame, the file then
+// decompresses with 'zstd -d' to the raw stream. The ring only frees bytes that both readers
+// are done with, so a disk that can not keep up throttles the sender instead of losing data.
+// With RECORD_MIB the "MPX,<length>," message prefixes of the Merlin are dropped: the frames go
+// to the file as a .mib file that the MERLIN file mode and ReplayServer read, the acquisition
+// header (first message) to a .hdr file next to it, like the Merlin software saves them.
+class SocketReceiver
+{
+public:
+    size_t chunk_size = 4 << 20; // largest single recv()
+
+    void start(SOCKET _socket, size_t ring_size, const std::string &record_path = "", int compression_level = 0,
+               Record_format record_format = RECORD_RAW);
+    void stop();
+    bool is_running() const { return b_running.load(); };
+    int read(char *buffer, size_t data_size); // 0 on success, -1 if the stream ended first
+    void print_statistics();
+
+    std::atomic<uint64_t> bytes_received{0}; // may be read while receiving
+    std::atomic<uint64_t> bytes_read{0};     // handed to the detector by read()
+    uint64_t peak_occupancy = 0;     // most bytes waiting in the ring
+    uint64_t kernel_drops = 0;       // TCP receive queue drops of the system while receiving (Linux)
+    uint64_t bytes_recorded = 0;     // raw bytes passed to the recorder
+    uint64_t bytes_written = 0;      // bytes written to the file, after compression
+    int receiver_stalls() const { return (p_index) ? p_index->producer_waits : 0; }; // ring was full
+    int recorder_stalls() const { return (p_record_index) ? p_record_index->producer_waits : 0; }; // recorder behind
+
+    ~SocketReceiver();
+
+private:
+    SOCKET socket = INVALID_SOCKET;
+    std::unique_ptr<char[]> ring;
+    std::unique_ptr<SpscRing> p_index; // byte indices of the ring
+    size_t ring_size = 0;
+    std::thread receive_thread;
+    std::atomic<bool> b_running{false};
+    std::atomic<bool> b_finished{false};
+    uint64_t kernel_drops_at_start = 0;
+
+    std::unique_ptr<SpscRing> p_record_index; // recorder's read position in the same ring
+    std::thread record_thread;
+    std::ofstream record_file;
+    int compression_level = 0;
+    std::vector<char> compressed;
+
+    // RECORD_MIB: position in the current Merlin message
+    Record_format record_format = RECORD_RAW;
+    std::ofstream header_file;
+    char mpx_head[15];
+    size_t mpx_head_n = 0;  // bytes of the message prefix seen
+    uint64_t mpx_left = 0;  // payload bytes of the message still to come
+    uint64_t n_messages = 0;
+
+    void receive();
+    bool open_record(const std::string &record_path, int _compression_level);
+    void record();
+    void write_block(const char *data, size_t size);
+    void record_mib(const char *data, size_t size);
+    void end_message();
+};
+
 class SocketConnector
 {
 public:
@@ -49,13 +126,28 @@ public:
     int port;
 
     std::string connection_information;
+    int rcvbuf_size;          // requested SO_RCVBUF, 0 keeps the system default
+    size_t receive_ring_size; // bytes buffered by the receive thread, 0 reads on the caller's thread
+    std::shared_ptr<SocketReceiver> receiver; // shared by the copies handed to the detectors
+    std::string record_path;  // tee the received stream to this file (needs the receive ring), empty to disable
+    int record_compression;   // zstd level for the recording, 0 writes the raw bytes
+    Record_format record_format; // set by the detector, RECORD_MIB for the Merlin
+
     int read_data(char *buffer, int data_size);
+    int send_data(const char *buffer, size_t data_size);
     void flush_socket();
     void connect_socket();
     void close_socket();
+    void shutdown_socket();
     void accept_socket();
     SocketConnector() : rc_socket(INVALID_SOCKET),
-                        b_connected(false)
+                        client_socket(INVALID_SOCKET),
+                        b_connected(false),
+                        rcvbuf_size(64 << 20),
+                        receive_ring_size(256 << 20),
+                        receiver(std::make_shared<SocketReceiver>()),
+                        record_compression(0),
+                        record_format(RECORD_RAW)
     {
     };
 
@@ -64,6 +156,8 @@ private:
     struct sockaddr_in c_address;
     void init_connect();
     void init_listen();
+    void set_receive_buffer();
+    void start_receiver();
 #ifdef WIN32
     WSADATA w;
     const char opt = 1;
@@ -0,0 +1,185 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef SPSCRING_HPP
+#define SPSCRING_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+
+// Index pair of a single-producer/single-consumer ring of buffers; the buffers themselves are
+// owned by the detector. The producer fills slot filled() % capacity and publishes it with
+// push(), the consumer reads slots processed() % capacity and hands them back with pop().
+// Publishing uses release stores and reading acquire loads, so the buffer contents are visible
+// to the other side without locks. A side that has to wait sleeps on a condition variable and is
+// woken by the other side, or spins when busy polling is enabled (lowest latency, burns a core).
+// Waits also return after stop_check_interval to re-evaluate the stop condition.
+
+// Copy of the ring state that other threads may read while the ring is in use, kept up to date
+// with relaxed stores when attached with set_counters() (see PipelineMetrics).
+struct RingCounters
+{
+    std::atomic<uint64_t> filled{0};
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> producer_waits{0};
+    std::atomic<uint64_t> consumer_waits{0};
+    std::atomic<uint64_t> capacity{0};
+};
+
+class SpscRing
+{
+private:
+    alignas(64) std::atomic<uint64_t> n_filled{0};
+    alignas(64) std::atomic<uint64_t> n_processed{0};
+    alignas(64) std::atomic<bool> producer_waiting{false};
+    std::atomic<bool> consumer_waiting{false};
+    uint64_t n_capacity;
+    bool busy_poll = false;
+    std::mutex mtx;
+    std::condition_variable cnd_filled;
+    std::condition_variable cnd_processed;
+    const std::chrono::milliseconds stop_check_interval{10};
+    RingCounters *p_counters = nullptr;
+
+    template <typename Ready, typename Stop>
+    inline bool wait(Ready &&ready, Stop &&stop, std::atomic<bool> &waiting, std::condition_variable &cnd, int &n_waits,
+                     std::atomic<uint64_t> RingCounters::*counter)
+    {
+        if (ready()) return true;
+        ++n_waits;
+        if (p_counters) (p_counters->*counter).store(n_waits, std::memory_order_relaxed);
+        if (busy_poll)
+        {
+            while (!ready())
+            {
+                if (stop()) return false;
+                std::this_thread::yield();
+            }
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready())
+        {
+            if (stop())
+            {
+                waiting.store(false);
+                return false;
+            }
+            cnd.wait_for(lock, stop_check_interval);
+        }
+        waiting.store(false);
+        return true;
+    };
+
+    inline void wake(std::atomic<bool> &waiting, std::condition_variable &cnd)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load())
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            cnd.notify_one();
+        }
+    };
+
+    inline void sync_counters()
+    {
+        if (!p_counters) return;
+        p_counters->filled.store(filled(), std::memory_order_relaxed);
+        p_counters->processed.store(processed(), std::memory_order_relaxed);
+        p_counters->producer_waits.store(producer_waits, std::memory_order_relaxed);
+        p_counters->consumer_waits.store(consumer_waits, std::memory_order_relaxed);
+    };
+
+public:
+    int producer_waits = 0;
+    int consumer_waits = 0;
+
+    // producer side -------------------------------------------------------------------------------
+    inline uint64_t filled() const { return n_filled.load(std::memory_order_relaxed); };
+
+    // blocks until a free slot exists, false if stop() became true first
+    template <typename Stop>
+    inline bool wait_for_space(Stop &&stop)
+    {
+        return wait([this]{ return filled() - n_processed.load(std::memory_order_acquire) < n_capacity; },
+                    stop, producer_waiting, cnd_processed, producer_waits, &RingCounters::producer_waits);
+    };
+
+    inline uint64_t space() const { return n_capacity - (filled() - n_processed.load(std::memory_order_acquire)); };
+
+    inline void push(uint64_t n = 1)
+    {
+        n_filled.store(filled() + n, std::memory_order_release);
+        if (p_counters) p_counters->filled.store(filled(), std::memory_order_relaxed);
+        if (!busy_poll) wake(consumer_waiting, cnd_filled);
+    };
+
+    // consumer side -------------------------------------------------------------------------------
+    inline uint64_t processed() const { return n_processed.load(std::memory_order_relaxed); };
+
+    inline uint64_t available() const { return n_filled.load(std::memory_order_acquire) - processed(); };
+
+    // blocks until a slot is filled, false if stop() became true first
+    template <typename Stop>
+    inline bool wait_for_data(Stop &&stop)
+    {
+        return wait([this]{ return available() > 0; }, stop, consumer_waiting, cnd_filled, consumer_waits, &RingCounters::consumer_waits);
+    };
+
+    inline void pop(uint64_t n = 1)
+    {
+        n_processed.store(processed() + n, std::memory_order_release);
+        if (p_counters) p_counters->processed.store(processed(), std::memory_order_relaxed);
+        if (!busy_poll) wake(producer_waiting, cnd_processed);
+    };
+
+    // consumer only: restart reading at slot id (used to re-read a file from an earlier buffer)
+    inline void seek(uint64_t id)
+    {
+        n_processed.store(id, std::memory_order_release);
+        if (p_counters) p_counters->processed.store(id, std::memory_order_relaxed);
+    };
+
+    //----------------------------------------------------------------------------------------------
+    inline uint64_t capacity() const { return n_capacity; };
+
+    void set_busy_poll(bool _busy_poll) { busy_poll = _busy_poll; };
+
+    // mirror the indices and wait counts into counters (nullptr detaches), set before the ring is used
+    void set_counters(RingCounters *_p_counters)
+    {
+        p_counters = _p_counters;
+        if (p_counters) p_counters->capacity.store(n_capacity, std::memory_order_relaxed);
+        sync_counters();
+    };
+
+    void reset()
+    {
+        n_filled.store(0);
+        n_processed.store(0);
+        producer_waits = 0;
+        consumer_waits = 0;
+        sync_counters();
+    };
+
+    explicit SpscRing(uint64_t _capacity) : n_capacity(_capacity) {};
+};
+
+#endif // SPSCRING_HPP
@@ -0,0 +1,233 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#include "Tracer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+    std::atomic<uint64_t> n_sessions{0};
+
+    // n, mean, percentiles and a power of two histogram of latencies in ns
+    void print_histogram(std::ostream &out, const char *name, std::vector<int64_t> &v)
+    {
+        out << std::setw(11) << std::left << name << std::right;
+        if (v.empty())
+        {
+            out << "no samples" << std::endl;
+            return;
+        }
+        std::sort(v.begin(), v.end());
+        double sum = 0;
+        for (auto x : v) sum += x;
+        auto pct = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))] / 1e3; };
+        out << std::fixed << std::setprecision(1)
+            << "n " << v.size() << ", mean " << sum / v.size() / 1e3 << " us, p50 " << pct(0.5)
+            << " us, p90 " << pct(0.9) << " us, p99 " << pct(0.99) << " us, max " << v.back() / 1e3 << " us" << std::endl;
+
+        std::vector<size_t> buckets;
+        for (auto x : v)
+        {
+            size_t b = 0;
+            while ((b < 40) && ((int64_t)1000 << b) < x) ++b; // upper edges 1 us, 2 us, 4 us, ...
+            if (buckets.size() <= b) buckets.resize(b + 1, 0);
+            ++buckets[b];
+        }
+        out << std::setw(11) << "";
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            if (buckets[b] > 0) out << " <=" << (1ull << b) << "us:" << buckets[b];
+        }
+        out << std::endl;
+    }
+}
+
+void Tracer::start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    tracks.clear();
+    last_published = 0;
+    last_processed = 0;
+    session = ++n_sessions;
+    t_start = std::chrono::steady_clock::now();
+    b_running = true;
+}
+
+void Tracer::finish()
+{
+    if (!b_running.exchange(false)) return;
+    summary = latency_summary();
+    std::cout << summary;
+    write_json();
+}
+
+std::string Tracer::report() const
+{
+    return summary;
+}
+
+// the track of the calling thread, created on its first event of a session
+Tracer::Track *Tracer::track()
+{
+    thread_local const Tracer *t_owner = nullptr;
+    thread_local uint64_t t_session = 0;
+    thread_local Track *t_track = nullptr;
+    if ((t_owner != this) || (t_session != session))
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tracks.emplace_back(new Track);
+        t_track = tracks.back().get();
+        t_track->name = "thread " + std::to_string(tracks.size());
+        t_track->events.reserve(4096);
+        t_owner = this;
+        t_session = session;
+    }
+    return t_track;
+}
+
+void Tracer::record(const Event &e)
+{
+    Track *t = track();
+    if (t->events.size() < max_events) t->events.push_back(e);
+    else ++t->n_dropped;
+}
+
+void Tracer::name_thread(const char *name)
+{
+    track()->name = name;
+}
+
+int64_t Tracer::complete(const char *name, int64_t id, int64_t t_begin)
+{
+    int64_t t_end = now();
+    record({name, id, t_begin, t_end});
+    return t_end;
+}
+
+void Tracer::instant(const char *name, int64_t id)
+{
+    record({name, id, now(), -1});
+}
+
+void Tracer::line_published(int line)
+{
+    if (line <= last_published) return;
+    last_published = line;
+    instant("line_published", line);
+}
+
+void Tracer::line_processed(int line)
+{
+    if (line <= last_processed) return;
+    last_processed = line;
+    instant("line_processed", line);
+}
+
+void Tracer::write_json() const
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cout << "Tracer: Error opening " << path << std::endl;
+        return;
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"EvenTem\"}}";
+    uint64_t n_dropped = 0;
+    for (size_t tid = 0; tid < tracks.size(); tid++)
+    {
+        const Track &t = *tracks[tid];
+        n_dropped += t.n_dropped;
+        out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": \"" << t.name << "\"}}";
+        for (auto &e : t.events)
+        {
+            out << ",\n{\"name\": \"" << e.name << "\", \"pid\": 1, \"tid\": " << tid << ", \"ts\": " << e.t_begin / 1e3;
+            if (e.t_end < 0) out << ", \"ph\": \"i\", \"s\": \"t\"";
+            else out << ", \"ph\": \"X\", \"dur\": " << (e.t_end - e.t_begin) / 1e3;
+            out << ", \"args\": {\"id\": " << e.id << "}}";
+        }
+    }
+    out << "\n]}\n";
+    std::cout << "Trace of " << tracks.size() << " threads written to " << path;
+    if (n_dropped > 0) std::cout << " (" << n_dropped << " events dropped, raise max_events)";
+    std::cout << std::endl;
+}
+
+std::string Tracer::latency_summary() const
+{
+    struct BufferSpans
+    {
+        int64_t read_end = -1;
+        int64_t first_begin = INT64_MAX;
+        int64_t last_end = -1;
+    };
+    std::unordered_map<int64_t, BufferSpans> buffers;
+    std::vector<int64_t> decode, accumulate, queue, buffer, line;
+    std::vector<std::pair<int64_t, int64_t>> published, processed; // (line, time)
+
+    for (auto &t : tracks)
+    {
+        for (auto &e : t->events)
+        {
+            if (std::strcmp(e.name, "read") == 0) buffers[e.id].read_end = e.t_end;
+            else if ((std::strcmp(e.name, "decode") == 0) || (std::strcmp(e.name, "accumulate") == 0))
+            {
+                ((e.name[0] == 'd') ? decode : accumulate).push_back(e.t_end - e.t_begin);
+                BufferSpans &b = buffers[e.id];
+                b.first_begin = std::min(b.first_begin, e.t_begin);
+                b.last_end = std::max(b.last_end, e.t_end);
+            }
+            else if (std::strcmp(e.name, "line_published") == 0) published.push_back({e.id, e.t_begin});
+            else if (std::strcmp(e.name, "line_processed") == 0) processed.push_back({e.id, e.t_begin});
+        }
+    }
+    for (auto &b : buffers)
+    {
+        if ((b.second.read_end < 0) || (b.second.last_end < 0)) continue;
+        queue.push_back(std::max((int64_t)0, b.second.first_begin - b.second.read_end));
+        buffer.push_back(std::max((int64_t)0, b.second.last_end - b.second.read_end));
+    }
+
+    // every line in between two processed marks was done at the later one, and published by
+    // the first published mark beyond it
+    std::sort(published.begin(), published.end());
+    std::sort(processed.begin(), processed.end());
+    int64_t done = 0;
+    for (auto &p : processed)
+    {
+        for (int64_t l = done; l < p.first; l++)
+        {
+            auto it = std::upper_bound(published.begin(), published.end(), std::make_pair(l, INT64_MAX));
+            if (it != published.end()) line.push_back(std::max((int64_t)0, p.second - it->second));
+        }
+        done = p.first;
+    }
+
+    std::ostringstream out;
+    out << "Latency:" << std::endl;
+    print_histogram(out, "queue", queue);
+    print_histogram(out, "decode", decode);
+    print_histogram(out, "accumulate", accumulate);
+    print_histogram(out, "buffer", buffer);
+    print_histogram(out, "line", line);
+    return out.str();
+}
@@ -0,0 +1,94 @@
+/* Copyright (C) 2025 Thomas Friedrich, Chu-Ping Yu, Arno Annys
+ * University of Antwerp - All Rights Reserved.
+ * You may use, distribute and modify
+ * this code under the terms of the GPL3 license.
+ * You should have received a copy of the GPL3 license with
+ * this file. If not, please visit:
+ * https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * Authors:
+ *   Thomas Friedrich <>
+ *   Chu-Ping Yu <>
+ *   Arno Annys <arno.annys@uantwerpen.be>
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Timeline of a run: every thread records spans (buffer read, decoded, accumulated, ...) and
+// instants (line published, line processed) into its own track, without locks, identified by
+// the ring sequence number of the buffer or the scan line. finish(), called once the threads
+// are joined, writes the tracks as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) and
+// prints the latency histograms:
+//   queue:      buffer read -> first decode/accumulate span started
+//   decode:     duration of the decode spans
+//   accumulate: duration of the accumulate spans
+//   buffer:     buffer read -> last span of the buffer ended
+//   line:       line published by the detector -> line done in the line processor
+// Span and instant names must be string literals, only the pointer is stored.
+class Tracer
+{
+public:
+    std::string path;            // trace file written by finish(), tracing is off while empty
+    size_t max_events = 1 << 20; // per thread, later events are dropped
+
+    bool enabled() const { return !path.empty(); };
+    bool running() const { return b_running.load(std::memory_order_relaxed); };
+
+    void start();  // drops the previous session, times count from here
+    void finish(); // after all traced threads are joined
+    std::string report() const; // latency histograms of the last finished session
+
+    inline int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t_start).count();
+    };
+
+    void name_thread(const char *name);
+    int64_t complete(const char *name, int64_t id, int64_t t_begin); // span from t_begin to now, returns now
+    void instant(const char *name, int64_t id);
+
+    // detector: lines before 'line' are decoded (from the decoder thread only)
+    void line_published(int line);
+    // line processor: lines before 'line' are done
+    void line_processed(int line);
+
+private:
+    struct Event
+    {
+        const char *name;
+        int64_t id;
+        int64_t t_begin;
+        int64_t t_end; // -1 for instants
+    };
+    struct Track
+    {
+        std::string name;
+        std::vector<Event> events;
+        uint64_t n_dropped = 0;
+    };
+
+    std::chrono::steady_clock::time_point t_start;
+    std::atomic<bool> b_running{false};
+    uint64_t session = 0;
+    std::mutex mtx;
+    std::vector<std::unique_ptr<Track>> tracks;
+    int last_published = 0;
+    int last_processed = 0;
+    std::string summary;
+
+    Track *track();
+    void record(const Event &e);
+    void write_json() const;
+    std::string latency_summary() const;
+};
+
+#endif // TRACER_H